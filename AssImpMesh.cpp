@@ -1,4 +1,5 @@
 #include "AssImpMesh.h"
+#include "TextureCache.h"
 
 using namespace std;
 
@@ -10,25 +11,38 @@ AssImpMesh::AssImpMesh(QOpenGLShaderProgram* shader, QString name, vector<Vertex
 	_vertices = vertices;
 	_indices = indices;
 	_textures = textures;
+	// Textures are shared between meshes and clones, each holds a reference
+	if (TextureCache* cache = TextureCache::current())
+	{
+		for (const Texture& t : _textures)
+			cache->retain(t.id);
+	}
 	/*for (Texture t : _textures)
 	{
 		std::cout << "AssImpMesh::AssImpMesh : texture = " << t.id << std::endl;
 	}*/
 
 	_material = material;
+	// Imported meshes share the context's geometry arena, the foreground pass batches their draws
+	_useGeometryArena = true;
 	// Now that we have all the required data, set the vertex buffers and its attribute pointers.
 	setupMesh();
 }
 
 AssImpMesh::~AssImpMesh()
 {
-	if (_textures.size())
+	TextureCache* cache = TextureCache::current();
+	if (_textures.size() && cache)
 	{
 		for (const Texture &t : _textures)
 		{
 			//std::cout << "AssImpMesh::~AssImpMesh : texture = " << t.id << std::endl;
-			glDeleteTextures(1, &t.id);
+			cache->release(t.id);
 		}
+		// The material slots setupMesh filled hold references of their own
+		for (unsigned int* map : { &_diffuseADSMap, &_specularADSMap, &_emissiveADSMap, &_normalADSMap, &_heightADSMap, &_opacityADSMap,
+			&_albedoPBRMap, &_metallicPBRMap, &_roughnessPBRMap, &_normalPBRMap, &_aoPBRMap, &_heightPBRMap, &_opacityPBRMap })
+			setTextureMap(*map, 0);
 	}
 }
 
@@ -42,168 +56,11 @@ void AssImpMesh::render()
 	if (!_vertexArrayObject.isCreated())
 		return;
 
+	// The model's textures are in the material slots since setupMesh
 	setupTextures();
 	setupUniforms();
 
-	// Bind appropriate textures
-	unsigned int diffuseNr = 1;
-	unsigned int specularNr = 1;
-	unsigned int emissiveNr = 1;
-	unsigned int normalNr = 1;
-	unsigned int heightNr = 1;
-	unsigned int opacityNr = 1;
-	// PBR
-	unsigned int albedoNr = 1;
-	unsigned int metallicNr = 1;
-	unsigned int roughnessNr = 1;
-	unsigned int normalPBRNr = 1;
-	unsigned int aoNr = 1;
-	
-	bool hasTexture = false;
-	// ADS
-	for (unsigned int i = 0; i < _textures.size(); i++)
-	{		
-		hasTexture = false;
-		// Retrieve texture number (the N in diffuse_textureN)
-		stringstream ss;
-		string number;
-		string name = _textures[i].type;
-
-		// Transfer unsigned int to stream
-		if (name == "texture_diffuse")
-		{
-			ss << diffuseNr++;
-			hasTexture = true;
-		}
-		if (name == "texture_specular")
-		{
-			ss << specularNr++;
-			hasTexture = true;
-		}
-		if (name == "texture_emissive")
-		{
-			ss << emissiveNr++;
-			hasTexture = true;
-		}
-		if (name == "texture_normal")
-		{
-			ss << normalNr++;
-			hasTexture = true;
-		}
-		if (name == "texture_height")
-		{
-			ss << heightNr++;
-			hasTexture = true;
-		}
-		if (name == "texture_opacity")
-		{
-			ss << opacityNr++;
-			hasTexture = true;
-		}		
-		number = ss.str();
-
-		if (hasTexture)
-		{
-			glActiveTexture(GL_TEXTURE10 + i); // Active proper texture unit before binding
-			// Now set the sampler to the correct texture unit
-			_prog->bind();
-			_prog->setUniformValue((name + number).c_str(), i);
-			// And finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, _textures[i].id);
-		}
-	}
-	// PBR from ADS
-	for (unsigned int i = 0; i < _textures.size(); i++)
-	{
-		hasTexture = false;
-		// Retrieve texture number (the N in diffuse_textureN)
-		stringstream ss;
-		string number;
-		string name = _textures[i].type;
-		// Transfer unsigned int to stream
-		if (name == "texture_diffuse")
-		{
-			ss << diffuseNr++;
-			hasTexture = true;
-		}
-		if (name == "texture_specular")
-		{
-			ss << specularNr++;
-			hasTexture = true;
-		}		
-		if (name == "texture_normal")
-		{
-			ss << normalNr++;
-			hasTexture = true;
-		}
-		if (name == "texture_height")
-		{
-			ss << heightNr++;
-			hasTexture = true;
-		}
-		if (name == "texture_opacity")
-		{
-			ss << opacityNr++;
-			hasTexture = true;
-		}
-		number = ss.str();
-		if (hasTexture)
-		{
-			glActiveTexture(GL_TEXTURE20 + i); // Active proper texture unit before binding
-			// Now set the sampler to the correct texture unit
-			_prog->bind();
-			_prog->setUniformValue((name + number).c_str(), i);
-			// And finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, _textures[i].id);
-		}
-	}
-	// PBR from model
-	for (unsigned int i = 0; i < _textures.size(); i++)
-	{
-		hasTexture = false;
-		// Retrieve texture number (the N in diffuse_textureN)
-		stringstream ss;
-		string number;
-		string name = _textures[i].type;
-		// Transfer unsigned int to stream
-		if (name == "albedoMap")
-		{
-			ss << albedoNr++;
-			hasTexture = true;
-		}
-		if (name == "metallicMap")
-		{
-			ss << metallicNr++;
-			hasTexture = true;
-		}
-		if (name == "roughnessMap")
-		{
-			ss << roughnessNr++;
-			hasTexture = true;
-		}
-		if (name == "normalMap")
-		{
-			ss << normalPBRNr++;
-			hasTexture = true;
-		}		
-		if (name == "aoMap")
-		{
-			ss << aoNr++;
-			hasTexture = true;
-		}
-		number = ss.str();
-		if (hasTexture)
-		{
-			glActiveTexture(GL_TEXTURE20 + i); // Active proper texture unit before binding
-			// Now set the sampler to the correct texture unit
-			_prog->bind();
-			_prog->setUniformValue((name + number).c_str(), i);
-			// And finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, _textures[i].id);
-		}
-	}
-
-	if (_material.opacity() < 1.0f || _hasOpacityADSMap || _hasOpacityPBRMap)
+	if (isTransparent())
 	{
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -216,29 +73,10 @@ void AssImpMesh::render()
 	}
 
 	// Handle lighting normal for negative scaling
-	if ((_scaleX < 0 && _scaleY > 0 && _scaleZ > 0) ||
-		(_scaleX > 0 && _scaleY < 0 && _scaleZ > 0) ||
-		(_scaleX > 0 && _scaleY > 0 && _scaleZ < 0) ||
-		(_scaleX < 0 && _scaleY < 0 && _scaleZ < 0))
-	{
-		glFrontFace(GL_CW);
-	}
-	else
-	{
-		glFrontFace(GL_CCW);
-	}
-	_vertexArrayObject.bind();
-	glDrawElements(GL_TRIANGLES, _nVerts, GL_UNSIGNED_INT, 0);
-	_vertexArrayObject.release();
+	glFrontFace(mirrored() ? GL_CW : GL_CCW);
+	drawElements(_instanceCount);
 	_prog->release();
 	glDisable(GL_BLEND);
-
-	// Always good practice to set everything back to defaults once configured.
-	for (unsigned int i = 0; i < _textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE10 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
 }
 
 /*  Functions    */
@@ -274,74 +112,101 @@ void AssImpMesh::setupMesh()
 
 	_hasTexture = false;
 
+	// The model's textures fill the material slots, the first of a kind wins
+	auto assign = [this](unsigned int& map, unsigned int texture)
+	{
+		if (map == 0)
+			setTextureMap(map, texture);
+	};
 	for (unsigned int i = 0; i < _textures.size(); i++)
 	{
 		string name = _textures[i].type;
+		unsigned int id = _textures[i].id;
 
 		if (name == "texture_diffuse")
 		{
 			_hasDiffuseADSMap = true;
 			_hasAlbedoPBRMap = true;
+			assign(_diffuseADSMap, id);
+			assign(_albedoPBRMap, id);
 		}
 		if (name == "texture_specular")
 		{
 			_hasSpecularADSMap = true;
 			_hasMetallicPBRMap = true;
+			assign(_specularADSMap, id);
+			assign(_metallicPBRMap, id);
 		}
 		if (name == "texture_emissive")
 		{
 			_hasEmissiveADSMap = true;
+			assign(_emissiveADSMap, id);
 		}
 		if (name == "texture_normal")
 		{
 			_hasNormalADSMap = true;
 			_hasNormalPBRMap = true;
+			assign(_normalADSMap, id);
+			assign(_normalPBRMap, id);
 		}
 		if (name == "texture_height")
 		{
 			_hasHeightADSMap = true;
 			_hasHeightPBRMap = true;
+			assign(_heightADSMap, id);
+			assign(_heightPBRMap, id);
 		}
 		if (name == "texture_opacity")
 		{
 			_hasOpacityADSMap = true;
 			_hasOpacityPBRMap = true;
+			assign(_opacityADSMap, id);
+			assign(_opacityPBRMap, id);
 		}	
 
 		// PBR from model
 		if (name == "albedoMap")
 		{			
 			_hasAlbedoPBRMap = true;
+			assign(_albedoPBRMap, id);
 		}
 		if (name == "metallicMap")
 		{
 			_hasMetallicPBRMap = true;
+			assign(_metallicPBRMap, id);
 		}
 		if (name == "roughnessMap")
 		{
 			_hasRoughnessPBRMap = true;
+			assign(_roughnessPBRMap, id);
 		}
 		if (name == "normalMap")
 		{
 			_hasNormalPBRMap = true;
+			assign(_normalPBRMap, id);
 		}
 		if (name == "aoMap")
 		{
 			_hasAOPBRMap = true;
+			assign(_aoPBRMap, id);
 		}
 	}
 
+	// Large scanned or CAD meshes are bound by vertex fetch, packed normals cost them nothing visible
+	if (_vertices.size() >= COMPRESSED_VERTEX_THRESHOLD)
+		setVertexFormat(VertexFormat::Compressed);
+
 	initBuffers(&_indices, &points, &normals, &texCoords, &tangents, &bitangents);
 	computeBounds();
 }
 
 
-vector<Vertex> AssImpMesh::vertices() const
+const vector<Vertex>& AssImpMesh::vertices() const
 {
     return _vertices;
 }
 
-vector<unsigned int> AssImpMesh::indices() const
+const vector<unsigned int>& AssImpMesh::indices() const
 {
     return _indices;
 }
@@ -39,6 +39,8 @@ struct Texture
 class AssImpMesh : public TriangleMesh
 {
 public:
+	// Meshes from this many vertices on go to the GPU in the compressed vertex format
+	static constexpr size_t COMPRESSED_VERTEX_THRESHOLD = 16384;
 
 	/*  Functions  */
 	// Constructor
@@ -47,9 +49,9 @@ public:
 	virtual TriangleMesh* clone();
 	void render();
 
-    std::vector<Vertex> vertices() const;
+    const std::vector<Vertex>& vertices() const;
 
-    std::vector<unsigned int> indices() const;
+    const std::vector<unsigned int>& indices() const;
 
     std::vector<Texture> textures() const;
 
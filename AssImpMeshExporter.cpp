@@ -18,16 +18,17 @@ aiReturn AssImpMeshExporter::exportMeshes(const std::vector<AssImpMesh*>& meshes
         std::vector<aiVector3D> ainormals;
         std::vector<aiVector3D> aitexCoords;
 
-        for(Vertex v : mesh->vertices())
+        const std::vector<Vertex>& vertices = mesh->vertices();
+        aivertices.reserve(vertices.size());
+        ainormals.reserve(vertices.size());
+        aitexCoords.reserve(vertices.size());
+        for(const Vertex& v : vertices)
         {
             aivertices.push_back(aiVector3D(v.Position.x, v.Position.y, v.Position.z));
             ainormals.push_back(aiVector3D(v.Normal.x, v.Normal.y, v.Normal.z));
             aitexCoords.push_back(aiVector3D(v.TexCoords.s, v.TexCoords.t, 0));
         }
-        for(int index : mesh->indices())
-        {
-            aiindices.push_back(index);
-        }
+        aiindices = mesh->indices();
 
         aiMesh* aimesh = createMesh(aivertices, aiindices, ainormals, aitexCoords);
         aiMeshes.push_back(aimesh);
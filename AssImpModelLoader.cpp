@@ -1,5 +1,5 @@
 #include "AssImpModelLoader.h"
-#include "Utils.h"
+#include "TextureCache.h"
 
 using namespace std;
 
@@ -49,7 +49,7 @@ void AssImpModelLoader::loadModel(string path)
 	_loadingCancelled = false;
 	_path = std::string(path);
 	_meshes.clear();
-	_loadedTextures.clear();
+	releaseLoadedTextures();
 	// Read file via ASSIMP
 	_importer.SetPropertyFloat("PP_GSN_MAX_SMOOTHING_ANGLE", 15);
 	const aiScene* scene = _importer.ReadFile(path, aiProcess_CalcTangentSpace |
@@ -71,6 +71,20 @@ void AssImpModelLoader::loadModel(string path)
 
 	// Process ASSIMP's root node recursively
 	this->processNode(0, scene->mRootNode, scene);
+
+	// The meshes hold their own references now
+	releaseLoadedTextures();
+}
+
+void AssImpModelLoader::releaseLoadedTextures()
+{
+	TextureCache* cache = TextureCache::current();
+	if (cache)
+	{
+		for (const auto& loaded : _loadedTextures)
+			cache->release(loaded.second.id);
+	}
+	_loadedTextures.clear();
 }
 
 // Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -286,75 +300,55 @@ vector<Texture> AssImpModelLoader::loadMaterialTextures(aiMaterial* mat, aiTextu
 {
 	vector<Texture> textures;
 
+	// How the shaders sample the map decides its compressed format
+	TextureCache::Usage usage = TextureCache::Usage::Color;
+	if (type == aiTextureType_HEIGHT || type == aiTextureType_NORMAL_CAMERA)
+		usage = TextureCache::Usage::Normal; // texture_normal is read from the height slot
+	else if (type == aiTextureType_DISPLACEMENT || type == aiTextureType_OPACITY || type == aiTextureType_METALNESS ||
+		type == aiTextureType_DIFFUSE_ROUGHNESS || type == aiTextureType_AMBIENT_OCCLUSION)
+		usage = TextureCache::Usage::Mask;
+
 	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
 
 		// Check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-		GLboolean skip = false;
-
-		for (unsigned int j = 0; j < _loadedTextures.size(); j++)
+		auto loaded = _loadedTextures.find(str.C_Str());
+		if (loaded != _loadedTextures.end())
 		{
-			if (_loadedTextures[j].path == str)
+			if (loaded->second.id)
 			{
-				textures.push_back(_loadedTextures[j]);
-				skip = true; // A texture with the same filepath has already been loaded, continue to next one. (optimization)
-				break;
+				Texture texture = loaded->second;
+				texture.type = typeName;
+				textures.push_back(texture);
 			}
+			continue;
 		}
 
-		if (!skip)
-		{
-			// If texture hasn't been loaded already, load it
-			Texture texture;
-			texture.id = textureFromFile(str.C_Str(), this->directory);
-			texture.type = typeName;
-			texture.path = str;
+		// If texture hasn't been loaded already, load it
+		Texture texture;
+		texture.id = textureFromFile(str.C_Str(), this->directory, usage);
+		texture.type = typeName;
+		texture.path = str;
+		if (texture.id) // unreadable images are left out rather than bound as texture 0
 			textures.push_back(texture);
 
-			this->_loadedTextures.push_back(texture);  // Store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-		}
+		this->_loadedTextures[str.C_Str()] = texture;  // Store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
 	}
 
 	return textures;
 }
 
-unsigned int AssImpModelLoader::textureFromFile(const char* path, std::string directory)
+unsigned int AssImpModelLoader::textureFromFile(const char* path, std::string directory, TextureCache::Usage usage)
 {
-	//Generate texture ID and load texture data
+	// Shared with every other user of the same image through the texture cache
 	string filename = string(path);
 	filename = directory + '/' + filename;
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	QImage texImage;
-
-	if (!texImage.load(QString(filename.c_str())))
-	{ // Load first image from file
-		qWarning("AssImpModelLoader::textureFromFile - Could not read image file, using single-color instead.");
-		QImage dummy(128, 128, QImage::Format_ARGB32);
-		dummy.fill(Qt::white);
-		texImage = dummy;
-	}
-	else
-	{
-		texImage = convertToGLFormat(texImage);
-	}
-
-	// Assign texture to ID
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texImage.width(), texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, texImage.bits());
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	// Parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	return textureID;
+	TextureCache* cache = TextureCache::current();
+	if (!cache)
+		return 0;
+	return cache->acquire(QString::fromStdString(filename), usage);
 }
 
 QString AssImpModelLoader::getErrorMessage() const
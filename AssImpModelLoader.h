@@ -18,6 +18,7 @@
 #include <assimp/ProgressHandler.hpp>
 
 #include "AssImpMesh.h"
+#include "TextureCache.h"
 #include "TriangleMesh.h"
 
 
@@ -73,7 +74,7 @@ private:
 	/*  Model Data  */
 	std::vector<AssImpMesh*> _meshes;
 	std::string directory;
-	std::vector<Texture> _loadedTextures;	// Stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+	std::map<std::string, Texture> _loadedTextures;	// Textures of the model being loaded by material path, each holds one cache reference until the load ends
 
 	// Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
 	void processNode(int nodeNum, aiNode* node, const aiScene* scene);
@@ -84,7 +85,8 @@ private:
 	// The required info is returned as a Texture struct.
 	std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
 
-	unsigned int textureFromFile(const char* path, std::string directory);
+	unsigned int textureFromFile(const char* path, std::string directory, TextureCache::Usage usage);
+	void releaseLoadedTextures();
 
 	Assimp::Importer _importer;
 	AssImpModelProgressHandler* _progHandler;
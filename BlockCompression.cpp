@@ -0,0 +1,329 @@
+#include "BlockCompression.h"
+
+#include <qopengl.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace
+{
+	typedef unsigned char Texel[4];
+
+	// Next mipmap level by 2x2 box filtering, edges are clamped for odd sizes
+	std::vector<unsigned char> downsample(const unsigned char* rgba, int width, int height, bool normals)
+	{
+		const int nextWidth = std::max(1, width / 2);
+		const int nextHeight = std::max(1, height / 2);
+		std::vector<unsigned char> next(static_cast<size_t>(nextWidth) * nextHeight * 4);
+		for (int y = 0; y < nextHeight; y++)
+		{
+			for (int x = 0; x < nextWidth; x++)
+			{
+				float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				for (int j = 0; j < 2; j++)
+				{
+					const int sy = std::min(2 * y + j, height - 1);
+					for (int i = 0; i < 2; i++)
+					{
+						const int sx = std::min(2 * x + i, width - 1);
+						const unsigned char* texel = &rgba[(static_cast<size_t>(sy) * width + sx) * 4];
+						for (int c = 0; c < 4; c++)
+							sum[c] += texel[c];
+					}
+				}
+
+				unsigned char* out = &next[(static_cast<size_t>(y) * nextWidth + x) * 4];
+				if (normals)
+				{
+					// Average of unit vectors is shorter, scale it back to unit length
+					float n[3];
+					for (int c = 0; c < 3; c++)
+						n[c] = sum[c] / (4.0f * 127.5f) - 1.0f;
+					const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					for (int c = 0; c < 3; c++)
+					{
+						const float v = length > 0.0f ? n[c] / length : (c == 2 ? 1.0f : 0.0f);
+						out[c] = static_cast<unsigned char>(std::clamp((v + 1.0f) * 127.5f + 0.5f, 0.0f, 255.0f));
+					}
+					out[3] = static_cast<unsigned char>(sum[3] / 4.0f + 0.5f);
+				}
+				else
+				{
+					for (int c = 0; c < 4; c++)
+						out[c] = static_cast<unsigned char>(sum[c] / 4.0f + 0.5f);
+				}
+			}
+		}
+		return next;
+	}
+
+	unsigned short toRgb565(const float color[3])
+	{
+		const int r = static_cast<int>(std::clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+		const int g = static_cast<int>(std::clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+		const int b = static_cast<int>(std::clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+		return static_cast<unsigned short>((r << 11) | (g << 5) | b);
+	}
+
+	void fromRgb565(unsigned short color, int out[3])
+	{
+		const int r = (color >> 11) & 31;
+		const int g = (color >> 5) & 63;
+		const int b = color & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	// 4 color BC1 block: endpoints at the extremes of the colors along their
+	// principal axis, pulled in slightly, then every texel takes the nearest
+	// of the four palette entries
+	void encodeColorBlock(const Texel block[16], unsigned char* out)
+	{
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 3; c++)
+				mean[c] += block[i][c];
+		for (int c = 0; c < 3; c++)
+			mean[c] /= 16.0f;
+
+		float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // rr rg rb gg gb bb
+		for (int i = 0; i < 16; i++)
+		{
+			const float r = block[i][0] - mean[0];
+			const float g = block[i][1] - mean[1];
+			const float b = block[i][2] - mean[2];
+			covariance[0] += r * r;
+			covariance[1] += r * g;
+			covariance[2] += r * b;
+			covariance[3] += g * g;
+			covariance[4] += g * b;
+			covariance[5] += b * b;
+		}
+
+		// Principal axis by power iteration, starting from the covariance column of the widest channel
+		const int widest = covariance[0] >= covariance[3] ? (covariance[0] >= covariance[5] ? 0 : 2) : (covariance[3] >= covariance[5] ? 1 : 2);
+		const int column[3][3] = { { 0, 1, 2 }, { 1, 3, 4 }, { 2, 4, 5 } };
+		float axis[3] = { covariance[column[widest][0]], covariance[column[widest][1]], covariance[column[widest][2]] };
+		if (axis[widest] == 0.0f)
+			axis[0] = axis[1] = axis[2] = 1.0f; // solid block
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+			const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+			const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+			const float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+			if (length == 0.0f)
+				break;
+			axis[0] = x / length;
+			axis[1] = y / length;
+			axis[2] = z / length;
+		}
+		const float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+		float minT = 0.0f, maxT = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			const float t = ((block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] +
+				(block[i][2] - mean[2]) * axis[2]) / axisLength;
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+		const float inset = (maxT - minT) / 16.0f;
+		minT += inset;
+		maxT -= inset;
+
+		float high[3], low[3];
+		for (int c = 0; c < 3; c++)
+		{
+			high[c] = mean[c] + axis[c] * maxT;
+			low[c] = mean[c] + axis[c] * minT;
+		}
+		unsigned short color0 = toRgb565(high);
+		unsigned short color1 = toRgb565(low);
+		if (color0 < color1)
+			std::swap(color0, color1); // color0 > color1 selects the 4 color mode
+
+		unsigned int indices = 0;
+		if (color0 != color1)
+		{
+			int palette[4][3];
+			fromRgb565(color0, palette[0]);
+			fromRgb565(color1, palette[1]);
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0, bestDistance = INT_MAX;
+				for (int p = 0; p < 4; p++)
+				{
+					const int dr = block[i][0] - palette[p][0];
+					const int dg = block[i][1] - palette[p][1];
+					const int db = block[i][2] - palette[p][2];
+					const int distance = dr * dr + dg * dg + db * db;
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= static_cast<unsigned int>(best) << (2 * i);
+			}
+		}
+
+		out[0] = color0 & 0xFF;
+		out[1] = color0 >> 8;
+		out[2] = color1 & 0xFF;
+		out[3] = color1 >> 8;
+		for (int b = 0; b < 4; b++)
+			out[4 + b] = (indices >> (8 * b)) & 0xFF;
+	}
+
+	// 8 value BC4 block with the block's extremes as endpoints; also the alpha half of BC3
+	void encodeChannelBlock(const unsigned char values[16], unsigned char* out)
+	{
+		const unsigned char high = *std::max_element(values, values + 16);
+		const unsigned char low = *std::min_element(values, values + 16);
+		out[0] = high;
+		out[1] = low;
+
+		unsigned long long indices = 0;
+		const int range = high - low;
+		if (range > 0)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				// Steps from low to high; palette order is high, low, then 6/7 high down to 1/7 high
+				const int step = ((values[i] - low) * 7 + range / 2) / range;
+				const int index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+				indices |= static_cast<unsigned long long>(index) << (3 * i);
+			}
+		}
+		for (int b = 0; b < 6; b++)
+			out[2 + b] = (indices >> (8 * b)) & 0xFF;
+	}
+
+	void encodeBlock(const Texel block[16], BlockCompression::Format format, unsigned char* out)
+	{
+		unsigned char values[16];
+		switch (format)
+		{
+		case BlockCompression::Format::BC1:
+			encodeColorBlock(block, out);
+			break;
+		case BlockCompression::Format::BC3:
+			for (int i = 0; i < 16; i++)
+				values[i] = block[i][3];
+			encodeChannelBlock(values, out);
+			encodeColorBlock(block, out + 8);
+			break;
+		case BlockCompression::Format::BC4:
+			for (int i = 0; i < 16; i++)
+				values[i] = block[i][0];
+			encodeChannelBlock(values, out);
+			break;
+		case BlockCompression::Format::BC5:
+			for (int c = 0; c < 2; c++)
+			{
+				for (int i = 0; i < 16; i++)
+					values[i] = block[i][c];
+				encodeChannelBlock(values, out + 8 * c);
+			}
+			break;
+		}
+	}
+
+	void compressLevel(const unsigned char* rgba, int width, int height, BlockCompression::Format format, unsigned char* out)
+	{
+		const size_t blockBytes = BlockCompression::blockSize(format);
+		const int blocksX = (width + 3) / 4;
+		const int blocksY = (height + 3) / 4;
+		Texel block[16];
+		for (int by = 0; by < blocksY; by++)
+		{
+			for (int bx = 0; bx < blocksX; bx++)
+			{
+				// Blocks hanging over the edge repeat the last row and column
+				for (int j = 0; j < 4; j++)
+				{
+					const int y = std::min(4 * by + j, height - 1);
+					for (int i = 0; i < 4; i++)
+					{
+						const int x = std::min(4 * bx + i, width - 1);
+						std::memcpy(block[4 * j + i], rgba + (static_cast<size_t>(y) * width + x) * 4, 4);
+					}
+				}
+				encodeBlock(block, format, out);
+				out += blockBytes;
+			}
+		}
+	}
+}
+
+namespace BlockCompression
+{
+	size_t blockSize(Format format)
+	{
+		return format == Format::BC1 || format == Format::BC4 ? 8 : 16;
+	}
+
+	unsigned int glFormat(Format format)
+	{
+		switch (format)
+		{
+		case Format::BC1:
+			return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case Format::BC3:
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case Format::BC4:
+			return GL_COMPRESSED_RED_RGTC1;
+		case Format::BC5:
+			return GL_COMPRESSED_RG_RGTC2;
+		}
+		return 0;
+	}
+
+	Image compress(const unsigned char* rgba, int width, int height, Format format)
+	{
+		Image image = { format, width, height, {}, {} };
+		if (rgba == nullptr || width <= 0 || height <= 0)
+			return image;
+
+		// Level sizes first so the data is allocated once
+		size_t total = 0;
+		for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2))
+		{
+			const size_t size = static_cast<size_t>((w + 3) / 4) * ((h + 3) / 4) * blockSize(format);
+			image.levels.push_back({ w, h, total, size });
+			total += size;
+			if (w == 1 && h == 1)
+				break;
+		}
+		image.data.resize(static_cast<int>(total));
+
+		unsigned char* out = reinterpret_cast<unsigned char*>(image.data.data());
+		compressLevel(rgba, width, height, format, out);
+		std::vector<unsigned char> level;
+		const unsigned char* source = rgba;
+		for (size_t l = 1; l < image.levels.size(); l++)
+		{
+			const Level& previous = image.levels[l - 1];
+			level = downsample(source, previous.width, previous.height, format == Format::BC5);
+			source = level.data();
+			compressLevel(source, image.levels[l].width, image.levels[l].height, format, out + image.levels[l].offset);
+		}
+		return image;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QByteArray>
+#include <vector>
+
+// Block compression of 8 bit images into the BCn formats sampled natively by
+// the GPU, at a quarter (BC1, BC4) or half (BC3, BC5) of the RGBA8 size. The
+// encoders fit each 4x4 block's endpoints along its range, favouring speed
+// over the last bit of quality since they run when a texture is first loaded.
+// The full mipmap chain is built before compressing, compressed textures can't
+// have their mipmaps generated by the driver.
+namespace BlockCompression
+{
+	enum class Format
+	{
+		BC1, // RGB
+		BC3, // RGBA
+		BC4, // R
+		BC5  // RG, tangent space normal maps
+	};
+
+	struct Level
+	{
+		int width;
+		int height;
+		size_t offset; // into Image::data
+		size_t size;
+	};
+
+	struct Image
+	{
+		Format format;
+		int width;
+		int height;
+		std::vector<Level> levels; // level 0 first, empty when there is no image
+		QByteArray data;
+	};
+
+	// Bytes of one 4x4 block
+	size_t blockSize(Format format);
+	// OpenGL internal format of compressed data
+	unsigned int glFormat(Format format);
+
+	// rgba holds width * height RGBA8 pixels, rows bottom up as uploaded. For
+	// BC5 the pixels are normals, the mipmaps are renormalized.
+	Image compress(const unsigned char* rgba, int width, int height, Format format);
+}
@@ -0,0 +1,349 @@
+#include "BoundingVolumeHierarchy.h"
+#include "TriangleStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace
+{
+	constexpr int SAH_BINS = 16;
+	constexpr unsigned int MAX_LEAF_SIZE = RayTriangleKernels::MAX_PACKET_WIDTH; // one packet per leaf
+	constexpr unsigned int MAX_DEPTH = 60;  // keeps the fixed traversal stack below safe
+	constexpr int TRAVERSAL_STACK_SIZE = 64;
+	constexpr float NO_HIT = std::numeric_limits<float>::max();
+
+	struct Bin
+	{
+		float boundsMin[3] = { NO_HIT, NO_HIT, NO_HIT };
+		float boundsMax[3] = { -NO_HIT, -NO_HIT, -NO_HIT };
+		unsigned int triCount = 0;
+
+		void grow(const float* triBounds)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				boundsMin[a] = std::min(boundsMin[a], triBounds[a]);
+				boundsMax[a] = std::max(boundsMax[a], triBounds[a + 3]);
+			}
+		}
+
+		void grow(const Bin& other)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				boundsMin[a] = std::min(boundsMin[a], other.boundsMin[a]);
+				boundsMax[a] = std::max(boundsMax[a], other.boundsMax[a]);
+			}
+		}
+
+		float area() const
+		{
+			float ex = boundsMax[0] - boundsMin[0];
+			float ey = boundsMax[1] - boundsMin[1];
+			float ez = boundsMax[2] - boundsMin[2];
+			return ex * ey + ey * ez + ez * ex;
+		}
+	};
+
+	inline float nodeArea(const BoundingVolumeHierarchy::Node& node)
+	{
+		float ex = node.boundsMax[0] - node.boundsMin[0];
+		float ey = node.boundsMax[1] - node.boundsMin[1];
+		float ez = node.boundsMax[2] - node.boundsMin[2];
+		return ex * ey + ey * ez + ez * ex;
+	}
+
+	// Slab test, returns the entry distance or NO_HIT
+	inline float intersectsNode(const BoundingVolumeHierarchy::Node& node, const float* orig, const float* invDir, float tBest)
+	{
+		float tx1 = (node.boundsMin[0] - orig[0]) * invDir[0], tx2 = (node.boundsMax[0] - orig[0]) * invDir[0];
+		float tmin = std::min(tx1, tx2), tmax = std::max(tx1, tx2);
+		float ty1 = (node.boundsMin[1] - orig[1]) * invDir[1], ty2 = (node.boundsMax[1] - orig[1]) * invDir[1];
+		tmin = std::max(tmin, std::min(ty1, ty2)), tmax = std::min(tmax, std::max(ty1, ty2));
+		float tz1 = (node.boundsMin[2] - orig[2]) * invDir[2], tz2 = (node.boundsMax[2] - orig[2]) * invDir[2];
+		tmin = std::max(tmin, std::min(tz1, tz2)), tmax = std::min(tmax, std::max(tz1, tz2));
+		if (tmax >= tmin && tmin < tBest && tmax > 0.0f)
+			return tmin;
+		return NO_HIT;
+	}
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+{
+}
+
+void BoundingVolumeHierarchy::clear()
+{
+	_nodes.clear();
+	_nodes.shrink_to_fit();
+}
+
+void BoundingVolumeHierarchy::build(TriangleStore& triangles)
+{
+	clear();
+	const unsigned int triCount = static_cast<unsigned int>(triangles.size());
+	if (triCount == 0)
+		return;
+
+	// Per triangle bounds and centroids, only needed while building
+	std::vector<float> triBounds(triCount * 6);
+	std::vector<float> centroids(triCount * 3);
+	for (unsigned int i = 0; i < triCount; i++)
+	{
+		float v0[3], v1[3], v2[3];
+		triangles.vertices(i, v0, v1, v2);
+		for (int a = 0; a < 3; a++)
+		{
+			triBounds[6 * i + a] = std::min({ v0[a], v1[a], v2[a] });
+			triBounds[6 * i + a + 3] = std::max({ v0[a], v1[a], v2[a] });
+			centroids[3 * i + a] = (v0[a] + v1[a] + v2[a]) * (1.0f / 3.0f);
+		}
+	}
+
+	std::vector<unsigned int> triIndices(triCount);
+	for (unsigned int i = 0; i < triCount; i++)
+		triIndices[i] = i;
+
+	// A binary tree with n leaves at most has 2n - 1 nodes
+	_nodes.reserve(2 * triCount - 1);
+	Node root;
+	root.leftFirst = 0;
+	root.triCount = triCount;
+	updateNodeBounds(root, triIndices, triBounds);
+	_nodes.push_back(root);
+
+	std::vector<std::pair<unsigned int, unsigned int>> buildStack; // node index, depth
+	buildStack.push_back({ 0, 0 });
+	while (!buildStack.empty())
+	{
+		const unsigned int nodeIdx = buildStack.back().first;
+		const unsigned int depth = buildStack.back().second;
+		buildStack.pop_back();
+
+		Node& node = _nodes[nodeIdx];
+		if (node.triCount <= MAX_LEAF_SIZE || depth >= MAX_DEPTH)
+			continue;
+
+		int axis = -1;
+		float splitPos = 0.0f;
+		float splitCost = findBestSplitPlane(node, triIndices, centroids, triBounds, axis, splitPos);
+		float leafCost = node.triCount * nodeArea(node);
+		if (axis < 0 || splitCost >= leafCost)
+			continue;
+
+		// Partition the triangle permutation around the split plane
+		long long i = node.leftFirst;
+		long long j = i + node.triCount - 1;
+		while (i <= j)
+		{
+			if (centroids[3 * triIndices[i] + axis] < splitPos)
+				i++;
+			else
+				std::swap(triIndices[i], triIndices[j--]);
+		}
+		unsigned int leftCount = static_cast<unsigned int>(i - node.leftFirst);
+		if (leftCount == 0 || leftCount == node.triCount)
+			continue;
+
+		const unsigned int leftIdx = static_cast<unsigned int>(_nodes.size());
+		Node left, right;
+		left.leftFirst = node.leftFirst;
+		left.triCount = leftCount;
+		right.leftFirst = static_cast<unsigned int>(i);
+		right.triCount = node.triCount - leftCount;
+		updateNodeBounds(left, triIndices, triBounds);
+		updateNodeBounds(right, triIndices, triBounds);
+
+		node.leftFirst = leftIdx;
+		node.triCount = 0;
+
+		// Storage was reserved up front, so node stays valid across these
+		_nodes.push_back(left);
+		_nodes.push_back(right);
+
+		buildStack.push_back({ leftIdx, depth + 1 });
+		buildStack.push_back({ leftIdx + 1, depth + 1 });
+	}
+
+	// Leaves now address contiguous record ranges
+	triangles.reorder(triIndices);
+}
+
+void BoundingVolumeHierarchy::updateNodeBounds(Node& node, const std::vector<unsigned int>& triIndices, const std::vector<float>& triBounds) const
+{
+	for (int a = 0; a < 3; a++)
+	{
+		node.boundsMin[a] = NO_HIT;
+		node.boundsMax[a] = -NO_HIT;
+	}
+	for (unsigned int i = 0; i < node.triCount; i++)
+	{
+		const float* b = &triBounds[6 * triIndices[node.leftFirst + i]];
+		for (int a = 0; a < 3; a++)
+		{
+			node.boundsMin[a] = std::min(node.boundsMin[a], b[a]);
+			node.boundsMax[a] = std::max(node.boundsMax[a], b[a + 3]);
+		}
+	}
+}
+
+float BoundingVolumeHierarchy::findBestSplitPlane(const Node& node, const std::vector<unsigned int>& triIndices, const std::vector<float>& centroids,
+	const std::vector<float>& triBounds, int& axis, float& splitPos) const
+{
+	// Centroid bounds of all three axes in one pass
+	float centroidMin[3] = { NO_HIT, NO_HIT, NO_HIT };
+	float centroidMax[3] = { -NO_HIT, -NO_HIT, -NO_HIT };
+	for (unsigned int i = 0; i < node.triCount; i++)
+	{
+		const float* c = &centroids[3 * triIndices[node.leftFirst + i]];
+		for (int a = 0; a < 3; a++)
+		{
+			centroidMin[a] = std::min(centroidMin[a], c[a]);
+			centroidMax[a] = std::max(centroidMax[a], c[a]);
+		}
+	}
+
+	// Bin all three axes in one pass
+	Bin bins[3][SAH_BINS];
+	float scale[3];
+	for (int a = 0; a < 3; a++)
+		scale[a] = centroidMax[a] > centroidMin[a] ? SAH_BINS / (centroidMax[a] - centroidMin[a]) : 0.0f;
+	for (unsigned int i = 0; i < node.triCount; i++)
+	{
+		unsigned int tri = triIndices[node.leftFirst + i];
+		const float* c = &centroids[3 * tri];
+		for (int a = 0; a < 3; a++)
+		{
+			int binIdx = std::min(SAH_BINS - 1, static_cast<int>((c[a] - centroidMin[a]) * scale[a]));
+			bins[a][binIdx].triCount++;
+			bins[a][binIdx].grow(&triBounds[6 * tri]);
+		}
+	}
+
+	float bestCost = NO_HIT;
+	for (int a = 0; a < 3; a++)
+	{
+		if (scale[a] == 0.0f)
+			continue;
+
+		// Sweep from both sides to get the cost of every plane between bins
+		float leftArea[SAH_BINS - 1], rightArea[SAH_BINS - 1];
+		unsigned int leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+		Bin leftBox, rightBox;
+		unsigned int leftSum = 0, rightSum = 0;
+		for (int i = 0; i < SAH_BINS - 1; i++)
+		{
+			const Bin& lb = bins[a][i];
+			leftSum += lb.triCount;
+			leftCount[i] = leftSum;
+			if (lb.triCount)
+				leftBox.grow(lb);
+			leftArea[i] = leftSum ? leftBox.area() : 0.0f;
+
+			const Bin& rb = bins[a][SAH_BINS - 1 - i];
+			rightSum += rb.triCount;
+			rightCount[SAH_BINS - 2 - i] = rightSum;
+			if (rb.triCount)
+				rightBox.grow(rb);
+			rightArea[SAH_BINS - 2 - i] = rightSum ? rightBox.area() : 0.0f;
+		}
+
+		float binWidth = (centroidMax[a] - centroidMin[a]) / SAH_BINS;
+		for (int i = 0; i < SAH_BINS - 1; i++)
+		{
+			if (leftCount[i] == 0 || rightCount[i] == 0)
+				continue;
+			float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+			if (cost < bestCost)
+			{
+				axis = a;
+				splitPos = centroidMin[a] + binWidth * (i + 1);
+				bestCost = cost;
+			}
+		}
+	}
+	return bestCost;
+}
+
+bool BoundingVolumeHierarchy::nearestHit(const TriangleStore& triangles, const QVector3D& rayPos, const QVector3D& rayDir, RayHit& outHit) const
+{
+	if (_nodes.empty())
+		return false;
+
+	const RayTriangleKernels::Ray ray = { { rayPos.x(), rayPos.y(), rayPos.z() }, { rayDir.x(), rayDir.y(), rayDir.z() } };
+	const float* orig = ray.orig;
+	float invDir[3];
+	for (int a = 0; a < 3; a++)
+		invDir[a] = ray.dir[a] != 0.0f ? 1.0f / ray.dir[a] : 1e30f;
+
+	RayTriangleKernels::Hit hit = { NO_HIT, 0.0f, 0.0f, 0 };
+	float& tBest = hit.t;
+
+	if (intersectsNode(_nodes[0], orig, invDir, tBest) == NO_HIT)
+		return false;
+
+	unsigned int stack[TRAVERSAL_STACK_SIZE];
+	int stackPtr = 0;
+	const Node* node = &_nodes[0];
+	while (true)
+	{
+		if (node->isLeaf())
+		{
+			triangles.intersect(node->leftFirst, node->triCount, ray, hit);
+			if (stackPtr == 0)
+				break;
+			node = &_nodes[stack[--stackPtr]];
+			continue;
+		}
+
+		// Visit the nearer child first, defer the farther one
+		const Node* child1 = &_nodes[node->leftFirst];
+		const Node* child2 = &_nodes[node->leftFirst + 1];
+		float dist1 = intersectsNode(*child1, orig, invDir, tBest);
+		float dist2 = intersectsNode(*child2, orig, invDir, tBest);
+		unsigned int farIdx = node->leftFirst + 1;
+		if (dist1 > dist2)
+		{
+			std::swap(dist1, dist2);
+			std::swap(child1, child2);
+			farIdx = node->leftFirst;
+		}
+		if (dist1 == NO_HIT)
+		{
+			if (stackPtr == 0)
+				break;
+			node = &_nodes[stack[--stackPtr]];
+		}
+		else
+		{
+			node = child1;
+			if (dist2 != NO_HIT)
+				stack[stackPtr++] = farIdx;
+		}
+	}
+
+	if (tBest == NO_HIT)
+		return false;
+
+	outHit.t = hit.t;
+	outHit.triangle = triangles.triangleId(hit.index);
+	outHit.u = hit.u;
+	outHit.v = hit.v;
+	return true;
+}
+
+bool BoundingVolumeHierarchy::bounds(float* boundsMin, float* boundsMax) const
+{
+	if (_nodes.empty())
+		return false;
+	std::copy_n(_nodes[0].boundsMin, 3, boundsMin);
+	std::copy_n(_nodes[0].boundsMax, 3, boundsMax);
+	return true;
+}
+
+unsigned long long BoundingVolumeHierarchy::memorySize() const
+{
+	return _nodes.capacity() * sizeof(Node);
+}
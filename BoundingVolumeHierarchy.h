@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <QVector3D>
+
+class TriangleStore;
+
+// Bounding volume hierarchy over the triangles of a mesh, built with the
+// surface area heuristic (binned) and queried with closest-hit traversal.
+// The hierarchy only stores node bounds; building sorts the records of the
+// mesh's TriangleStore into leaf order so every leaf is a contiguous range.
+class BoundingVolumeHierarchy
+{
+public:
+	struct Node
+	{
+		float boundsMin[3];
+		unsigned int leftFirst; // left child index for interior nodes, first triangle for leaves
+		float boundsMax[3];
+		unsigned int triCount;  // 0 for interior nodes
+		bool isLeaf() const { return triCount > 0; }
+	};
+
+	// Nearest intersection along a ray
+	struct RayHit
+	{
+		float t;               // distance along the ray direction
+		unsigned int triangle; // triangle id in the mesh index array
+		float u;               // barycentric weight of the triangle's second vertex
+		float v;               // barycentric weight of the triangle's third vertex
+	};
+
+	BoundingVolumeHierarchy();
+
+	void build(TriangleStore& triangles);
+	void clear();
+
+	bool isEmpty() const { return _nodes.empty(); }
+	size_t nodeCount() const { return _nodes.size(); }
+	bool bounds(float* boundsMin, float* boundsMax) const; // of the root node, false when empty
+
+	bool nearestHit(const TriangleStore& triangles, const QVector3D& rayPos, const QVector3D& rayDir, RayHit& outHit) const;
+
+	unsigned long long memorySize() const;
+
+private:
+	void updateNodeBounds(Node& node, const std::vector<unsigned int>& triIndices, const std::vector<float>& triBounds) const;
+	float findBestSplitPlane(const Node& node, const std::vector<unsigned int>& triIndices, const std::vector<float>& centroids,
+		const std::vector<float>& triBounds, int& axis, float& splitPos) const;
+
+	std::vector<Node> _nodes;
+};
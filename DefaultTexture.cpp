@@ -0,0 +1,97 @@
+#include "DefaultTexture.h"
+#include "Utils.h"
+#include "config.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+#include <map>
+
+namespace
+{
+	struct ContextTexture
+	{
+		unsigned int texture;
+		int references;
+	};
+
+	std::map<QOpenGLContextGroup*, ContextTexture>& groupTextures()
+	{
+		static std::map<QOpenGLContextGroup*, ContextTexture> textures;
+		return textures;
+	}
+}
+
+QImage DefaultTexture::image()
+{
+	static const QImage defaultImage = []()
+	{
+		const QString path = QString(MODELVIEWER_DATA_DIR) + "/";
+		QImage texBuffer;
+		if (!texBuffer.load(path + "textures/opengllogo.png"))
+		{ // Load first image from file
+			qWarning("DefaultTexture::image - Could not read image file, using single-color instead.");
+			QImage dummy(128, 128, QImage::Format_ARGB32);
+			dummy.fill(Qt::white);
+			texBuffer = dummy;
+		}
+		return convertToGLFormat(texBuffer);
+	}();
+	return defaultImage;
+}
+
+unsigned int DefaultTexture::acquire()
+{
+	QOpenGLContext* context = QOpenGLContext::currentContext();
+	if (!context)
+		return 0;
+
+	QOpenGLContextGroup* group = context->shareGroup();
+	auto& textures = groupTextures();
+	auto it = textures.find(group);
+	if (it != textures.end())
+	{
+		it->second.references++;
+		return it->second.texture;
+	}
+
+	const QImage texImage = image();
+	QOpenGLFunctions* f = context->functions();
+	unsigned int texture = 0;
+	f->glGenTextures(1, &texture);
+	f->glBindTexture(GL_TEXTURE_2D, texture);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	f->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texImage.width(), texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, texImage.bits());
+	f->glGenerateMipmap(GL_TEXTURE_2D);
+
+	textures[group] = { texture, 1 };
+	// The texture goes away with the group's last context, forget it then
+	QObject::connect(group, &QObject::destroyed, [group]()
+		{
+			groupTextures().erase(group);
+		});
+	return texture;
+}
+
+void DefaultTexture::release(QOpenGLContext* context)
+{
+	auto& textures = groupTextures();
+	auto it = textures.find(context->shareGroup());
+	if (it == textures.end())
+		return;
+
+	if (--it->second.references > 0)
+		return;
+
+	// Can only be deleted while a context of the group is current, otherwise it lives until the group goes
+	QOpenGLContext* current = QOpenGLContext::currentContext();
+	if (current && current->shareGroup() == it->first)
+	{
+		current->functions()->glDeleteTextures(1, &it->second.texture);
+		textures.erase(it);
+	}
+}
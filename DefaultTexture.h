@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QImage>
+
+class QOpenGLContext;
+
+// The opengllogo.png texture shown on textured meshes that have no image of
+// their own. The image is decoded once per process and every OpenGL context
+// share group gets a single texture object, created on the first textured
+// render. Meshes hold a reference and the texture is deleted with the last one.
+class DefaultTexture
+{
+public:
+	static QImage image();
+
+	// Texture of the current context's group, created on first use; adds a reference
+	static unsigned int acquire();
+	static void release(QOpenGLContext* context);
+};
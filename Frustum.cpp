@@ -0,0 +1,51 @@
+#include "Frustum.h"
+#include "BoundingSphere.h"
+#include "BoundingBox.h"
+
+Frustum::Frustum()
+{
+	_planes.fill(QVector4D(0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+Frustum::Frustum(const QMatrix4x4& viewProjection)
+{
+	const QVector4D x = viewProjection.row(0);
+	const QVector4D y = viewProjection.row(1);
+	const QVector4D z = viewProjection.row(2);
+	const QVector4D w = viewProjection.row(3);
+	// left, right, bottom, top, near, far
+	_planes = { w + x, w - x, w + y, w - y, w + z, w - z };
+
+	// Normalized so the sphere test compares true distances
+	for (QVector4D& plane : _planes)
+	{
+		const float length = plane.toVector3D().length();
+		if (length > 0.0f)
+			plane /= length;
+	}
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const
+{
+	const QVector3D center = sphere.getCenter();
+	for (const QVector4D& plane : _planes)
+	{
+		if (QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() < -sphere.getRadius())
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::intersects(const BoundingBox& box) const
+{
+	for (const QVector4D& plane : _planes)
+	{
+		// The corner furthest along the plane normal
+		const QVector3D corner(plane.x() >= 0.0f ? box.xMax() : box.xMin(),
+			plane.y() >= 0.0f ? box.yMax() : box.yMin(),
+			plane.z() >= 0.0f ? box.zMax() : box.zMin());
+		if (QVector3D::dotProduct(plane.toVector3D(), corner) + plane.w() < 0.0f)
+			return false;
+	}
+	return true;
+}
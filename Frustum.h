@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QVector4D>
+#include <array>
+
+class BoundingSphere;
+class BoundingBox;
+
+// The six planes of a view volume, extracted from the rows of a view
+// projection matrix (Gribb and Hartmann), perspective and orthographic alike.
+// The planes are in the space the matrix maps from and face inwards, a
+// volume is outside when it is entirely behind one of them. The tests are
+// conservative, volumes straddling a corner may pass.
+class Frustum
+{
+public:
+	Frustum(); // contains everything
+	explicit Frustum(const QMatrix4x4& viewProjection);
+
+	bool intersects(const BoundingSphere& sphere) const;
+	bool intersects(const BoundingBox& box) const;
+
+private:
+	std::array<QVector4D, 6> _planes;
+};
@@ -1,5 +1,6 @@
 
 #include <QMenu>
+#include <QFile>
 #include <QMessageBox>
 #include <QStyleFactory>
 
@@ -57,9 +58,16 @@
 #include "stb_image.h"
 
 #include "AssImpModelLoader.h"
+#include "TextureCache.h"
+#include "MaterialTextures.h"
+#include "SharedResources.h"
+#include "IndirectDraws.h"
+#include "OcclusionCuller.h"
 
 #include "config.h"
 
+#include <algorithm>
+
 
 using glm::mat4;
 using glm::vec3;
@@ -70,10 +78,15 @@ GLWidget::GLWidget(QWidget* parent, const char* /*name*/) : QOpenGLWidget(parent
 _bgShader(nullptr),
 _bgSplitShader(nullptr),
 _fgShader(nullptr),
+_fgVariants(nullptr),
+_indirectDraws(nullptr),
+_occlusionCuller(nullptr),
+_frameUniforms(),
 _axisShader(nullptr),
 _vertexNormalShader(nullptr),
 _faceNormalShader(nullptr),
 _shadowMappingShader(nullptr),
+_shadowMultiDrawShader(nullptr),
 _skyBoxShader(nullptr),
 _irradianceShader(nullptr),
 _prefilterShader(nullptr),
@@ -147,6 +160,10 @@ _assimpModelLoader(nullptr)
 	_renderingMode = RenderingMode::ADS_PHONG;
 
 	_multiViewActive = false;
+	_viewportLayerArray = false;
+	_viewCount = 1;
+	_culledMeshCount = 0;
+	_drawnMeshCount = 0;
 
 	_showAxis = true;
 
@@ -291,10 +308,15 @@ _assimpModelLoader(nullptr)
 
 GLWidget::~GLWidget()
 {
+	makeCurrent();
 	if (_textRenderer)
 		delete _textRenderer;
 	if (_axisTextRenderer)
 		delete _axisTextRenderer;
+	if (_indirectDraws)
+		delete _indirectDraws;
+	if (_occlusionCuller)
+		delete _occlusionCuller;
 
 	for (auto a : _meshStore)
 	{
@@ -308,18 +330,23 @@ GLWidget::~GLWidget()
 
 	cleanUpShaders();
 
-	//std::cout << "GLWidget::~GLWidget : _environmentMap = " << _environmentMap << std::endl;
-	glDeleteTextures(1, &_environmentMap);
+	// The environment and IBL maps may be in use by other windows
+	if (SharedResources* shared = SharedResources::forContext(context()))
+	{
+		//std::cout << "GLWidget::~GLWidget : _environmentMap = " << _environmentMap << std::endl;
+		shared->releaseTexture(_environmentMap);
+		//std::cout << "GLWidget::~GLWidget : _irradianceMap = " << _irradianceMap << std::endl;
+		shared->releaseTexture(_irradianceMap);
+		//std::cout << "GLWidget::~GLWidget : _prefilterMap = " << _prefilterMap << std::endl;
+		shared->releaseTexture(_prefilterMap);
+		//std::cout << "GLWidget::~GLWidget : _brdfLUTTexture = " << _brdfLUTTexture << std::endl;
+		shared->releaseTexture(_brdfLUTTexture);
+	}
 	//std::cout << "GLWidget::~GLWidget : _shadowMap = " << _shadowMap << std::endl;
 	glDeleteTextures(1, &_shadowMap);
-	//std::cout << "GLWidget::~GLWidget : _irradianceMap = " << _irradianceMap << std::endl;
-	glDeleteTextures(1, &_irradianceMap);
-	//std::cout << "GLWidget::~GLWidget : _prefilterMap = " << _prefilterMap << std::endl;
-	glDeleteTextures(1, &_prefilterMap);
-	//std::cout << "GLWidget::~GLWidget : _brdfLUTTexture = " << _brdfLUTTexture << std::endl;
-	glDeleteTextures(1, &_brdfLUTTexture);
 	//std::cout << "GLWidget::~GLWidget : _cappingTexture = " << _cappingTexture << std::endl;
-	glDeleteTextures(1, &_cappingTexture);
+	if (TextureCache* textureCache = TextureCache::forContext(context()))
+		textureCache->release(_cappingTexture);
 
 	if (_clippingPlaneXY)
 		delete _clippingPlaneXY;
@@ -342,16 +369,20 @@ GLWidget::~GLWidget()
 	_bgSplitVBO.destroy();
 	_bgSplitVAO.destroy();
 
+	_frameUniformBuffer.destroy();
+	_viewUniformBuffer.destroy();
+
 	_bgVAO.destroy();
 }
 
 void GLWidget::cleanUpShaders()
 {
-	if (_fgShader)	delete _fgShader;
+	if (_fgVariants) delete _fgVariants; // _fgShader is one of them
 	if (_axisShader) delete _axisShader;
 	if (_vertexNormalShader) delete _vertexNormalShader;
 	if (_faceNormalShader) delete _faceNormalShader;
 	if (_shadowMappingShader) delete _shadowMappingShader;
+	if (_shadowMultiDrawShader) delete _shadowMultiDrawShader;
 	if (_skyBoxShader) delete _skyBoxShader;
 	if (_irradianceShader) delete _irradianceShader;
 	if (_prefilterShader) delete _prefilterShader;
@@ -405,13 +436,28 @@ void GLWidget::setSkyBoxTextureFolder(QString folder)
 
 	makeCurrent();
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
+	// The current texture may be shared with other windows, so the faces go into a
+	// new one, unless another window shows this skybox already
+	SharedResources* shared = SharedResources::forContext(context());
+	const QString key = environmentKey();
+	unsigned int environmentMap = shared->acquireTexture(key);
+	const bool loadFaces = environmentMap == 0;
+	if (loadFaces)
+	{
+		glGenTextures(1, &environmentMap);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, environmentMap);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
 
 	stbi_set_flip_vertically_on_load(true);
 	bool loaded = false;
 	int width, height, nrComponents;
 	void* data = nullptr;
-	for (unsigned int i = 0; i < _skyBoxFaces.size(); i++)
+	for (unsigned int i = 0; loadFaces && i < _skyBoxFaces.size(); i++)
 	{
 		if (!_skyBoxTextureHDRI)
 		{
@@ -446,6 +492,7 @@ void GLWidget::setSkyBoxTextureFolder(QString folder)
 		}
 		else
 		{
+			glDeleteTextures(1, &environmentMap);
 			if (_skyBoxTextureHDRI)
 			{
 				QMessageBox::critical(this, "Error", "Skybox HDR files are not found in the selected folder\n"
@@ -475,6 +522,13 @@ void GLWidget::setSkyBoxTextureFolder(QString folder)
 			return;
 		}
 	}
+	if (loadFaces)
+		shared->insertTexture(key, environmentMap);
+	shared->releaseTexture(_environmentMap);
+	_environmentMap = environmentMap;
+	_environmentKey = key;
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
 	loadIrradianceMap();
 	update();
 	QApplication::restoreOverrideCursor();
@@ -644,6 +698,8 @@ void GLWidget::setDisplayList(const std::vector<int>& ids)
 	if (_hiddenObjectsIds.size() == 0 && _visibleSwapped)
 		_visibleSwapped = false;
 
+	_sceneHierarchy.sync(_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds, _meshStore);
+
 	_currentTranslation = _primaryCamera->getPosition();
 	_boundingSphere.setCenter(0, 0, 0);
 
@@ -823,6 +879,7 @@ void GLWidget::removeFromDisplay(int index)
 	TriangleMesh* mesh = _meshStore[index];
 	_meshStore.erase(_meshStore.begin() + index);
 	delete mesh;
+	_sceneHierarchy.clear(); // ids after index have shifted
 	if (_meshStore.size() == 0)
 	{
 		_displayedObjectsIds.clear();
@@ -951,6 +1008,7 @@ void GLWidget::showModelLoadingProgress(int nodeNum, int totalNodes)
 void GLWidget::swapVisible(bool checked)
 {
 	_visibleSwapped = checked;
+	_sceneHierarchy.sync(_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds, _meshStore);
 	updateBoundingSphere();
 	if (_autoFitViewOnUpdate)
 		fitAll();
@@ -981,7 +1039,8 @@ void GLWidget::enableADSDiffuseTexMap(const std::vector<int>& ids, const bool& e
 
 void GLWidget::setADSDiffuseTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path);
 	for (int id : ids)
 	{
 		try
@@ -994,6 +1053,7 @@ void GLWidget::setADSDiffuseTexMap(const std::vector<int>& ids, const QString& p
 			std::cout << "Exception in GLWidget::setADSDiffuseTexMap\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearADSDiffuseTexMap(const std::vector<int>& ids)
@@ -1030,7 +1090,8 @@ void GLWidget::enableADSSpecularTexMap(const std::vector<int>& ids, const bool&
 
 void GLWidget::setADSSpecularTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path);
 	for (int id : ids)
 	{
 		try
@@ -1043,6 +1104,7 @@ void GLWidget::setADSSpecularTexMap(const std::vector<int>& ids, const QString&
 			std::cout << "Exception in GLWidget::setADSSpecularTexMap\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearADSSpecularTexMap(const std::vector<int>& ids)
@@ -1079,7 +1141,8 @@ void GLWidget::enableADSEmissiveTexMap(const std::vector<int>& ids, const bool&
 
 void GLWidget::setADSEmissiveTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path);
 	for (int id : ids)
 	{
 		try
@@ -1092,6 +1155,7 @@ void GLWidget::setADSEmissiveTexMap(const std::vector<int>& ids, const QString&
 			std::cout << "Exception in GLWidget::setADSEmissiveTexMap\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearADSEmissiveTexMap(const std::vector<int>& ids)
@@ -1128,7 +1192,8 @@ void GLWidget::enableADSNormalTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setADSNormalTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path, TextureCache::Usage::Normal);
 	for (int id : ids)
 	{
 		try
@@ -1141,6 +1206,7 @@ void GLWidget::setADSNormalTexMap(const std::vector<int>& ids, const QString& pa
 			std::cout << "Exception in GLWidget::setADSNormalTexMap\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearADSNormalTexMap(const std::vector<int>& ids)
@@ -1177,7 +1243,8 @@ void GLWidget::enableADSHeightTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setADSHeightTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path, TextureCache::Usage::Mask);
 	for (int id : ids)
 	{
 		try
@@ -1190,6 +1257,7 @@ void GLWidget::setADSHeightTexMap(const std::vector<int>& ids, const QString& pa
 			std::cout << "Exception in GLWidget::setADSHeightTexMap\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearADSHeightTexMap(const std::vector<int>& ids)
@@ -1242,7 +1310,8 @@ void GLWidget::invertADSOpacityTexMap(const std::vector<int>& ids, const bool& i
 
 void GLWidget::setADSOpacityTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path, TextureCache::Usage::Mask);
 	for (int id : ids)
 	{
 		try
@@ -1255,6 +1324,7 @@ void GLWidget::setADSOpacityTexMap(const std::vector<int>& ids, const QString& p
 			std::cout << "Exception in GLWidget::setADSOpacityTexMap\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearADSOpacityTexMap(const std::vector<int>& ids)
@@ -1387,7 +1457,8 @@ void GLWidget::enablePBRAlbedoTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setPBRAlbedoTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path);
 	for (int id : ids)
 	{
 		try
@@ -1400,6 +1471,7 @@ void GLWidget::setPBRAlbedoTexMap(const std::vector<int>& ids, const QString& pa
 			std::cout << "Exception in GLWidget::setAlbedoTexture\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearPBRAlbedoTexMap(const std::vector<int>& ids)
@@ -1436,7 +1508,8 @@ void GLWidget::enablePBRMetallicTexMap(const std::vector<int>& ids, const bool&
 
 void GLWidget::setPBRMetallicTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path, TextureCache::Usage::Mask);
 	for (int id : ids)
 	{
 		try
@@ -1449,6 +1522,7 @@ void GLWidget::setPBRMetallicTexMap(const std::vector<int>& ids, const QString&
 			std::cout << "Exception in GLWidget::setMetallicTexture\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearPBRMetallicTexMap(const std::vector<int>& ids)
@@ -1485,7 +1559,8 @@ void GLWidget::enablePBRRoughnessTexMap(const std::vector<int>& ids, const bool&
 
 void GLWidget::setPBRRoughnessTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path, TextureCache::Usage::Mask);
 	for (int id : ids)
 	{
 		try
@@ -1498,6 +1573,7 @@ void GLWidget::setPBRRoughnessTexMap(const std::vector<int>& ids, const QString&
 			std::cout << "Exception in GLWidget::setRoughnessTexture\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearPBRRoughnessTexMap(const std::vector<int>& ids)
@@ -1534,7 +1610,8 @@ void GLWidget::enablePBRNormalTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setPBRNormalTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path, TextureCache::Usage::Normal);
 	for (int id : ids)
 	{
 		try
@@ -1547,6 +1624,7 @@ void GLWidget::setPBRNormalTexMap(const std::vector<int>& ids, const QString& pa
 			std::cout << "Exception in GLWidget::setNormalTexture\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearPBRNormalTexMap(const std::vector<int>& ids)
@@ -1583,7 +1661,8 @@ void GLWidget::enablePBRAOTexMap(const std::vector<int>& ids, const bool& enable
 
 void GLWidget::setPBRAOTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path, TextureCache::Usage::Mask);
 	for (int id : ids)
 	{
 		try
@@ -1596,6 +1675,7 @@ void GLWidget::setPBRAOTexMap(const std::vector<int>& ids, const QString& path)
 			std::cout << "Exception in GLWidget::setAOTexture\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearPBRAOTexMap(const std::vector<int>& ids)
@@ -1632,7 +1712,8 @@ void GLWidget::enablePBROpacityTexMap(const std::vector<int>& ids, const bool& e
 
 void GLWidget::setPBROpacityTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path, TextureCache::Usage::Mask);
 	for (int id : ids)
 	{
 		try
@@ -1645,6 +1726,7 @@ void GLWidget::setPBROpacityTexMap(const std::vector<int>& ids, const QString& p
 			std::cout << "Exception in GLWidget::setPBROpacityTexMap\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::invertPBROpacityTexMap(const std::vector<int>& ids, const bool& inverted)
@@ -1697,7 +1779,8 @@ void GLWidget::enablePBRHeightTexMap(const std::vector<int>& ids, const bool& en
 
 void GLWidget::setPBRHeightTexMap(const std::vector<int>& ids, const QString& path)
 {
-	unsigned int texId = loadTextureFromFile(path.toStdString().c_str());
+	TextureCache* cache = TextureCache::forContext(context());
+	unsigned int texId = cache->acquire(path, TextureCache::Usage::Mask);
 	for (int id : ids)
 	{
 		try
@@ -1710,6 +1793,7 @@ void GLWidget::setPBRHeightTexMap(const std::vector<int>& ids, const QString& pa
 			std::cout << "Exception in GLWidget::setHeightTexture\n" << ex.what() << std::endl;
 		}
 	}
+	cache->release(texId);
 }
 
 void GLWidget::clearPBRHeightTexMap(const std::vector<int>& ids)
@@ -1754,6 +1838,7 @@ void GLWidget::setTransformation(const std::vector<int>& ids, const QVector3D& t
 			mesh->setTranslation(trans);
 			mesh->setRotation(rot);
 			mesh->setScaling(scale);
+			_sceneHierarchy.update(id);
 		}
 		catch (const std::exception& ex)
 		{
@@ -1771,6 +1856,7 @@ void GLWidget::resetTransformation(const std::vector<int>& ids)
 		{
 			TriangleMesh* mesh = _meshStore[id];
 			mesh->resetTransformations();
+			_sceneHierarchy.update(id);
 		}
 		catch (const std::exception& ex)
 		{
@@ -1787,6 +1873,17 @@ void GLWidget::initializeGL()
 	makeCurrent();
 
 	createShaderPrograms();
+	_indirectDraws = new IndirectDraws();
+	_viewportLayerArray = context()->hasExtension("GL_ARB_shader_viewport_layer_array");
+	if (QOpenGLShader::hasOpenGLShaders(QOpenGLShader::Compute, context()))
+	{
+		_occlusionCuller = new OcclusionCuller(QString(MODELVIEWER_DATA_DIR) + "/shaders/");
+		if (!_occlusionCuller->isValid())
+		{
+			delete _occlusionCuller;
+			_occlusionCuller = nullptr;
+		}
+	}
 
 	_assimpModelLoader = new AssImpModelLoader(_fgShader);
 	connect(_assimpModelLoader, SIGNAL(fileReadProcessed(float)), this, SLOT(showFileReadingProgress(float)));
@@ -1816,19 +1913,13 @@ void GLWidget::initializeGL()
 
 	createGeometry();
 
-	// Set lighting information
-	_fgShader->bind();
-	_fgShader->setUniformValue("lightSource.ambient", _ambientLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.diffuse", _diffuseLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.specular", _specularLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.position", _lightPosition + QVector3D(_lightOffsetX, _lightOffsetY, _lightOffsetZ));
-	_fgShader->setUniformValue("lightModel.ambient", QVector3D(0.2f, 0.2f, 0.2f));
-	_fgShader->setUniformValue("texUnit", 0);
-	_fgShader->setUniformValue("envMap", 1);
-	_fgShader->setUniformValue("shadowMap", 2);
-	_fgShader->setUniformValue("irradianceMap", 3);
-	_fgShader->setUniformValue("prefilterMap", 4);
-	_fgShader->setUniformValue("brdfLUT", 5);
+	// Lighting and the rest of the per view state go in the frame uniforms on every render
+	_frameUniformBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer); // only bound as a uniform buffer
+	_frameUniformBuffer.create();
+	glNamedBufferData(_frameUniformBuffer.bufferId(), sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+	_viewUniformBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	_viewUniformBuffer.create();
+	glNamedBufferData(_viewUniformBuffer.bufferId(), sizeof(ViewUniforms), nullptr, GL_DYNAMIC_DRAW);
 
 	/*std::vector<int> ids;
 	for(size_t i = 0; i < _meshStore.size(); i++)
@@ -1852,19 +1943,37 @@ void GLWidget::initializeGL()
 
 bool GLWidget::loadCompileAndLinkShaderFromFile(QOpenGLShaderProgram* prog, const QString& vertexProg,
 	const QString& fragmentProg, const QString& geometryProg,
-	const QString& tessControlProg, const QString& tessEvalProg)
+	const QString& tessControlProg, const QString& tessEvalProg, const QStringList& defines)
 {
 	if (prog == nullptr || vertexProg == "" || fragmentProg == "")
 		return false;
 
-	bool success = prog->addShaderFromSourceFile(QOpenGLShader::Vertex, vertexProg);
+	// Defines go right after the #version line of every stage.
+	// The stages are only compiled by link() when Qt's shader disk cache has no binary
+	// of the program yet, the binaries are keyed by the sources and the GL driver.
+	auto addShader = [prog, &defines](QOpenGLShader::ShaderType type, const QString& fileName)
+	{
+		if (defines.isEmpty())
+			return prog->addCacheableShaderFromSourceFile(type, fileName);
+		QFile file(fileName);
+		if (!file.open(QIODevice::ReadOnly))
+			return false;
+		QByteArray source = file.readAll();
+		QByteArray header;
+		for (const QString& define : defines)
+			header += "#define " + define.toLatin1() + "\n";
+		source.insert(source.startsWith("#version") ? source.indexOf('\n') + 1 : 0, header);
+		return prog->addCacheableShaderFromSourceCode(type, source);
+	};
+
+	bool success = addShader(QOpenGLShader::Vertex, vertexProg);
 	if (!success)
 	{
 		qDebug() << "Error in vertex shader:" << prog->objectName() << prog->log();
 	}
 	if (tessControlProg != "")
 	{
-		success = prog->addShaderFromSourceFile(QOpenGLShader::TessellationControl, tessControlProg);
+		success = addShader(QOpenGLShader::TessellationControl, tessControlProg);
 		if (!success)
 		{
 			qDebug() << "Error in tessellation  control shader:" << prog->objectName() << prog->log();
@@ -1872,7 +1981,7 @@ bool GLWidget::loadCompileAndLinkShaderFromFile(QOpenGLShaderProgram* prog, cons
 	}
 	if (tessEvalProg != "")
 	{
-		success = prog->addShaderFromSourceFile(QOpenGLShader::TessellationEvaluation, tessEvalProg);
+		success = addShader(QOpenGLShader::TessellationEvaluation, tessEvalProg);
 		if (!success)
 		{
 			qDebug() << "Error in tessellation  evaluation shader:" << prog->objectName() << prog->log();
@@ -1880,13 +1989,13 @@ bool GLWidget::loadCompileAndLinkShaderFromFile(QOpenGLShaderProgram* prog, cons
 	}
 	if (geometryProg != "")
 	{
-		success = prog->addShaderFromSourceFile(QOpenGLShader::Geometry, geometryProg);
+		success = addShader(QOpenGLShader::Geometry, geometryProg);
 		if (!success)
 		{
 			qDebug() << "Error in geometry shader:" << prog->objectName() << prog->log();
 		}
 	}
-	success = prog->addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentProg);
+	success = addShader(QOpenGLShader::Fragment, fragmentProg);
 	if (!success)
 	{
 		qDebug() << "Error in fragment shader:" << prog->objectName() << prog->log();
@@ -1908,9 +2017,20 @@ void GLWidget::createShaderPrograms()
     const QString path = QString(MODELVIEWER_DATA_DIR) + "/";
 	// Foreground objects shader program
 	// Per fragment lighting
-	_fgShader = new QOpenGLShaderProgram(this); _fgShader->setObjectName("_fgShader");
-    loadCompileAndLinkShaderFromFile(_fgShader, path + "shaders/twoside_per_fragment.vert",
-        path + "shaders/twoside_per_fragment.frag", path + "shaders/twoside_per_fragment.geom");
+	// Variants are built on first use, only the wireshaded ones have the geometry stage
+	// Material maps come from resident handles where the driver supports them
+	const bool bindless = MaterialTextures::forContext(context())->bindless();
+	_fgVariants = new ShaderVariants("_fgShader", [this, path, bindless](QOpenGLShaderProgram* prog, ShaderVariants::Features features, const QStringList& defines)
+		{
+			QStringList fgDefines = defines;
+			if (bindless)
+				fgDefines << "BINDLESS_TEXTURES";
+			const QString geometryProg = (features & ShaderVariants::WIRESHADED) ? path + "shaders/twoside_per_fragment.geom" : QString();
+			return loadCompileAndLinkShaderFromFile(prog, path + "shaders/twoside_per_fragment.vert",
+				path + "shaders/twoside_per_fragment.frag", geometryProg, "", "", fgDefines);
+		});
+	// The meshes are created with the full variant, the foreground pass picks theirs when drawing
+	_fgShader = _fgVariants->program(ShaderVariants::ALL_FEATURES);
 	// Axis
 	_axisShader = new QOpenGLShaderProgram(this); _axisShader->setObjectName("_axisShader");
     loadCompileAndLinkShaderFromFile(_axisShader, path + "shaders/axis.vert", path + "shaders/axis.frag");
@@ -1926,6 +2046,14 @@ void GLWidget::createShaderPrograms()
 	_shadowMappingShader = new QOpenGLShaderProgram(this); _shadowMappingShader->setObjectName("_shadowMappingShader");
     loadCompileAndLinkShaderFromFile(_shadowMappingShader, path + "shaders/shadow_mapping_depth.vert",
         path + "shaders/shadow_mapping_depth.frag");
+	// Shadow mapping of the geometry arena meshes, one draw call per pool
+	_shadowMultiDrawShader = new QOpenGLShaderProgram(this); _shadowMultiDrawShader->setObjectName("_shadowMultiDrawShader");
+	if (!loadCompileAndLinkShaderFromFile(_shadowMultiDrawShader, path + "shaders/shadow_mapping_depth.vert",
+		path + "shaders/shadow_mapping_depth.frag", "", "", "", QStringList() << "MULTI_DRAW"))
+	{
+		delete _shadowMultiDrawShader;
+		_shadowMultiDrawShader = nullptr;
+	}
 	// Sky Box
 	_skyBoxShader = new QOpenGLShaderProgram(this); _skyBoxShader->setObjectName("_skyBoxShader");
     loadCompileAndLinkShaderFromFile(_skyBoxShader, path + "shaders/skybox.vert", path + "shaders/skybox.frag");
@@ -2126,45 +2254,53 @@ void GLWidget::loadEnvMap()
 	};
 
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
-	glGenTextures(1, &_environmentMap);
-	//std::cout << "GLWidget::loadEnvMap : _environmentMap = " << _environmentMap << std::endl;
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
-
-	stbi_set_flip_vertically_on_load(true);
-	int width, height, nrComponents;
-	void* data = nullptr;
-	for (unsigned int i = 0; i < _skyBoxFaces.size(); i++)
-	{
-		if (_skyBoxTextureHDRI)
-			data = static_cast<float*>(stbi_loadf((_skyBoxFaces.at(i)).toStdString().c_str(), &width, &height, &nrComponents, 0));
-		else
-			data = static_cast<unsigned char*>(stbi_load((_skyBoxFaces.at(i)).toStdString().c_str(), &width, &height, &nrComponents, 0));
-
-		if (data)
+	// Windows showing the same skybox share its texture
+	SharedResources* shared = SharedResources::forContext(context());
+	_environmentKey = environmentKey();
+	_environmentMap = shared->acquireTexture(_environmentKey);
+	if (_environmentMap == 0)
+	{
+		glGenTextures(1, &_environmentMap);
+		//std::cout << "GLWidget::loadEnvMap : _environmentMap = " << _environmentMap << std::endl;
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
+
+		stbi_set_flip_vertically_on_load(true);
+		int width, height, nrComponents;
+		void* data = nullptr;
+		for (unsigned int i = 0; i < _skyBoxFaces.size(); i++)
 		{
 			if (_skyBoxTextureHDRI)
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+				data = static_cast<float*>(stbi_loadf((_skyBoxFaces.at(i)).toStdString().c_str(), &width, &height, &nrComponents, 0));
 			else
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-			stbi_image_free(data);
-		}
-		else
-		{
-			qWarning("GLWidget::loadEnvMap - Could not read image file, using single-color instead.");
-			QImage dummy(128, 128, QImage::Format_ARGB32);
-			dummy.fill(Qt::white);
-			_texImage = dummy;
-			_texImage = convertToGLFormat(_texBuffer);
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, _texImage.width(), _texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, _texImage.bits());
+				data = static_cast<unsigned char*>(stbi_load((_skyBoxFaces.at(i)).toStdString().c_str(), &width, &height, &nrComponents, 0));
+
+			if (data)
+			{
+				if (_skyBoxTextureHDRI)
+					glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+				else
+					glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+				glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+				stbi_image_free(data);
+			}
+			else
+			{
+				qWarning("GLWidget::loadEnvMap - Could not read image file, using single-color instead.");
+				QImage dummy(128, 128, QImage::Format_ARGB32);
+				dummy.fill(Qt::white);
+				_texImage = dummy;
+				_texImage = convertToGLFormat(_texBuffer);
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, _texImage.width(), _texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, _texImage.bits());
+			}
 		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		shared->insertTexture(_environmentKey, _environmentMap);
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
 
@@ -2173,8 +2309,25 @@ void GLWidget::loadEnvMap()
 	_skyBoxShader->setUniformValue("skybox", 1);
 }
 
+QString GLWidget::environmentKey() const
+{
+	QString key = _skyBoxTextureHDRI ? "environment:hdr" : "environment:ldr";
+	for (const QString& face : _skyBoxFaces)
+		key += "|" + face;
+	return key;
+}
+
 void GLWidget::loadIrradianceMap()
 {
+	// The maps only depend on the environment, other windows may have made them already
+	SharedResources* shared = SharedResources::forContext(context());
+	const unsigned int previousMaps[] = { _irradianceMap, _prefilterMap, _brdfLUTTexture };
+	_irradianceMap = shared->acquireTexture("irradiance:" + _environmentKey);
+	_prefilterMap = shared->acquireTexture("prefilter:" + _environmentKey);
+	_brdfLUTTexture = shared->acquireTexture("brdfLUT");
+	for (unsigned int map : previousMaps)
+		shared->releaseTexture(map);
+
 	// PBR: setup framebuffer
 	// ----------------------
 	unsigned int captureFBO;
@@ -2202,134 +2355,142 @@ void GLWidget::loadIrradianceMap()
 
 	// PBR: create an irradiance cubemap, and re-scale capture FBO to irradiance scale.
 	// --------------------------------------------------------------------------------
-	if (_irradianceMap)
-		glDeleteTextures(1, &_irradianceMap);
-	glGenTextures(1, &_irradianceMap);
-	//std::cout << "GLWidget::loadIrradianceMap : _irradianceMap = " << _irradianceMap << std::endl;
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _irradianceMap);
-	for (unsigned int i = 0; i < 6; ++i)
+	if (_irradianceMap == 0)
 	{
-		if (_skyBoxTextureHDRI)
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
-		else
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glGenTextures(1, &_irradianceMap);
+		//std::cout << "GLWidget::loadIrradianceMap : _irradianceMap = " << _irradianceMap << std::endl;
+		glBindTexture(GL_TEXTURE_CUBE_MAP, _irradianceMap);
+		for (unsigned int i = 0; i < 6; ++i)
+		{
+			if (_skyBoxTextureHDRI)
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
+			else
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
-
-	// PBR: solve diffuse integral by convolution to create an irradiance (cube)map.
-	// -----------------------------------------------------------------------------
-	_skyBox->setProg(_irradianceShader);
-	_irradianceShader->bind();
-	_irradianceShader->setUniformValue("environmentMap", 1);
-	_irradianceShader->setUniformValue("projectionMatrix", captureProjection);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
+		glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
 
-	glViewport(0, 0, 32, 32); // don't forget to configure the viewport to the capture dimensions.
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
+		// PBR: solve diffuse integral by convolution to create an irradiance (cube)map.
+		// -----------------------------------------------------------------------------
+		_skyBox->setProg(_irradianceShader);
 		_irradianceShader->bind();
-		_irradianceShader->setUniformValue("viewMatrix", captureViews[i]);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, _irradianceMap, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		_skyBox->render();
+		_irradianceShader->setUniformValue("environmentMap", 1);
+		_irradianceShader->setUniformValue("projectionMatrix", captureProjection);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
+
+		glViewport(0, 0, 32, 32); // don't forget to configure the viewport to the capture dimensions.
+		glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+		for (unsigned int i = 0; i < 6; ++i)
+		{
+			_irradianceShader->bind();
+			_irradianceShader->setUniformValue("viewMatrix", captureViews[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, _irradianceMap, 0);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			_skyBox->render();
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+		shared->insertTexture("irradiance:" + _environmentKey, _irradianceMap);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
 
 	// PBR: create a pre-filter cubemap, and re-scale capture FBO to pre-filter scale.
 	// --------------------------------------------------------------------------------
-	if (_prefilterMap)
-		glDeleteTextures(1, &_prefilterMap);
-	glGenTextures(1, &_prefilterMap);
-	//std::cout << "GLWidget::loadIrradianceMap : _prefilterMap = " << _prefilterMap << std::endl;
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _prefilterMap);
-	for (unsigned int i = 0; i < 6; ++i)
+	if (_prefilterMap == 0)
 	{
-		if (_skyBoxTextureHDRI)
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 128, 128, 0, GL_RGB, GL_FLOAT, nullptr);
-		else
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 128, 128, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // be sure to set minifcation filter to mip_linear
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// generate mipmaps for the cubemap so OpenGL automatically allocates the required memory.
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
-	// PBR: run a quasi monte-carlo simulation on the environment lighting to create a prefilter (cube)map.
-	// ----------------------------------------------------------------------------------------------------
-	_skyBox->setProg(_prefilterShader);
-	_prefilterShader->bind();
-	_prefilterShader->setUniformValue("environmentMap", 1);
-	_prefilterShader->setUniformValue("projectionMatrix", captureProjection);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	unsigned int maxMipLevels = 5;
-	for (unsigned int mip = 0; mip < maxMipLevels; ++mip)
-	{
-		// reisze framebuffer according to mip-level size.
-		unsigned int mipWidth = 128 * std::pow(0.5, mip);
-		unsigned int mipHeight = 128 * std::pow(0.5, mip);
-		glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-		glViewport(0, 0, mipWidth, mipHeight);
-
-		float roughness = (float)mip / (float)(maxMipLevels - 1);
-		_prefilterShader->bind();
-		_prefilterShader->setUniformValue("roughness", roughness);
+		glGenTextures(1, &_prefilterMap);
+		//std::cout << "GLWidget::loadIrradianceMap : _prefilterMap = " << _prefilterMap << std::endl;
+		glBindTexture(GL_TEXTURE_CUBE_MAP, _prefilterMap);
 		for (unsigned int i = 0; i < 6; ++i)
 		{
+			if (_skyBoxTextureHDRI)
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 128, 128, 0, GL_RGB, GL_FLOAT, nullptr);
+			else
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 128, 128, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // be sure to set minifcation filter to mip_linear
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// generate mipmaps for the cubemap so OpenGL automatically allocates the required memory.
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+		// PBR: run a quasi monte-carlo simulation on the environment lighting to create a prefilter (cube)map.
+		// ----------------------------------------------------------------------------------------------------
+		_skyBox->setProg(_prefilterShader);
+		_prefilterShader->bind();
+		_prefilterShader->setUniformValue("environmentMap", 1);
+		_prefilterShader->setUniformValue("projectionMatrix", captureProjection);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, _environmentMap);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+		unsigned int maxMipLevels = 5;
+		for (unsigned int mip = 0; mip < maxMipLevels; ++mip)
+		{
+			// reisze framebuffer according to mip-level size.
+			unsigned int mipWidth = 128 * std::pow(0.5, mip);
+			unsigned int mipHeight = 128 * std::pow(0.5, mip);
+			glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
+			glViewport(0, 0, mipWidth, mipHeight);
+
+			float roughness = (float)mip / (float)(maxMipLevels - 1);
 			_prefilterShader->bind();
-			_prefilterShader->setUniformValue("viewMatrix", captureViews[i]);
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, _prefilterMap, mip);
+			_prefilterShader->setUniformValue("roughness", roughness);
+			for (unsigned int i = 0; i < 6; ++i)
+			{
+				_prefilterShader->bind();
+				_prefilterShader->setUniformValue("viewMatrix", captureViews[i]);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, _prefilterMap, mip);
 
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			_skyBox->render();
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				_skyBox->render();
+			}
 		}
+		glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+		shared->insertTexture("prefilter:" + _environmentKey, _prefilterMap);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
 
 	// PBR: generate a 2D LUT from the BRDF equations used.
 	// ----------------------------------------------------
-	if (_brdfLUTTexture)
-		glDeleteTextures(1, &_brdfLUTTexture);
-	glGenTextures(1, &_brdfLUTTexture);
-	//std::cout << "GLWidget::loadIrradianceMap : _brdfLUTTexture = " << _brdfLUTTexture << std::endl;
+	if (_brdfLUTTexture == 0)
+	{
+		glGenTextures(1, &_brdfLUTTexture);
+		//std::cout << "GLWidget::loadIrradianceMap : _brdfLUTTexture = " << _brdfLUTTexture << std::endl;
+
+		// pre-allocate enough memory for the LUT texture.
+		glBindTexture(GL_TEXTURE_2D, _brdfLUTTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, 0);
+		// be sure to set wrapping mode to GL_CLAMP_TO_EDGE
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	// pre-allocate enough memory for the LUT texture.
-	glBindTexture(GL_TEXTURE_2D, _brdfLUTTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, 0);
-	// be sure to set wrapping mode to GL_CLAMP_TO_EDGE
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// then re-configure capture framebuffer object and render screen-space quad with BRDF shader.
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _brdfLUTTexture, 0);
+		// then re-configure capture framebuffer object and render screen-space quad with BRDF shader.
+		glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _brdfLUTTexture, 0);
 
-	glViewport(0, 0, 512, 512);
-	_brdfShader->bind();
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	renderQuad();
+		glViewport(0, 0, 512, 512);
+		_brdfShader->bind();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		renderQuad();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+		glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+		shared->insertTexture("brdfLUT", _brdfLUTTexture);
+	}
+	glDeleteRenderbuffers(1, &captureRBO);
+	glDeleteFramebuffers(1, &captureFBO);
 
 	// bind pre-computed IBL data
 	glActiveTexture(GL_TEXTURE3);
@@ -2385,6 +2546,12 @@ void GLWidget::paintGL()
 	QColor botColor = !_visibleSwapped ? _bgBotColor : QColor::fromRgbF(1.0f - _bgBotColor.redF(),
 		1.0f - _bgBotColor.greenF(), 1.0f - _bgBotColor.blueF(),
 		_bgBotColor.alphaF());
+	// Stream in the textures decoded since the last frame
+	TextureCache* textureCache = TextureCache::forContext(context());
+	textureCache->processUploads();
+	MaterialTextures::forContext(context())->prepare();
+	_culledMeshCount = 0;
+	_drawnMeshCount = 0;
 	try
 	{
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -2406,27 +2573,31 @@ void GLWidget::paintGL()
 			_orthoViewsCamera->setProjectionMatrix(_projectionMatrix);
 			_orthoViewsCamera->setViewMatrix(_viewMatrix);
 			_orthoViewsCamera->setPosition(_primaryCamera->getPosition());
+			// With a viewport per view the meshes of all four go out in one pass, the renders add the rest.
+			// Section capping clears the depth buffer between its passes, with it the views go one by one.
+			const bool capping = (_clipYZEnabled || _clipZXEnabled || _clipXYEnabled) && _cappingEnabled && !_floorDisplayed;
+			const bool meshViews = _viewportLayerArray && !capping && drawMeshViews();
 			glViewport(0, 0, width() / 2, height() / 2);
 			_orthoViewsCamera->setView(GLCamera::ViewProjection::TOP_VIEW);
-			render(_orthoViewsCamera);
+			render(_orthoViewsCamera, !meshViews);
 			_textRenderer->RenderText("Top", -50, 5, 1.6f, glm::vec3(1.0f, 1.0f, 0.0f), TextRenderer::VAlignment::VTOP, TextRenderer::HAlignment::HRIGHT);
 
 			// Front View
 			glViewport(0, height() / 2, width() / 2, height() / 2);
 			_orthoViewsCamera->setView(GLCamera::ViewProjection::FRONT_VIEW);
-			render(_orthoViewsCamera);
+			render(_orthoViewsCamera, !meshViews);
 			_textRenderer->RenderText("Front", -50, 5, 1.6f, glm::vec3(1.0f, 1.0f, 0.0f), TextRenderer::VAlignment::VTOP, TextRenderer::HAlignment::HRIGHT);
 
 			// Left View
 			glViewport(width() / 2, height() / 2, width() / 2, height() / 2);
 			_orthoViewsCamera->setView(GLCamera::ViewProjection::LEFT_VIEW);
-			render(_orthoViewsCamera);
+			render(_orthoViewsCamera, !meshViews);
 			_textRenderer->RenderText("Left", -50, 5, 1.6f, glm::vec3(1.0f, 1.0f, 0.0f), TextRenderer::VAlignment::VTOP, TextRenderer::HAlignment::HRIGHT);
 
 			// Render isometric view with primary camera
 			// Isometric View
 			glViewport(width() / 2, 0, width() / 2, height() / 2);
-			render(_primaryCamera);
+			render(_primaryCamera, !meshViews);
 			std::string viewLabel = _viewMode == ViewMode::DIMETRIC ? "Dimetric" : _viewMode
 				== ViewMode::TRIMETRIC ? "Trimetric" : "Isometric";
 			_textRenderer->RenderText(viewLabel, -50, 5, 1.6f, glm::vec3(1.0f, 1.0f, 0.0f), TextRenderer::VAlignment::VTOP, TextRenderer::HAlignment::HRIGHT);
@@ -2499,6 +2670,10 @@ void GLWidget::paintGL()
 		std::cout << "Exception raised in GLWidget::paintGL\n" << ex.what() << std::endl;
 	}
 
+	// Keep drawing while textures are still being decoded
+	if (textureCache->hasPendingUploads())
+		QTimer::singleShot(16, this, SLOT(update()));
+
 	// For testing rendered shadow map
 	/*_debugShader.bind();
 	_debugShader.setUniformValue("near_plane", 1.0f);
@@ -2529,11 +2704,12 @@ void GLWidget::drawFloor()
 		glCullFace(GL_FRONT);
 
 		// Draw floor
-		_fgShader->bind();
-		_fgShader->setUniformValue("envMapEnabled", false);
-		_fgShader->setUniformValue("floorRendering", true);
-		_fgShader->setUniformValue("renderingMode", static_cast<int>(RenderingMode::ADS_PHONG));
+		_frameUniforms.envMapEnabled = false;
+		_frameUniforms.floorRendering = true;
+		_frameUniforms.renderingMode = static_cast<int>(RenderingMode::ADS_PHONG);
+		uploadFrameUniforms();
 		_floorPlane->enableTexture(false);
+		_floorPlane->setProg(foregroundProgram(_floorPlane));
 		_floorPlane->render();
 		glDisable(GL_CULL_FACE);
 
@@ -2549,13 +2725,12 @@ void GLWidget::drawFloor()
 		model.scale(1.0f, 1.0f, -1.0f);
 		model.translate(0.0f, 0.0f, -offset);
 
-		_fgShader->bind();
-		_fgShader->setUniformValue("modelMatrix", model);
+		Std140::set(_frameUniforms.modelMatrix, model);
+		if (_reflectionsEnabled)
+			_frameUniforms.renderingMode = static_cast<int>(_renderingMode);
+		uploadFrameUniforms();
 		if (_reflectionsEnabled)
-		{
-			_fgShader->setUniformValue("renderingMode", static_cast<int>(_renderingMode));
 			drawMesh(_fgShader);
-		}
 
 		glStencilMask(0x00);
 		glDisable(GL_STENCIL_TEST);
@@ -2566,16 +2741,17 @@ void GLWidget::drawFloor()
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_FRONT);
-	_fgShader->bind();
-	_fgShader->setUniformValue("envMapEnabled", _envMapEnabled);
-	_fgShader->setUniformValue("renderingMode", static_cast<int>(RenderingMode::ADS_PHONG));
-	_fgShader->setUniformValue("shadowSamples", 18.0f);
+	_frameUniforms.envMapEnabled = _envMapEnabled;
+	_frameUniforms.renderingMode = static_cast<int>(RenderingMode::ADS_PHONG);
+	_frameUniforms.shadowSamples = 18.0f;
+	uploadFrameUniforms();
 	_floorPlane->enableTexture(_floorTextureDisplayed);
+	_floorPlane->setProg(foregroundProgram(_floorPlane));
 	_floorPlane->render();
 	glDisable(GL_CULL_FACE);
-	_fgShader->bind();
-	_fgShader->setUniformValue("floorRendering", false);
-	_fgShader->setUniformValue("renderingMode", static_cast<int>(_renderingMode));
+	_frameUniforms.floorRendering = false;
+	_frameUniforms.renderingMode = static_cast<int>(_renderingMode);
+	uploadFrameUniforms();
 }
 
 void GLWidget::drawSkyBox()
@@ -2600,7 +2776,7 @@ void GLWidget::drawSkyBox()
 	glDisable((GL_DEPTH_TEST));
 }
 
-void GLWidget::drawMesh(QOpenGLShaderProgram* prog)
+void GLWidget::drawMesh(QOpenGLShaderProgram* prog, bool occlusionCulling, bool countMeshes)
 {
 	QVector3D pos = _primaryCamera->getPosition();
 
@@ -2609,25 +2785,126 @@ void GLWidget::drawMesh(QOpenGLShaderProgram* prog)
 	// Render
 	if (_meshStore.size() != 0)
 	{
+		// The foreground pass draws each mesh with its shader variant, one bucket per variant.
+		// Opaque arena meshes go out batched, one multi draw per variant and pool.
+		const bool bindless = MaterialTextures::forContext(context())->bindless();
+		const std::vector<Frustum> frusta = frameFrusta();
+		std::vector<std::pair<QOpenGLShaderProgram*, TriangleMesh*>> draws;
 		for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
 		{
 			try
 			{
 				TriangleMesh* mesh = _meshStore.at(i);
-				if (mesh)
+				if (!mesh || !inFrustum(mesh, frusta, countMeshes))
+					continue;
+				if (prog == _fgShader && IndirectDraws::accepts(mesh, bindless))
 				{
-					mesh->setProg(prog);
-					mesh->render();
+					if (QOpenGLShaderProgram* batchProg = foregroundProgram(mesh, ShaderVariants::MULTI_DRAW))
+					{
+						_indirectDraws->add(batchProg, mesh, true, i);
+						continue;
+					}
 				}
+				QOpenGLShaderProgram* meshProg = prog == _fgShader ? foregroundProgram(mesh) : prog;
+				if (!meshProg)
+					continue; // Only MULTI_VIEW builds are left out, drawMeshViews checks them up front
+				draws.emplace_back(meshProg, mesh);
 			}
 			catch (const std::exception& ex)
 			{
 				std::cout << "Exception raised in GLWidget::drawMesh\n" << ex.what() << std::endl;
 			}
 		}
+		std::stable_sort(draws.begin(), draws.end(), [](const std::pair<QOpenGLShaderProgram*, TriangleMesh*>& a, const std::pair<QOpenGLShaderProgram*, TriangleMesh*>& b)
+			{
+				return a.first < b.first;
+			});
+
+		// Before the rest, blended meshes have to come after the opaque ones
+		if (occlusionCulling && _occlusionCuller)
+		{
+			// Last frame's visible meshes first, then the ones their depth doesn't hide
+			_indirectDraws->prepare();
+			_occlusionCuller->selectVisible(*_indirectDraws);
+			_indirectDraws->submit();
+			_occlusionCuller->selectDisoccluded(*_indirectDraws, defaultFramebufferObject(), width(), height(), frameViewProjection());
+			_indirectDraws->submit();
+			_indirectDraws->clear();
+		}
+		else
+		{
+			_indirectDraws->draw(_viewCount);
+		}
+		for (const auto& draw : draws)
+		{
+			draw.second->setProg(draw.first);
+			draw.second->setInstanceCount(_viewCount);
+			draw.second->render();
+		}
 	}
 }
 
+ShaderVariants::Features GLWidget::frameFeatures() const
+{
+	// Read back from the frame uniforms, the floor passes change them between draws
+	const FrameUniforms& frame = _frameUniforms;
+	const bool realShaded = frame.displayMode == static_cast<int>(DisplayMode::REALSHADED);
+	ShaderVariants::Features features = 0;
+	if (frame.displayMode == static_cast<int>(DisplayMode::WIRESHADED))
+		features |= ShaderVariants::WIRESHADED;
+	if (frame.renderingMode != static_cast<int>(RenderingMode::ADS_PHONG))
+		features |= ShaderVariants::PBR_LIGHTING;
+	if (frame.shadowsEnabled && realShaded)
+		features |= ShaderVariants::SHADOWS;
+	if (frame.envMapEnabled && realShaded)
+		features |= ShaderVariants::ENVIRONMENT_MAP;
+	return features;
+}
+
+QMatrix4x4 GLWidget::frameViewProjection() const
+{
+	// Read back from the frame uniforms too, the reflection pass mirrors the model matrix
+	const FrameUniforms& frame = _frameUniforms;
+	// QMatrix4x4 takes its values row by row, the uniforms are column major
+	const QMatrix4x4 projection = QMatrix4x4(frame.projectionMatrix).transposed();
+	const QMatrix4x4 view = QMatrix4x4(frame.viewMatrix).transposed();
+	const QMatrix4x4 model = QMatrix4x4(frame.modelMatrix).transposed();
+	return projection * view * model;
+}
+
+std::vector<Frustum> GLWidget::frameFrusta() const
+{
+	if (_viewCount > 1)
+		return _viewFrusta;
+	return { Frustum(frameViewProjection()) };
+}
+
+bool GLWidget::inFrustum(const TriangleMesh* mesh, const std::vector<Frustum>& frusta, bool countMeshes)
+{
+	// The sphere rejects most, the box is tighter for long thin meshes
+	const auto views = std::count_if(frusta.begin(), frusta.end(), [mesh](const Frustum& frustum)
+		{
+			return frustum.intersects(mesh->getBoundingSphere()) && frustum.intersects(mesh->getBoundingBox());
+		});
+	// Once per view, the single pass of the four views counts as much as drawing them one by one
+	if (countMeshes)
+	{
+		_drawnMeshCount += static_cast<unsigned int>(views);
+		_culledMeshCount += static_cast<unsigned int>(frusta.size() - views);
+	}
+	return views != 0;
+}
+
+QOpenGLShaderProgram* GLWidget::foregroundProgram(const TriangleMesh* mesh, ShaderVariants::Features extraFeatures)
+{
+	ShaderVariants::Features features = frameFeatures() | extraFeatures;
+	if (mesh->hasTextureMaps())
+		features |= ShaderVariants::TEXTURE_MAPS;
+	if (_viewCount > 1)
+		features |= ShaderVariants::MULTI_VIEW;
+	return _fgVariants->program(features);
+}
+
 void GLWidget::drawSectionCapping()
 {
 	// We use a lightweight shader without lighting and stuff for drawing the clipped mesh
@@ -2758,15 +3035,16 @@ void GLWidget::drawVertexNormals()
 
 	if (_meshStore.size() != 0)
 	{
+		const std::vector<Frustum> frusta = frameFrusta();
 		for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
 		{
 			if (_showVertexNormals)
 			{
 				TriangleMesh* mesh = _meshStore.at(i);
+				if (!inFrustum(mesh, frusta))
+					continue;
 				mesh->setProg(_vertexNormalShader);
-				mesh->getVAO().bind();
-				glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getPoints().size()), GL_UNSIGNED_INT, 0);
-				mesh->getVAO().release();
+				mesh->drawElements();
 			}
 		}
 	}
@@ -2779,15 +3057,16 @@ void GLWidget::drawFaceNormals()
 
 	if (_meshStore.size() != 0)
 	{
+		const std::vector<Frustum> frusta = frameFrusta();
 		for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
 		{
 			if (_showFaceNormals)
 			{
 				TriangleMesh* mesh = _meshStore.at(i);
+				if (!inFrustum(mesh, frusta))
+					continue;
 				mesh->setProg(_faceNormalShader);
-				mesh->getVAO().bind();
-				glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getPoints().size()), GL_UNSIGNED_INT, 0);
-				mesh->getVAO().release();
+				mesh->drawElements();
 			}
 		}
 	}
@@ -2880,7 +3159,7 @@ void GLWidget::drawAxis()
 	_axisShader->setUniformValue("coneColor", QVector3D(1.0f, 0.0, 0.0));
 	_axisShader->setUniformValue("modelViewMatrix", _viewMatrix * model);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, _axisCone->indexCount(), _axisCone->indexType(), 0);
 	_axisCone->getVAO().release();
 
 	// Y Axis
@@ -2891,7 +3170,7 @@ void GLWidget::drawAxis()
 	_axisShader->setUniformValue("coneColor", QVector3D(0.0, 1.0f, 0.0));
 	_axisShader->setUniformValue("modelViewMatrix", _viewMatrix * model);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, _axisCone->indexCount(), _axisCone->indexType(), 0);
 	_axisCone->getVAO().release();
 
 	// Z Axis
@@ -2901,7 +3180,7 @@ void GLWidget::drawAxis()
 	_axisShader->setUniformValue("coneColor", QVector3D(0.0, 0.0, 1.0f));
 	_axisShader->setUniformValue("modelViewMatrix", _viewMatrix * model);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, _axisCone->indexCount(), _axisCone->indexType(), 0);
 	_axisCone->getVAO().release();
 
 	_axisVAO.release();
@@ -3000,7 +3279,7 @@ void GLWidget::drawCornerAxis()
 	_axisShader->setUniformValue("coneColor", QVector3D(1.0f, 1.0f, 1.0f));
 	_axisShader->setUniformValue("modelViewMatrix", mat);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, _axisCone->indexCount(), _axisCone->indexType(), 0);
 	_axisCone->getVAO().release();
 
 	// Y Axis
@@ -3012,7 +3291,7 @@ void GLWidget::drawCornerAxis()
 	_axisShader->bind();
 	_axisShader->setUniformValue("modelViewMatrix", mat);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, _axisCone->indexCount(), _axisCone->indexType(), 0);
 	_axisCone->getVAO().release();
 
 	// Z Axis
@@ -3023,7 +3302,7 @@ void GLWidget::drawCornerAxis()
 	_axisShader->bind();
 	_axisShader->setUniformValue("modelViewMatrix", mat);
 	_axisCone->getVAO().bind();
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_axisCone->getPoints().size()), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, _axisCone->indexCount(), _axisCone->indexType(), 0);
 	_axisCone->getVAO().release();
 
 	_axisVAO.release();
@@ -3047,10 +3326,8 @@ void GLWidget::drawLights()
 	_lightCube->render();
 }
 
-void GLWidget::render(GLCamera* camera)
+void GLWidget::setupView(GLCamera* camera)
 {
-	glEnable(GL_DEPTH_TEST);
-
 	_viewMatrix.setToIdentity();
 	_viewMatrix = camera->getViewMatrix();
 	_projectionMatrix = camera->getProjectionMatrix();
@@ -3070,33 +3347,51 @@ void GLWidget::render(GLCamera* camera)
 	bool floorVisible = QVector3D::dotProduct(viewDir, zDir) < 0.0f;
 	bool showShadows = (_shadowsEnabled && floorVisible && !_lowResEnabled && camera == _primaryCamera);
 
-	_fgShader->bind();
-	_fgShader->setUniformValue("lightSource.ambient", _ambientLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.diffuse", _diffuseLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.specular", _specularLight.toVector3D());
-	_fgShader->setUniformValue("lightSource.position", _lightPosition + QVector3D(_lightOffsetX, _lightOffsetY, _lightOffsetZ));
-	_fgShader->setUniformValue("lightModel.ambient", QVector3D(0.2f, 0.2f, 0.2f));
-	_fgShader->setUniformValue("modelViewMatrix", _modelViewMatrix);
-	_fgShader->setUniformValue("normalMatrix", _modelViewMatrix.normalMatrix());
-	_fgShader->setUniformValue("projectionMatrix", _projectionMatrix);
-	_fgShader->setUniformValue("viewportMatrix", _viewportMatrix);
-	_fgShader->setUniformValue("Line.Width", 0.75f);
-	_fgShader->setUniformValue("Line.Color", QVector4D(0.05f, 0.0f, 0.05f, 1.0f));
-	_fgShader->setUniformValue("displayMode", static_cast<int>(_displayMode));
-	_fgShader->setUniformValue("renderingMode", static_cast<int>(_renderingMode));
-	_fgShader->setUniformValue("envMapEnabled", _envMapEnabled);
-	_fgShader->setUniformValue("shadowsEnabled", showShadows);
-	_fgShader->setUniformValue("reflectionMapEnabled", false);
-	_fgShader->setUniformValue("cameraPos", _primaryCamera->getPosition());
-	_fgShader->setUniformValue("lightPos", _lightPosition + QVector3D(_lightOffsetX, _lightOffsetY, _lightOffsetZ));
-	_fgShader->setUniformValue("modelMatrix", _modelMatrix);
-	_fgShader->setUniformValue("viewMatrix", _viewMatrix);
-	_fgShader->setUniformValue("lightSpaceMatrix", _lightSpaceMatrix);
-	_fgShader->setUniformValue("lockLightAndCamera", _lockLightAndCamera);
-	_fgShader->setUniformValue("hdrToneMapping", _hdrToneMapping);
-	_fgShader->setUniformValue("gammaCorrection", _gammaCorrection);
-	_fgShader->setUniformValue("screenGamma", _screenGamma);
-	_fgShader->setUniformValue("shadowSamples", 27.0f);
+	// One upload of the view's state instead of setting each uniform by name
+	const QVector3D lightPos = _lightPosition + QVector3D(_lightOffsetX, _lightOffsetY, _lightOffsetZ);
+	const QVector3D cameraPos = _primaryCamera->getPosition();
+	const std::array<QVector4D, 4> planes = clippingPlanes(cameraPos);
+	FrameUniforms& frame = _frameUniforms;
+	Std140::set(frame.modelMatrix, _modelMatrix);
+	Std140::set(frame.viewMatrix, _viewMatrix);
+	Std140::set(frame.modelViewMatrix, _modelViewMatrix);
+	Std140::set(frame.projectionMatrix, _projectionMatrix);
+	Std140::set(frame.viewportMatrix, _viewportMatrix);
+	Std140::set(frame.lightSpaceMatrix, _lightSpaceMatrix);
+	Std140::set(frame.normalMatrix, _modelViewMatrix.normalMatrix());
+	Std140::set(frame.clipPlaneX, planes[0]);
+	Std140::set(frame.clipPlaneY, planes[1]);
+	Std140::set(frame.clipPlaneZ, planes[2]);
+	Std140::set(frame.clipPlane, planes[3]);
+	Std140::set(frame.cameraPos, cameraPos);
+	Std140::set(frame.lightPos, lightPos);
+	Std140::set(frame.lightAmbient, _ambientLight.toVector3D());
+	Std140::set(frame.lightDiffuse, _diffuseLight.toVector3D());
+	Std140::set(frame.lightSpecular, _specularLight.toVector3D());
+	Std140::set(frame.lightPosition, lightPos);
+	Std140::set(frame.modelAmbient, QVector3D(0.2f, 0.2f, 0.2f));
+	frame.lineWidth = 0.75f;
+	Std140::set(frame.lineColor, QVector4D(0.05f, 0.0f, 0.05f, 1.0f));
+	frame.displayMode = static_cast<int>(_displayMode);
+	frame.renderingMode = static_cast<int>(_renderingMode);
+	frame.envMapEnabled = _envMapEnabled;
+	frame.shadowsEnabled = showShadows;
+	frame.reflectionMapEnabled = false;
+	frame.lockLightAndCamera = _lockLightAndCamera;
+	frame.hdrToneMapping = _hdrToneMapping;
+	frame.gammaCorrection = _gammaCorrection;
+	frame.screenGamma = _screenGamma;
+	frame.shadowSamples = 27.0f;
+	frame.sectionActive = _clipYZEnabled || _clipZXEnabled || _clipXYEnabled || !(_clipDX == 0 && _clipDY == 0 && _clipDZ == 0);
+	frame.floorRendering = false;
+	uploadFrameUniforms();
+}
+
+void GLWidget::render(GLCamera* camera, bool drawMeshes)
+{
+	glEnable(GL_DEPTH_TEST);
+
+	setupView(camera);
 
 	glPolygonMode(GL_FRONT_AND_BACK, _displayMode == DisplayMode::WIREFRAME ? GL_LINE : GL_FILL);
 	glLineWidth(_displayMode == DisplayMode::WIREFRAME ? 1.25 : 1.0);
@@ -3111,8 +3406,9 @@ void GLWidget::render(GLCamera* camera)
 		if (_clipYZEnabled)
 		{
 			glEnable(GL_CLIP_DISTANCE0);
-			// Mesh
-			drawMesh(_fgShader);
+			// Mesh, the first pass counts the drawn and culled meshes
+			if (drawMeshes)
+				drawMesh(_fgShader, false, true);
 			// Vertex Normal
 			drawVertexNormals();
 			// Face Normal
@@ -3123,7 +3419,8 @@ void GLWidget::render(GLCamera* camera)
 		{
 			glEnable(GL_CLIP_DISTANCE1);
 			// Mesh
-			drawMesh(_fgShader);
+			if (drawMeshes)
+				drawMesh(_fgShader, false, !_clipYZEnabled);
 			// Vertex Normal
 			drawVertexNormals();
 			// Face Normal
@@ -3134,7 +3431,8 @@ void GLWidget::render(GLCamera* camera)
 		{
 			glEnable(GL_CLIP_DISTANCE2);
 			// Mesh
-			drawMesh(_fgShader);
+			if (drawMeshes)
+				drawMesh(_fgShader, false, !_clipYZEnabled && !_clipZXEnabled);
 			// Vertex Normal
 			drawVertexNormals();
 			// Face Normal
@@ -3144,8 +3442,9 @@ void GLWidget::render(GLCamera* camera)
 	}
 	else
 	{
-		// Mesh
-		drawMesh(_fgShader);
+		// Mesh, the four views would keep overwriting each other's visible sets
+		if (drawMeshes)
+			drawMesh(_fgShader, !_multiViewActive, true);
 		// Vertex Normal
 		drawVertexNormals();
 		// Face Normal
@@ -3178,6 +3477,75 @@ void GLWidget::render(GLCamera* camera)
 	_fgShader->release();
 }
 
+bool GLWidget::drawMeshViews()
+{
+	// paintGL's layout: top, front and left with the ortho views camera, then the primary camera's
+	const int w = width() / 2;
+	const int h = height() / 2;
+	const std::array<QRect, ViewUniforms::VIEW_COUNT> viewports = { QRect(0, 0, w, h), QRect(0, h, w, h), QRect(w, h, w, h), QRect(w, 0, w, h) };
+	const std::array<GLCamera::ViewProjection, 3> orthoViews = { GLCamera::ViewProjection::TOP_VIEW,
+		GLCamera::ViewProjection::FRONT_VIEW, GLCamera::ViewProjection::LEFT_VIEW };
+
+	ViewUniforms views = {};
+	_viewFrusta.clear();
+	for (int i = 0; i < ViewUniforms::VIEW_COUNT; i++)
+	{
+		GLCamera* camera = _primaryCamera;
+		if (i < static_cast<int>(orthoViews.size()))
+		{
+			_orthoViewsCamera->setView(orthoViews[i]);
+			camera = _orthoViewsCamera;
+		}
+		// The primary camera's comes last, the frame uniforms keep the state the views share
+		setupView(camera);
+		ViewUniforms::View& view = views.views[i];
+		Std140::set(view.view, _viewMatrix);
+		Std140::set(view.modelView, _modelViewMatrix);
+		Std140::set(view.projection, _projectionMatrix);
+		Std140::set(view.viewport, _viewportMatrix);
+		Std140::set(view.normalTransform, _modelViewMatrix.normalMatrix());
+		view.shadows = _frameUniforms.shadowsEnabled;
+		_viewFrusta.push_back(Frustum(frameViewProjection()));
+		glViewportIndexedf(i, viewports[i].x(), viewports[i].y(), viewports[i].width(), viewports[i].height());
+	}
+
+	// A variant that fails to build leaves the frame to the views one by one, and all frames after it
+	_viewCount = ViewUniforms::VIEW_COUNT;
+	for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
+	{
+		const TriangleMesh* mesh = i < static_cast<int>(_meshStore.size()) ? _meshStore[i] : nullptr;
+		if (mesh && !foregroundProgram(mesh))
+		{
+			_viewCount = 1;
+			_viewportLayerArray = false;
+			return false;
+		}
+	}
+	glNamedBufferSubData(_viewUniformBuffer.bufferId(), 0, sizeof(ViewUniforms), &views);
+	glBindBufferBase(GL_UNIFORM_BUFFER, ViewUniforms::BINDING, _viewUniformBuffer.bufferId());
+
+	glEnable(GL_DEPTH_TEST);
+	glPolygonMode(GL_FRONT_AND_BACK, _displayMode == DisplayMode::WIREFRAME ? GL_LINE : GL_FILL);
+	glLineWidth(_displayMode == DisplayMode::WIREFRAME ? 1.25 : 1.0);
+	glDisable(GL_STENCIL_TEST);
+
+	// The mesh passes of render(), one per enabled clipping plane
+	const std::array<bool, 3> clipped = { _clipYZEnabled, _clipZXEnabled, _clipXYEnabled };
+	const auto firstClipped = std::find(clipped.begin(), clipped.end(), true);
+	if (firstClipped == clipped.end())
+		drawMesh(_fgShader, false, true);
+	for (size_t i = 0; i < clipped.size(); i++)
+	{
+		if (!clipped[i])
+			continue;
+		glEnable(GL_CLIP_DISTANCE0 + static_cast<GLenum>(i));
+		drawMesh(_fgShader, false, clipped.begin() + i == firstClipped);
+		glDisable(GL_CLIP_DISTANCE0 + static_cast<GLenum>(i));
+	}
+	_viewCount = 1;
+	return true;
+}
+
 void GLWidget::renderToShadowBuffer()
 {
 	// save current viewport
@@ -3209,19 +3577,31 @@ void GLWidget::renderToShadowBuffer()
 	_shadowMappingShader->bind();
 	_shadowMappingShader->setUniformValue("lightSpaceMatrix", _lightSpaceMatrix);
 	_shadowMappingShader->setUniformValue("model", _modelMatrix);
+	if (_shadowMultiDrawShader)
+	{
+		_shadowMultiDrawShader->bind();
+		_shadowMultiDrawShader->setUniformValue("lightSpaceMatrix", _lightSpaceMatrix);
+		_shadowMultiDrawShader->setUniformValue("model", _modelMatrix);
+	}
 	if (_meshStore.size() != 0)
 	{
+		// Meshes outside the light's volume cast no shadow onto what it covers
+		const std::vector<Frustum> lightFrustum = { Frustum(_lightSpaceMatrix * _modelMatrix) };
 		for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
 		{
 			try
 			{
 				TriangleMesh* mesh = _meshStore.at(i);
-				if (mesh)
+				if (mesh && inFrustum(mesh, lightFrustum))
 				{
+					// Depth only, transparency and textures don't matter
+					if (_shadowMultiDrawShader && mesh->inGeometryArena())
+					{
+						_indirectDraws->add(_shadowMultiDrawShader, mesh, false);
+						continue;
+					}
 					mesh->setProg(_shadowMappingShader);
-					mesh->getVAO().bind();
-					glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getPoints().size()), GL_UNSIGNED_INT, 0);
-					mesh->getVAO().release();
+					mesh->drawElements();
 				}
 			}
 			catch (const std::exception& ex)
@@ -3229,6 +3609,7 @@ void GLWidget::renderToShadowBuffer()
 				std::cout << "Exception raised in GLWidget::renderToShadowBuffer\n" << ex.what() << std::endl;
 			}
 		}
+		_indirectDraws->draw();
 	}
 	glDisable(GL_CULL_FACE);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, defaultFramebufferObject());
@@ -3307,9 +3688,7 @@ int GLWidget::processSelection(const QPoint& pixel)
 
 						_selectionShader->setUniformValue("pickingColor", QVector4D(r, g, b, a));
 						mesh->setProg(_selectionShader);
-						mesh->getVAO().bind();
-						glDrawElements(GL_TRIANGLES, static_cast<int>(mesh->getPoints().size()), GL_UNSIGNED_INT, 0);
-						mesh->getVAO().release();
+						mesh->drawElements();
 						glFlush();
 						glFinish();
 					}
@@ -3457,25 +3836,39 @@ void GLWidget::splitScreen()
 
 void GLWidget::setupClippingUniforms(QOpenGLShaderProgram* prog, QVector3D pos)
 {
+	// The foreground shader variants have them in their frame uniforms
+	if (prog == _fgShader)
+		return;
+
+	const std::array<QVector4D, 4> planes = clippingPlanes(pos);
 	prog->bind();
-	if (_clipYZEnabled || _clipZXEnabled || _clipXYEnabled || !(_clipDX == 0 && _clipDY == 0 && _clipDZ == 0))
-	{
-		_fgShader->setUniformValue("sectionActive", true);
-	}
-	else
-	{
-		_fgShader->setUniformValue("sectionActive", false);
-	}
 	prog->setUniformValue("modelViewMatrix", _modelViewMatrix);
 	prog->setUniformValue("projectionMatrix", _projectionMatrix);
-	prog->setUniformValue("clipPlaneX", QVector4D(_modelViewMatrix.map(QVector3D(_clipXFlipped ? 1 : -1, 0, 0) + pos),
-		(_clipXFlipped ? 1 : -1) * (pos.x() - _clipXCoeff)));
-	prog->setUniformValue("clipPlaneY", QVector4D(_modelViewMatrix.map(QVector3D(0, _clipYFlipped ? 1 : -1, 0) + pos),
-		(_clipYFlipped ? 1 : -1) * (pos.y() - _clipYCoeff)));
-	prog->setUniformValue("clipPlaneZ", QVector4D(_modelViewMatrix.map(QVector3D(0, 0, _clipZFlipped ? 1 : -1) + pos),
-		(_clipZFlipped ? 1 : -1) * (pos.z() - _clipZCoeff)));
-	prog->setUniformValue("clipPlane", QVector4D(_modelViewMatrix.map(QVector3D(_clipDX, _clipDY, _clipDZ) + pos),
-		pos.x() * _clipDX + pos.y() * _clipDY + pos.z() * _clipDZ));
+	prog->setUniformValue("clipPlaneX", planes[0]);
+	prog->setUniformValue("clipPlaneY", planes[1]);
+	prog->setUniformValue("clipPlaneZ", planes[2]);
+	prog->setUniformValue("clipPlane", planes[3]);
+}
+
+std::array<QVector4D, 4> GLWidget::clippingPlanes(const QVector3D& pos) const
+{
+	return {
+		QVector4D(_modelViewMatrix.map(QVector3D(_clipXFlipped ? 1 : -1, 0, 0) + pos),
+			(_clipXFlipped ? 1 : -1) * (pos.x() - _clipXCoeff)),
+		QVector4D(_modelViewMatrix.map(QVector3D(0, _clipYFlipped ? 1 : -1, 0) + pos),
+			(_clipYFlipped ? 1 : -1) * (pos.y() - _clipYCoeff)),
+		QVector4D(_modelViewMatrix.map(QVector3D(0, 0, _clipZFlipped ? 1 : -1) + pos),
+			(_clipZFlipped ? 1 : -1) * (pos.z() - _clipZCoeff)),
+		QVector4D(_modelViewMatrix.map(QVector3D(_clipDX, _clipDY, _clipDZ) + pos),
+			pos.x() * _clipDX + pos.y() * _clipDY + pos.z() * _clipDZ)
+	};
+}
+
+void GLWidget::uploadFrameUniforms()
+{
+	// Draws already issued keep the previous contents, the floor passes rely on that
+	glNamedBufferSubData(_frameUniformBuffer.bufferId(), 0, sizeof(FrameUniforms), &_frameUniforms);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FrameUniforms::BINDING, _frameUniformBuffer.bufferId());
 }
 
 void GLWidget::checkAndStopTimers()
@@ -4007,42 +4400,8 @@ QVector3D GLWidget::get3dTranslationVectorFromMousePoints(const QPoint& start, c
 
 unsigned int GLWidget::loadTextureFromFile(char const* path)
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	//std::cout << "GLWidget::loadTextureFromFile : textureID = " << textureID << std::endl;
-
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format = GL_RGBA;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 2)
-			format = GL_RG;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
+	// Decoded in the background, a placeholder is bound until the image arrives
+	return TextureCache::forContext(context())->acquire(QString(path));
 }
 
 #include <chrono>
@@ -4071,7 +4430,6 @@ int GLWidget::clickSelect(const QPoint& pixel)
 	}
 
 	QVector3D rayPos, rayDir;
-	QVector3D intersectionPoint;
 	QRect viewport = getViewportFromPoint(pixel);
 	GLCamera* camera = _primaryCamera;
 	if (_multiViewActive)
@@ -4094,43 +4452,12 @@ int GLWidget::clickSelect(const QPoint& pixel)
 	// Get starting timepoint
     //auto start = high_resolution_clock::now();
 
-	QMap<int, float> selectedIdsDist;
-	for (int i : (_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds))
-	{
-		TriangleMesh* mesh = _meshStore.at(i);
-		if (mesh->getBoundingSphere().intersectsWithRay(rayPos, rayDir))
-		{
-			bool intersects = mesh->intersectsWithRay(rayPos, rayDir, intersectionPoint);
-			//qDebug() << intPoint;
-			if (intersects)
-			{
-				//id = i;
-				selectedIdsDist[i] = intersectionPoint.distanceToPoint(rayPos);
-				_selectedIDs.push_back(i);
-				//_selectRect->setGeometry(_boundingRect);
-				//_selectRect->setGeometry(mesh->getBoundingBox().project(_modelViewMatrix, _projectionMatrix, viewport, geometry()));
-				//_selectRect->setGeometry(mesh->projectedRect(_modelViewMatrix, _projectionMatrix, viewport, geometry()));
-				//_selectRect->show();
-				//break;
-			}
-		}
-		//else
-		//_selectRect->hide();
-	}
-	//qDebug() << selectedIdsDist;
-	if (!selectedIdsDist.isEmpty())
-	{
-		QMapIterator<int, float> it(selectedIdsDist);
-		float lowestDist = std::numeric_limits<float>::max();
-		while (it.hasNext())
-		{
-			it.next();
-			float val = it.value();
-			if (val < lowestDist)
-				lowestDist = val;
-		}
-		id = selectedIdsDist.key(lowestDist);
-	}
+	// One query through the scene hierarchy returns the closest mesh
+	_sceneHierarchy.sync(_visibleSwapped ? _hiddenObjectsIds : _displayedObjectsIds, _meshStore);
+	TriangleMesh::RayHit hit;
+	id = _sceneHierarchy.nearestHit(rayPos, rayDir, hit);
+	if (id >= 0)
+		_selectedIDs.push_back(id);
 	qDebug() << "Selected Id: " << id;
 
 	int colId = processSelection(pixel);
@@ -9,13 +9,20 @@
 #include <QRubberBand>
 
 #include <math.h>
+#include <array>
 #include "GLCamera.h"
 #include "BoundingSphere.h"
+#include "Frustum.h"
 #include "TriangleMesh.h"
+#include "UniformBlocks.h"
+#include "ShaderVariants.h"
+#include "SceneHierarchy.h"
 
 /* Custom OpenGL Viewer Widget */
 
 class TextRenderer;
+class IndirectDraws;
+class OcclusionCuller;
 class SphericalHarmonicsEditor;
 class SuperToroidEditor;
 class SuperEllipsoidEditor;
@@ -66,6 +73,9 @@ public:
 	{
 		return _modelNum;
 	}
+	// Meshes of the last frame left out by frustum culling and drawn, once per view
+	unsigned int culledMeshCount() const { return _culledMeshCount; }
+	unsigned int drawnMeshCount() const { return _drawnMeshCount; }
 
 	void updateClippingPlane();
 	void showClippingPlaneEditor(bool show);
@@ -285,16 +295,23 @@ protected:
 private:
 	bool loadCompileAndLinkShaderFromFile(QOpenGLShaderProgram* prog, const QString& vertexProg,
 		const QString& fragmentProg, const QString& geometryProg = "",
-		const QString& tessControlProg = "", const QString& tessEvalProg = "");
+		const QString& tessControlProg = "", const QString& tessEvalProg = "", const QStringList& defines = QStringList());
 	void createShaderPrograms();
 	void createLights();
 	void createGeometry();
 
 	void loadEnvMap();
 	void loadIrradianceMap();
+	QString environmentKey() const; // names the skybox's textures in SharedResources
 	void loadFloor();
 
-	void drawMesh(QOpenGLShaderProgram* prog);
+	void drawMesh(QOpenGLShaderProgram* prog, bool occlusionCulling = false, bool countMeshes = false);
+	ShaderVariants::Features frameFeatures() const;
+	QMatrix4x4 frameViewProjection() const; // of the view and model matrices being drawn with
+	std::vector<Frustum> frameFrusta() const; // one, or one per view in drawMeshViews
+	bool inFrustum(const TriangleMesh* mesh, const std::vector<Frustum>& frusta, bool countMeshes = false); // in any, counts it per view if asked
+	// _fgShader variant for the mesh and frame, nullptr for a MULTI_DRAW or MULTI_VIEW one that fails to build
+	QOpenGLShaderProgram* foregroundProgram(const TriangleMesh* mesh, ShaderVariants::Features extraFeatures = 0);
 	void drawSectionCapping();
 	void drawFloor();
 	void drawSkyBox();
@@ -304,7 +321,9 @@ private:
 	void drawCornerAxis();
 	void drawLights();
 
-	void render(GLCamera* camera);
+	void setupView(GLCamera* camera); // matrices and frame uniforms of the camera
+	void render(GLCamera* camera, bool drawMeshes = true);
+	bool drawMeshViews(); // the meshes of all four views of the multi view layout in one pass, false if left to the views
 	void renderToShadowBuffer();
 	int processSelection(const QPoint& pixel);
 	void renderQuad();
@@ -331,6 +350,8 @@ private:
 	QVector3D get3dTranslationVectorFromMousePoints(const QPoint& start, const QPoint& end);
 	unsigned int loadTextureFromFile(const char* path);
 	void setupClippingUniforms(QOpenGLShaderProgram* prog, QVector3D pos);
+	std::array<QVector4D, 4> clippingPlanes(const QVector3D& pos) const; // X, Y, Z and the user defined plane
+	void uploadFrameUniforms();
 
 private:
 	QSet<int> _keys;
@@ -379,6 +400,11 @@ private:
 	unsigned int _selectionDBO;
 
 	bool _multiViewActive;
+	bool _viewportLayerArray;          // the vertex stage can pick the viewport
+	GLsizei _viewCount;                // views the meshes are drawn to at once
+	std::vector<Frustum> _viewFrusta;  // of the views of drawMeshViews
+	unsigned int _culledMeshCount;     // of the main foreground pass, per view of the frame
+	unsigned int _drawnMeshCount;
 
 	bool _showAxis;
 
@@ -441,11 +467,18 @@ private:
 	QMatrix4x4 _modelViewMatrix;
 	QMatrix4x4 _viewportMatrix;
 
-	QOpenGLShaderProgram* _fgShader;
+	QOpenGLShaderProgram* _fgShader;     // all features variant of _fgVariants
+	ShaderVariants* _fgVariants;
+	IndirectDraws* _indirectDraws;       // batches the arena meshes of the foreground and shadow passes
+	OcclusionCuller* _occlusionCuller;   // of the single view batches, nullptr without compute shaders
+	FrameUniforms _frameUniforms;        // _fgShader's FrameUniforms block
+	QOpenGLBuffer _frameUniformBuffer;
+	QOpenGLBuffer _viewUniformBuffer;    // ViewUniforms of drawMeshViews
 	QOpenGLShaderProgram* _axisShader;
 	QOpenGLShaderProgram* _vertexNormalShader;
 	QOpenGLShaderProgram* _faceNormalShader;
 	QOpenGLShaderProgram* _shadowMappingShader;
+	QOpenGLShaderProgram* _shadowMultiDrawShader; // MULTI_DRAW build, nullptr where it doesn't link
 	QOpenGLShaderProgram* _skyBoxShader;
 	QOpenGLShaderProgram* _irradianceShader;
 	QOpenGLShaderProgram* _prefilterShader;
@@ -456,6 +489,7 @@ private:
 	QOpenGLShaderProgram* _selectionShader;
 
 	unsigned int             _environmentMap;
+	QString                  _environmentKey;
 	unsigned int             _shadowMap;
 	unsigned int             _shadowMapFBO;
 	unsigned int			 _irradianceMap;
@@ -483,6 +517,7 @@ private:
 	std::vector<int> _hiddenObjectsIds;
 	std::vector<int> _centerScreenObjectIDs;
 	bool _visibleSwapped;
+	SceneHierarchy _sceneHierarchy; // Picking structure over the meshes of the current display list
 
 	QVBoxLayout* _editorLayout;
 	QFormLayout* _lowerLayout;
@@ -0,0 +1,292 @@
+#include "GeometryArena.h"
+
+#include <QOpenGLContext>
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <numeric>
+
+namespace
+{
+	constexpr size_t MIN_VERTEX_CAPACITY = 256 * 1024;
+	constexpr size_t MIN_INDEX_CAPACITY = 1024 * 1024;
+	constexpr GLuint VERTEX_BINDING = 0;
+	constexpr GLuint DRAW_INDEX_BINDING = 1;
+
+	std::map<QOpenGLContext*, GeometryArena*>& contextArenas()
+	{
+		static std::map<QOpenGLContext*, GeometryArena*> arenas;
+		return arenas;
+	}
+}
+
+GeometryArena::GeometryArena(QOpenGLContext* context) : _context(context),
+_drawIndexBuffer(0),
+_drawIndexCapacity(0)
+{
+	initializeOpenGLFunctions();
+}
+
+GeometryArena::~GeometryArena()
+{
+	// Only clean up while our context is current, otherwise everything goes with the context
+	if (QOpenGLContext::currentContext() != _context)
+		return;
+
+	for (const Pool& pool : _pools)
+	{
+		glDeleteVertexArrays(1, &pool.vao);
+		glDeleteBuffers(1, &pool.vertexBuffer);
+		glDeleteBuffers(1, &pool.indexBuffer);
+	}
+	if (_drawIndexBuffer)
+		glDeleteBuffers(1, &_drawIndexBuffer);
+}
+
+GeometryArena* GeometryArena::forContext(QOpenGLContext* context)
+{
+	if (!context)
+		return nullptr;
+
+	auto& arenas = contextArenas();
+	auto it = arenas.find(context);
+	if (it != arenas.end())
+		return it->second;
+
+	GeometryArena* arena = new GeometryArena(context);
+	arenas[context] = arena;
+	QObject::connect(context, &QOpenGLContext::aboutToBeDestroyed, context, [context]()
+		{
+			auto& arenas = contextArenas();
+			auto it = arenas.find(context);
+			if (it != arenas.end())
+			{
+				delete it->second;
+				arenas.erase(it);
+			}
+		});
+	return arena;
+}
+
+GeometryArena* GeometryArena::current()
+{
+	return forContext(QOpenGLContext::currentContext());
+}
+
+void GeometryArena::release(QOpenGLContext* context, Allocation& allocation)
+{
+	auto& arenas = contextArenas();
+	auto it = arenas.find(context);
+	if (it == arenas.end())
+	{
+		allocation.pool = -1;
+		return;
+	}
+	it->second->free(allocation);
+}
+
+GeometryArena::Allocation GeometryArena::allocate(Layout layout, GLenum indexType, const void* vertices, GLuint vertexCount,
+	const void* indices, GLsizei indexCount)
+{
+	const int p = pool(layout, indexType);
+	Pool& target = _pools[p];
+	const size_t stride = vertexSize(layout);
+	const size_t indexBytes = indexSize(indexType);
+
+	size_t vertexOffset = 0, indexOffset = 0;
+	if (!take(target.freeVertices, vertexCount, vertexOffset))
+	{
+		grow(target.vertexBuffer, target.vertexCapacity, stride, vertexCount, MIN_VERTEX_CAPACITY, target.freeVertices);
+		glVertexArrayVertexBuffer(target.vao, VERTEX_BINDING, target.vertexBuffer, 0, static_cast<GLsizei>(stride));
+		take(target.freeVertices, vertexCount, vertexOffset);
+	}
+	if (!take(target.freeIndices, indexCount, indexOffset))
+	{
+		grow(target.indexBuffer, target.indexCapacity, indexBytes, indexCount, MIN_INDEX_CAPACITY, target.freeIndices);
+		glVertexArrayElementBuffer(target.vao, target.indexBuffer);
+		take(target.freeIndices, indexCount, indexOffset);
+	}
+
+	glNamedBufferSubData(target.vertexBuffer, vertexOffset * stride, vertexCount * stride, vertices);
+	glNamedBufferSubData(target.indexBuffer, indexOffset * indexBytes, indexCount * indexBytes, indices);
+
+	return { p, static_cast<GLint>(vertexOffset), static_cast<GLuint>(indexOffset), vertexCount, indexCount };
+}
+
+void GeometryArena::free(Allocation& allocation)
+{
+	if (allocation.pool < 0 || allocation.pool >= static_cast<int>(_pools.size()))
+		return;
+	Pool& pool = _pools[allocation.pool];
+	give(pool.freeVertices, allocation.baseVertex, allocation.vertexCount);
+	give(pool.freeIndices, allocation.firstIndex, allocation.indexCount);
+	allocation.pool = -1;
+}
+
+GLenum GeometryArena::indexType(int pool) const
+{
+	return _pools[pool].indexType;
+}
+
+void GeometryArena::bind(int pool, GLuint instancesPerDraw)
+{
+	Pool& p = _pools[pool];
+	if (p.drawIndexDivisor != instancesPerDraw)
+	{
+		glVertexArrayBindingDivisor(p.vao, DRAW_INDEX_BINDING, instancesPerDraw);
+		p.drawIndexDivisor = instancesPerDraw;
+	}
+	glBindVertexArray(p.vao);
+}
+
+void GeometryArena::release()
+{
+	glBindVertexArray(0);
+}
+
+void GeometryArena::reserveDrawIndices(size_t count)
+{
+	if (count <= _drawIndexCapacity)
+		return;
+
+	size_t capacity = std::max<size_t>(_drawIndexCapacity * 2, 1024);
+	while (capacity < count)
+		capacity *= 2;
+	std::vector<GLuint> drawIndices(capacity);
+	std::iota(drawIndices.begin(), drawIndices.end(), 0u);
+
+	if (_drawIndexBuffer)
+		glDeleteBuffers(1, &_drawIndexBuffer);
+	glCreateBuffers(1, &_drawIndexBuffer);
+	glNamedBufferStorage(_drawIndexBuffer, capacity * sizeof(GLuint), drawIndices.data(), 0);
+	_drawIndexCapacity = capacity;
+
+	for (const Pool& pool : _pools)
+		glVertexArrayVertexBuffer(pool.vao, DRAW_INDEX_BINDING, _drawIndexBuffer, 0, sizeof(GLuint));
+}
+
+int GeometryArena::pool(Layout layout, GLenum indexType)
+{
+	for (size_t i = 0; i < _pools.size(); i++)
+	{
+		if (_pools[i].layout == layout && _pools[i].indexType == indexType)
+			return static_cast<int>(i);
+	}
+
+	// Single draws read the draw index too, its binding can't be left empty
+	reserveDrawIndices(1);
+	Pool pool = { layout, indexType, 0, 0, 0, 0, 0, {}, {}, 1 };
+	glCreateVertexArrays(1, &pool.vao);
+	setupVertexArray(pool);
+	_pools.push_back(pool);
+	return static_cast<int>(_pools.size() - 1);
+}
+
+void GeometryArena::setupVertexArray(const Pool& pool)
+{
+	const GLuint vao = pool.vao;
+	auto attribute = [this, vao](GLuint location, GLint size, GLenum type, GLboolean normalized, size_t offset)
+	{
+		glEnableVertexArrayAttrib(vao, location);
+		glVertexArrayAttribFormat(vao, location, size, type, normalized, static_cast<GLuint>(offset));
+		glVertexArrayAttribBinding(vao, location, VERTEX_BINDING);
+	};
+
+	if (pool.layout == Layout::Compressed)
+	{
+		// packed attributes are read normalized, they need all four components
+		attribute(VertexAttributes::POSITION, 3, GL_FLOAT, GL_FALSE, offsetof(CompressedVertex, position));
+		attribute(VertexAttributes::NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(CompressedVertex, normal));
+		attribute(VertexAttributes::TEX_COORD, 2, GL_FLOAT, GL_FALSE, offsetof(CompressedVertex, texCoord));
+		attribute(VertexAttributes::TANGENT, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(CompressedVertex, tangent));
+		// rebuilt from the normal and the tangent sign
+	}
+	else
+	{
+		attribute(VertexAttributes::POSITION, 3, GL_FLOAT, GL_FALSE, offsetof(FullVertex, position));
+		attribute(VertexAttributes::NORMAL, 3, GL_FLOAT, GL_FALSE, offsetof(FullVertex, normal));
+		attribute(VertexAttributes::TEX_COORD, 2, GL_FLOAT, GL_FALSE, offsetof(FullVertex, texCoord));
+		attribute(VertexAttributes::TANGENT, 3, GL_FLOAT, GL_FALSE, offsetof(FullVertex, tangent));
+		attribute(VertexAttributes::BITANGENT, 3, GL_FLOAT, GL_FALSE, offsetof(FullVertex, bitangent));
+	}
+
+	glEnableVertexArrayAttrib(vao, VertexAttributes::DRAW_INDEX);
+	glVertexArrayAttribIFormat(vao, VertexAttributes::DRAW_INDEX, 1, GL_UNSIGNED_INT, 0);
+	glVertexArrayAttribBinding(vao, VertexAttributes::DRAW_INDEX, DRAW_INDEX_BINDING);
+	glVertexArrayBindingDivisor(vao, DRAW_INDEX_BINDING, pool.drawIndexDivisor);
+	glVertexArrayVertexBuffer(vao, DRAW_INDEX_BINDING, _drawIndexBuffer, 0, sizeof(GLuint));
+}
+
+void GeometryArena::grow(GLuint& buffer, size_t& capacity, size_t elementSize, size_t needed, size_t minCapacity,
+	std::vector<Range>& freeRanges)
+{
+	const size_t newCapacity = std::max({ capacity * 2, capacity + needed, minCapacity });
+
+	GLuint newBuffer = 0;
+	glCreateBuffers(1, &newBuffer);
+	glNamedBufferStorage(newBuffer, newCapacity * elementSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	if (buffer)
+	{
+		glCopyNamedBufferSubData(buffer, newBuffer, 0, 0, capacity * elementSize);
+		glDeleteBuffers(1, &buffer);
+	}
+	give(freeRanges, capacity, newCapacity - capacity);
+	buffer = newBuffer;
+	capacity = newCapacity;
+}
+
+bool GeometryArena::take(std::vector<Range>& freeRanges, size_t size, size_t& offset)
+{
+	// First fit, the ranges are kept in offset order
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+	{
+		if (it->size < size)
+			continue;
+		offset = it->offset;
+		it->offset += size;
+		it->size -= size;
+		if (it->size == 0)
+			freeRanges.erase(it);
+		return true;
+	}
+	return false;
+}
+
+void GeometryArena::give(std::vector<Range>& freeRanges, size_t offset, size_t size)
+{
+	if (size == 0)
+		return;
+	auto it = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset, [](const Range& range, size_t value)
+		{
+			return range.offset < value;
+		});
+	it = freeRanges.insert(it, { offset, size });
+
+	// Merge with the neighbours it touches
+	auto next = it + 1;
+	if (next != freeRanges.end() && it->offset + it->size == next->offset)
+	{
+		it->size += next->size;
+		freeRanges.erase(next);
+	}
+	if (it != freeRanges.begin())
+	{
+		auto previous = it - 1;
+		if (previous->offset + previous->size == it->offset)
+		{
+			previous->size += it->size;
+			freeRanges.erase(it);
+		}
+	}
+}
+
+size_t GeometryArena::vertexSize(Layout layout)
+{
+	return layout == Layout::Compressed ? sizeof(CompressedVertex) : sizeof(FullVertex);
+}
+
+size_t GeometryArena::indexSize(GLenum indexType)
+{
+	return indexType == GL_UNSIGNED_SHORT ? sizeof(quint16) : sizeof(GLuint);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <QOpenGLFunctions_4_5_Core>
+#include <cstddef>
+#include <vector>
+#include "VertexAttributes.h"
+
+class QOpenGLContext;
+
+// Large vertex and index buffers of one OpenGL context that imported meshes
+// are sub-allocated from. There is a pool per vertex layout and index type
+// with its own VAO, so all meshes of a pool draw from the same vertex state
+// and can go out together with glMultiDrawElementsIndirect. A mesh's indices
+// count from its first vertex, draws pass it as the base vertex.
+//
+// The VAOs have the attributes at the VertexAttributes locations. DRAW_INDEX
+// is a per instance draw index, a draw's baseInstance selects it; the
+// MULTI_DRAW shaders read their per draw data with it. Draws with several
+// instances, one per view, bind the VAO with their instance count so all of
+// them read the same index.
+//
+// The buffers grow by copying into larger ones, freed ranges are reused.
+class GeometryArena : public QOpenGLFunctions_4_5_Core
+{
+public:
+	enum class Layout
+	{
+		Full,      // FullVertex
+		Compressed // CompressedVertex
+	};
+
+	// Interleaved vertex of the full precision format
+	struct FullVertex
+	{
+		float position[3];
+		float normal[3];
+		float texCoord[2];
+		float tangent[3];
+		float bitangent[3];
+	};
+	static_assert(sizeof(FullVertex) == 56, "unexpected FullVertex padding");
+
+	// Interleaved vertex of the compressed format, 28 bytes instead of 56.
+	// Texture coordinates stay full floats, halves would shift the texels of large maps.
+	struct CompressedVertex
+	{
+		float position[3];
+		quint32 normal;      // GL_INT_2_10_10_10_REV
+		quint32 tangent;     // GL_INT_2_10_10_10_REV, w is the bitangent sign
+		float texCoord[2];
+	};
+	static_assert(sizeof(CompressedVertex) == 28, "unexpected CompressedVertex padding");
+
+	struct Allocation
+	{
+		int pool;            // -1 when nothing is allocated
+		GLint baseVertex;
+		GLuint firstIndex;
+		GLuint vertexCount;
+		GLsizei indexCount;
+	};
+
+	static GeometryArena* forContext(QOpenGLContext* context);
+	static GeometryArena* current(); // nullptr without a current context
+	// Frees a mesh's ranges, if the context still exists
+	static void release(QOpenGLContext* context, Allocation& allocation);
+
+	~GeometryArena();
+
+	// Copies the vertices and indices into the pool of the layout and index type
+	Allocation allocate(Layout layout, GLenum indexType, const void* vertices, GLuint vertexCount, const void* indices, GLsizei indexCount);
+	void free(Allocation& allocation);
+
+	GLenum indexType(int pool) const;
+	void bind(int pool, GLuint instancesPerDraw = 1); // the pool's VAO
+	void release();
+
+	// Makes draw indices up to count available to the VAOs
+	void reserveDrawIndices(size_t count);
+
+private:
+	explicit GeometryArena(QOpenGLContext* context);
+
+	struct Range
+	{
+		size_t offset;
+		size_t size;
+	};
+
+	struct Pool
+	{
+		Layout layout;
+		GLenum indexType;
+		GLuint vao;
+		GLuint vertexBuffer;
+		GLuint indexBuffer;
+		size_t vertexCapacity; // in vertices
+		size_t indexCapacity;  // in indices
+		std::vector<Range> freeVertices;
+		std::vector<Range> freeIndices;
+		GLuint drawIndexDivisor;
+	};
+
+	int pool(Layout layout, GLenum indexType);
+	void setupVertexArray(const Pool& pool);
+	// Copies the buffer into one with room for at least needed more elements
+	void grow(GLuint& buffer, size_t& capacity, size_t elementSize, size_t needed, size_t minCapacity, std::vector<Range>& freeRanges);
+
+	static bool take(std::vector<Range>& freeRanges, size_t size, size_t& offset);
+	static void give(std::vector<Range>& freeRanges, size_t offset, size_t size);
+	static size_t vertexSize(Layout layout);
+	static size_t indexSize(GLenum indexType);
+
+	QOpenGLContext* _context;
+	std::vector<Pool> _pools;
+	GLuint _drawIndexBuffer;
+	size_t _drawIndexCapacity;
+};
@@ -0,0 +1,109 @@
+#include "IndirectDraws.h"
+#include "GeometryArena.h"
+#include "TriangleMesh.h"
+
+#include <QOpenGLShaderProgram>
+
+#include <algorithm>
+#include <tuple>
+
+IndirectDraws::IndirectDraws() : _instanceCount(1),
+_uniformBuffer(0),
+_commandBuffer(0)
+{
+	initializeOpenGLFunctions();
+	glCreateBuffers(1, &_uniformBuffer);
+	glCreateBuffers(1, &_commandBuffer);
+}
+
+IndirectDraws::~IndirectDraws()
+{
+	glDeleteBuffers(1, &_uniformBuffer);
+	glDeleteBuffers(1, &_commandBuffer);
+}
+
+bool IndirectDraws::accepts(const TriangleMesh* mesh, bool bindless)
+{
+	// Blended meshes keep their order after the opaque ones, bound maps can't vary within a draw call
+	return mesh->inGeometryArena() && !mesh->isTransparent() && (bindless || !mesh->hasTextureMaps());
+}
+
+void IndirectDraws::add(QOpenGLShaderProgram* prog, TriangleMesh* mesh, bool withMaterial, int id)
+{
+	_draws.push_back({ prog, mesh, withMaterial, id });
+}
+
+void IndirectDraws::draw(GLuint instanceCount)
+{
+	prepare(instanceCount);
+	submit();
+	clear();
+}
+
+void IndirectDraws::prepare(GLuint instanceCount)
+{
+	if (_draws.empty())
+		return;
+	_instanceCount = instanceCount;
+
+	// One bucket per program, pool and winding, each a single draw call
+	std::stable_sort(_draws.begin(), _draws.end(), [](const Draw& a, const Draw& b)
+		{
+			return std::make_tuple(a.prog, a.mesh->arenaAllocation().pool, a.mesh->mirrored()) <
+				std::make_tuple(b.prog, b.mesh->arenaAllocation().pool, b.mesh->mirrored());
+		});
+
+	_uniforms.clear();
+	_commands.clear();
+	for (size_t i = 0; i < _draws.size(); i++)
+	{
+		const Draw& draw = _draws[i];
+		const GeometryArena::Allocation& allocation = draw.mesh->arenaAllocation();
+		_uniforms.push_back(draw.mesh->drawUniforms(draw.withMaterial));
+		_commands.push_back({ static_cast<GLuint>(allocation.indexCount), instanceCount, allocation.firstIndex, allocation.baseVertex, static_cast<GLuint>(i) });
+	}
+
+	// Orphaned every pass, the previous contents may still be in use
+	glNamedBufferData(_uniformBuffer, _uniforms.size() * sizeof(DrawUniforms), _uniforms.data(), GL_STREAM_DRAW);
+	glNamedBufferData(_commandBuffer, _commands.size() * sizeof(DrawElementsIndirectCommand), _commands.data(), GL_STREAM_DRAW);
+	GeometryArena::current()->reserveDrawIndices(_draws.size());
+}
+
+void IndirectDraws::submit()
+{
+	if (_draws.empty())
+		return;
+	GeometryArena* arena = GeometryArena::current();
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DrawUniforms::BINDING, _uniformBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+	glDisable(GL_BLEND);
+	size_t begin = 0;
+	while (begin < _draws.size())
+	{
+		QOpenGLShaderProgram* prog = _draws[begin].prog;
+		const int pool = _draws[begin].mesh->arenaAllocation().pool;
+		const bool mirrored = _draws[begin].mesh->mirrored();
+		size_t end = begin + 1;
+		while (end < _draws.size() && _draws[end].prog == prog &&
+			_draws[end].mesh->arenaAllocation().pool == pool && _draws[end].mesh->mirrored() == mirrored)
+			end++;
+
+		prog->bind();
+		arena->bind(pool, _instanceCount);
+		// Handle lighting normal for negative scaling
+		glFrontFace(mirrored ? GL_CW : GL_CCW);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, arena->indexType(pool),
+			reinterpret_cast<const void*>(begin * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(end - begin), 0);
+		begin = end;
+	}
+
+	arena->release();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	_draws.back().prog->release();
+}
+
+void IndirectDraws::clear()
+{
+	_draws.clear();
+}
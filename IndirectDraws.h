@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QOpenGLFunctions_4_5_Core>
+#include <vector>
+#include "UniformBlocks.h"
+
+class QOpenGLShaderProgram;
+class TriangleMesh;
+
+// Draws of geometry arena meshes collected over a pass and submitted with one
+// glMultiDrawElementsIndirect per program, arena pool and winding. The state
+// a mesh would set as uniforms goes into the DrawUniforms storage buffer, a
+// draw's baseInstance is its entry there. The programs have to be MULTI_DRAW
+// builds, they read the entry through the arena's draw index attribute.
+class IndirectDraws : public QOpenGLFunctions_4_5_Core
+{
+public:
+	IndirectDraws();  // needs a current context
+	~IndirectDraws(); // needs the same context current
+
+	// Opaque arena meshes, textured ones only when their maps are bindless
+	static bool accepts(const TriangleMesh* mesh, bool bindless);
+
+	// Without the material only the transformation is filled in, for depth only passes.
+	// The id is the mesh's in the scene, kept for occlusion culling.
+	void add(QOpenGLShaderProgram* prog, TriangleMesh* mesh, bool withMaterial = true, int id = -1);
+	bool isEmpty() const { return _draws.empty(); }
+	// Submits the collected draws and forgets them, leaves no program or VAO bound.
+	// Each draw has the instances, the MULTI_VIEW shaders draw one per view.
+	void draw(GLuint instanceCount = 1);
+
+	// The steps of draw(), for callers changing the commands on the GPU in between.
+	// prepare() sorts and uploads the draws, after it they are in submission order.
+	void prepare(GLuint instanceCount = 1);
+	void submit();
+	void clear();
+
+	size_t size() const { return _draws.size(); }
+	const TriangleMesh* mesh(size_t draw) const { return _draws[draw].mesh; }
+	int id(size_t draw) const { return _draws[draw].id; }
+	// DrawElementsIndirectCommands of the prepared draws, instanceCount is the second of their five uints
+	GLuint commandBuffer() const { return _commandBuffer; }
+
+private:
+	// Layout glMultiDrawElementsIndirect reads
+	struct DrawElementsIndirectCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	struct Draw
+	{
+		QOpenGLShaderProgram* prog;
+		TriangleMesh* mesh;
+		bool withMaterial;
+		int id;
+	};
+
+	std::vector<Draw> _draws;
+	GLuint _instanceCount;
+	std::vector<DrawUniforms> _uniforms;
+	std::vector<DrawElementsIndirectCommand> _commands;
+	GLuint _uniformBuffer;
+	GLuint _commandBuffer;
+};
@@ -0,0 +1,212 @@
+#include "Ktx2.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const unsigned char IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	constexpr size_t HEADER_SIZE = 80;
+	constexpr size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+
+	// Vulkan format and Khronos data format color model of each format
+	struct FormatInfo
+	{
+		BlockCompression::Format format;
+		quint32 vkFormat;
+		quint8 colorModel;
+	};
+
+	const FormatInfo FORMATS[] = {
+		{ BlockCompression::Format::BC1, 131, 128 }, // VK_FORMAT_BC1_RGB_UNORM_BLOCK, KHR_DF_MODEL_BC1A
+		{ BlockCompression::Format::BC3, 137, 130 }, // VK_FORMAT_BC3_UNORM_BLOCK, KHR_DF_MODEL_BC3
+		{ BlockCompression::Format::BC4, 139, 131 }, // VK_FORMAT_BC4_UNORM_BLOCK, KHR_DF_MODEL_BC4
+		{ BlockCompression::Format::BC5, 141, 132 }  // VK_FORMAT_BC5_UNORM_BLOCK, KHR_DF_MODEL_BC5
+	};
+
+	const FormatInfo* findFormat(BlockCompression::Format format)
+	{
+		for (const FormatInfo& info : FORMATS)
+			if (info.format == format)
+				return &info;
+		return nullptr;
+	}
+
+	const FormatInfo* findVkFormat(quint32 vkFormat)
+	{
+		for (const FormatInfo& info : FORMATS)
+			if (info.vkFormat == vkFormat)
+				return &info;
+		return nullptr;
+	}
+
+	void append32(QByteArray& bytes, quint32 value)
+	{
+		const quint32 le = qToLittleEndian(value);
+		bytes.append(reinterpret_cast<const char*>(&le), 4);
+	}
+
+	void append64(QByteArray& bytes, quint64 value)
+	{
+		const quint64 le = qToLittleEndian(value);
+		bytes.append(reinterpret_cast<const char*>(&le), 8);
+	}
+
+	quint32 read32(const QByteArray& bytes, size_t offset)
+	{
+		return qFromLittleEndian<quint32>(bytes.constData() + offset);
+	}
+
+	quint64 read64(const QByteArray& bytes, size_t offset)
+	{
+		return qFromLittleEndian<quint64>(bytes.constData() + offset);
+	}
+
+	// Basic data format descriptor: one 4x4 block per texel block, a sample per 64 bit half
+	QByteArray dataFormatDescriptor(const FormatInfo& info)
+	{
+		const bool twoHalves = BlockCompression::blockSize(info.format) == 16;
+		const quint32 samples = twoHalves ? 2 : 1;
+		const quint32 blockSize = 24 + 16 * samples;
+
+		QByteArray dfd;
+		append32(dfd, 4 + blockSize);
+		append32(dfd, 0);                          // Khronos vendor, basic descriptor type
+		append32(dfd, 2 | (blockSize << 16));      // version 1.3, block size
+		dfd.append(static_cast<char>(info.colorModel));
+		dfd.append(static_cast<char>(1));          // BT.709 primaries
+		dfd.append(static_cast<char>(1));          // linear transfer, textures are sampled as is
+		dfd.append(static_cast<char>(0));          // straight alpha
+		dfd.append("\x03\x03\x00\x00", 4);         // 4x4x1x1 texel block
+		dfd.append(static_cast<char>(BlockCompression::blockSize(info.format)));
+		dfd.append(7, '\0');                       // bytesPlane1..7
+
+		// Channel of each 64 bit half
+		quint8 channels[2] = { 0, 0 };
+		if (info.format == BlockCompression::Format::BC3)
+		{
+			channels[0] = 15; // alpha block first
+			channels[1] = 0;
+		}
+		else if (info.format == BlockCompression::Format::BC5)
+		{
+			channels[0] = 0;  // red
+			channels[1] = 1;  // green
+		}
+		for (quint32 sample = 0; sample < samples; sample++)
+		{
+			append32(dfd, (64 * sample) | (63 << 16) | (static_cast<quint32>(channels[sample]) << 24));
+			append32(dfd, 0);                      // sample position
+			append32(dfd, 0);                      // lower
+			append32(dfd, 0xFFFFFFFF);             // upper
+		}
+		return dfd;
+	}
+}
+
+namespace Ktx2
+{
+	bool write(const QString& path, const BlockCompression::Image& image)
+	{
+		const FormatInfo* info = findFormat(image.format);
+		if (!info || image.levels.empty())
+			return false;
+
+		const QByteArray dfd = dataFormatDescriptor(*info);
+		const size_t levelCount = image.levels.size();
+		const size_t dfdOffset = HEADER_SIZE + LEVEL_INDEX_ENTRY_SIZE * levelCount;
+		const size_t alignment = BlockCompression::blockSize(image.format);
+
+		// Level data goes after the descriptor, smallest level first as the format recommends
+		std::vector<quint64> levelOffsets(levelCount);
+		size_t offset = dfdOffset + dfd.size();
+		for (size_t l = levelCount; l-- > 0; )
+		{
+			offset = (offset + alignment - 1) / alignment * alignment;
+			levelOffsets[l] = offset;
+			offset += image.levels[l].size;
+		}
+
+		QByteArray bytes;
+		bytes.reserve(static_cast<int>(offset));
+		bytes.append(reinterpret_cast<const char*>(IDENTIFIER), sizeof(IDENTIFIER));
+		append32(bytes, info->vkFormat);
+		append32(bytes, 1);                            // typeSize
+		append32(bytes, static_cast<quint32>(image.width));
+		append32(bytes, static_cast<quint32>(image.height));
+		append32(bytes, 0);                            // pixelDepth
+		append32(bytes, 0);                            // layerCount
+		append32(bytes, 1);                            // faceCount
+		append32(bytes, static_cast<quint32>(levelCount));
+		append32(bytes, 0);                            // supercompressionScheme
+		append32(bytes, static_cast<quint32>(dfdOffset));
+		append32(bytes, static_cast<quint32>(dfd.size()));
+		append32(bytes, 0);                            // no key/value data
+		append32(bytes, 0);
+		append64(bytes, 0);                            // no supercompression global data
+		append64(bytes, 0);
+		for (size_t l = 0; l < levelCount; l++)
+		{
+			append64(bytes, levelOffsets[l]);
+			append64(bytes, image.levels[l].size);
+			append64(bytes, image.levels[l].size);
+		}
+		bytes.append(dfd);
+		for (size_t l = levelCount; l-- > 0; )
+		{
+			bytes.append(static_cast<int>(levelOffsets[l] - bytes.size()), '\0');
+			bytes.append(image.data.constData() + image.levels[l].offset, static_cast<int>(image.levels[l].size));
+		}
+
+		QSaveFile file(path);
+		if (!file.open(QIODevice::WriteOnly))
+			return false;
+		file.write(bytes);
+		return file.commit();
+	}
+
+	bool read(const QString& path, BlockCompression::Image& image)
+	{
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly))
+			return false;
+		QByteArray bytes = file.readAll();
+		const size_t fileSize = bytes.size();
+		if (fileSize < HEADER_SIZE || std::memcmp(bytes.constData(), IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+			return false;
+
+		const FormatInfo* info = findVkFormat(read32(bytes, 12));
+		const quint32 width = read32(bytes, 20);
+		const quint32 height = read32(bytes, 24);
+		const quint32 levelCount = read32(bytes, 40);
+		if (!info || read32(bytes, 16) != 1 || width == 0 || height == 0 || read32(bytes, 28) != 0 ||
+			read32(bytes, 32) != 0 || read32(bytes, 36) != 1 || levelCount == 0 || levelCount > 32 || read32(bytes, 44) != 0 ||
+			HEADER_SIZE + LEVEL_INDEX_ENTRY_SIZE * levelCount > fileSize)
+			return false;
+
+		BlockCompression::Image result = { info->format, static_cast<int>(width), static_cast<int>(height), {}, {} };
+		int levelWidth = result.width, levelHeight = result.height;
+		for (quint32 l = 0; l < levelCount; l++)
+		{
+			const size_t entry = HEADER_SIZE + LEVEL_INDEX_ENTRY_SIZE * l;
+			const quint64 offset = read64(bytes, entry);
+			const quint64 size = read64(bytes, entry + 8);
+			const size_t expected = static_cast<size_t>((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * BlockCompression::blockSize(info->format);
+			if (size != expected || offset > fileSize || size > fileSize - offset)
+				return false;
+			result.levels.push_back({ levelWidth, levelHeight, static_cast<size_t>(offset), expected });
+			levelWidth = std::max(1, levelWidth / 2);
+			levelHeight = std::max(1, levelHeight / 2);
+		}
+
+		// The levels are addressed inside the file contents, no copy
+		result.data = bytes;
+		image = std::move(result);
+		return true;
+	}
+}
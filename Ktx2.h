@@ -0,0 +1,15 @@
+#pragma once
+
+#include "BlockCompression.h"
+
+#include <QString>
+
+// KTX 2.0 container for block compressed images with their mipmaps, the
+// on-disk cache of compressed textures. Only what BlockCompression produces
+// is written and read back: one 2D image, no supercompression.
+namespace Ktx2
+{
+	bool write(const QString& path, const BlockCompression::Image& image);
+	// False when the file is missing or not one written by write()
+	bool read(const QString& path, BlockCompression::Image& image);
+}
@@ -0,0 +1,179 @@
+#include "MaterialTextures.h"
+#include "TextureCache.h"
+
+#include <QOpenGLContext>
+
+#include <algorithm>
+#include <map>
+
+namespace
+{
+	std::map<QOpenGLContext*, MaterialTextures*>& contextTables()
+	{
+		static std::map<QOpenGLContext*, MaterialTextures*> tables;
+		return tables;
+	}
+}
+
+MaterialTextures::MaterialTextures(QOpenGLContext* context) : _context(context),
+_bindless(false),
+_getTextureHandle(nullptr),
+_makeTextureHandleResident(nullptr),
+_isTextureHandleResident(nullptr),
+_buffer(0),
+_bufferMaterials(0),
+_blankTexture(0),
+_pendingTexture(0),
+_blankHandle(0),
+_pendingHandle(0)
+{
+	initializeOpenGLFunctions();
+
+	if (context->hasExtension("GL_ARB_bindless_texture"))
+	{
+		_getTextureHandle = reinterpret_cast<GetTextureHandle>(context->getProcAddress("glGetTextureHandleARB"));
+		_makeTextureHandleResident = reinterpret_cast<MakeTextureHandleResident>(context->getProcAddress("glMakeTextureHandleResidentARB"));
+		_isTextureHandleResident = reinterpret_cast<IsTextureHandleResident>(context->getProcAddress("glIsTextureHandleResidentARB"));
+		_bindless = _getTextureHandle && _makeTextureHandleResident && _isTextureHandleResident;
+	}
+
+	if (_bindless)
+	{
+		const unsigned char blank[4] = { 0, 0, 0, 255 };
+		const unsigned char white[4] = { 255, 255, 255, 255 };
+		_blankTexture = createPixelTexture(blank);
+		_pendingTexture = createPixelTexture(white);
+		_blankHandle = handle(_blankTexture);
+		_pendingHandle = handle(_pendingTexture);
+		glCreateBuffers(1, &_buffer);
+	}
+}
+
+MaterialTextures::~MaterialTextures()
+{
+	// Only clean up while our context is current, otherwise everything goes with the context
+	if (QOpenGLContext::currentContext() != _context)
+		return;
+
+	// Resident handles go away with their textures
+	if (_buffer)
+		glDeleteBuffers(1, &_buffer);
+	if (_blankTexture)
+		glDeleteTextures(1, &_blankTexture);
+	if (_pendingTexture)
+		glDeleteTextures(1, &_pendingTexture);
+}
+
+MaterialTextures* MaterialTextures::forContext(QOpenGLContext* context)
+{
+	if (!context)
+		return nullptr;
+
+	auto& tables = contextTables();
+	auto it = tables.find(context);
+	if (it != tables.end())
+		return it->second;
+
+	MaterialTextures* table = new MaterialTextures(context);
+	tables[context] = table;
+	QObject::connect(context, &QOpenGLContext::aboutToBeDestroyed, context, [context]()
+		{
+			auto& tables = contextTables();
+			auto it = tables.find(context);
+			if (it != tables.end())
+			{
+				delete it->second;
+				tables.erase(it);
+			}
+		});
+	return table;
+}
+
+void MaterialTextures::release(QOpenGLContext* context, int material)
+{
+	auto& tables = contextTables();
+	auto it = tables.find(context);
+	if (it == tables.end() || material < 0)
+		return;
+	it->second->_freeMaterials.push_back(material);
+}
+
+int MaterialTextures::allocate()
+{
+	if (!_freeMaterials.empty())
+	{
+		const int material = _freeMaterials.back();
+		_freeMaterials.pop_back();
+		return material;
+	}
+	const int material = static_cast<int>(_handles.size() / SLOT_COUNT);
+	_handles.resize(_handles.size() + SLOT_COUNT, _blankHandle);
+	return material;
+}
+
+bool MaterialTextures::update(int material, const Slots& textures)
+{
+	bool complete = true;
+	GLuint64* row = &_handles[static_cast<size_t>(material) * SLOT_COUNT];
+	for (int slot = 0; slot < SLOT_COUNT; slot++)
+	{
+		row[slot] = handle(textures[slot]);
+		if (row[slot] == 0)
+		{
+			row[slot] = _pendingHandle;
+			complete = false;
+		}
+	}
+
+	const size_t materials = _handles.size() / SLOT_COUNT;
+	if (materials > _bufferMaterials)
+	{
+		// Grown by doubling, the whole table goes up with the new storage
+		_bufferMaterials = std::max(materials, 2 * _bufferMaterials);
+		glNamedBufferData(_buffer, _bufferMaterials * SLOT_COUNT * sizeof(GLuint64), nullptr, GL_DYNAMIC_DRAW);
+		glNamedBufferSubData(_buffer, 0, _handles.size() * sizeof(GLuint64), _handles.data());
+	}
+	else
+	{
+		glNamedBufferSubData(_buffer, static_cast<size_t>(material) * SLOT_COUNT * sizeof(GLuint64), SLOT_COUNT * sizeof(GLuint64), row);
+	}
+	return complete;
+}
+
+void MaterialTextures::prepare()
+{
+	if (_bindless)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_BINDING, _buffer);
+}
+
+void MaterialTextures::bind(const Slots& textures)
+{
+	// Slot ranges map onto units 0, 10 to 15 and 20 to 26
+	glBindTextures(0, 1, &textures[0]);
+	glBindTextures(10, 6, &textures[1]);
+	glBindTextures(20, 7, &textures[7]);
+}
+
+GLuint64 MaterialTextures::handle(unsigned int texture)
+{
+	if (texture == 0)
+		return _blankHandle;
+	// A handle freezes the texture, the cache's placeholders still have their image to come
+	TextureCache* cache = TextureCache::forContext(_context);
+	if (cache && cache->isPending(texture))
+		return 0;
+
+	const GLuint64 textureHandle = _getTextureHandle(texture);
+	if (textureHandle && !_isTextureHandleResident(textureHandle))
+		_makeTextureHandleResident(textureHandle);
+	return textureHandle;
+}
+
+unsigned int MaterialTextures::createPixelTexture(const unsigned char rgba[4])
+{
+	unsigned int texture = 0;
+	glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+	glTextureStorage2D(texture, 1, GL_RGBA8, 1, 1);
+	glTextureSubImage2D(texture, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+	return texture;
+}
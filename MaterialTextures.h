@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QOpenGLFunctions_4_5_Core>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+class QOpenGLContext;
+
+// The texture maps a mesh's material samples, one slot per texture unit of
+// the foreground shader: texUnit on unit 0, the ADS maps on 10 to 15 and the
+// PBR maps on 20 to 26.
+//
+// With ARB_bindless_texture every material owns a row of resident texture
+// handles in a shader storage buffer. The shader reads its samplers from the
+// row of the materialIndex uniform, so drawing a mesh binds no textures.
+// Without it the slots are bound with one glBindTextures call per unit range.
+class MaterialTextures : public QOpenGLFunctions_4_5_Core
+{
+public:
+	static constexpr int SLOT_COUNT = 14;
+	static constexpr unsigned int BUFFER_BINDING = 3; // MaterialTextures block of twoside_per_fragment.frag
+	typedef std::array<unsigned int, SLOT_COUNT> Slots;
+
+	static MaterialTextures* forContext(QOpenGLContext* context);
+	// Frees a material row of the context, if the context still exists
+	static void release(QOpenGLContext* context, int material);
+
+	~MaterialTextures();
+
+	bool bindless() const { return _bindless; }
+
+	// Bindless: a new material row
+	int allocate();
+	// Bindless: stores the handles of the textures in the material's row.
+	// Textures still waiting for their image are shown white and make it
+	// return false, call it again on a later frame.
+	bool update(int material, const Slots& textures);
+	// Bindless: binds the handle buffer, call before drawing
+	void prepare();
+
+	// Without bindless: binds the textures to their units
+	void bind(const Slots& textures);
+
+private:
+	explicit MaterialTextures(QOpenGLContext* context);
+
+	typedef GLuint64 (QOPENGLF_APIENTRYP GetTextureHandle)(GLuint texture);
+	typedef void (QOPENGLF_APIENTRYP MakeTextureHandleResident)(GLuint64 handle);
+	typedef GLboolean (QOPENGLF_APIENTRYP IsTextureHandleResident)(GLuint64 handle);
+
+	GLuint64 handle(unsigned int texture);
+	unsigned int createPixelTexture(const unsigned char rgba[4]);
+
+	QOpenGLContext* _context;
+	bool _bindless;
+	GetTextureHandle _getTextureHandle;
+	MakeTextureHandleResident _makeTextureHandleResident;
+	IsTextureHandleResident _isTextureHandleResident;
+
+	std::vector<GLuint64> _handles; // SLOT_COUNT per material
+	std::vector<int> _freeMaterials;
+	unsigned int _buffer;
+	size_t _bufferMaterials;        // rows the buffer has room for
+	unsigned int _blankTexture;     // samples like an empty unit
+	unsigned int _pendingTexture;   // white like the cache's placeholders
+	GLuint64 _blankHandle;
+	GLuint64 _pendingHandle;
+};
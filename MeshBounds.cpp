@@ -0,0 +1,290 @@
+#include "MeshBounds.h"
+
+#include <QMatrix4x4>
+#include <QThreadPool>
+#include <QSemaphore>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESH_BOUNDS_SSE2
+#endif
+
+namespace
+{
+	constexpr size_t PARALLEL_BOUNDS_VERTICES = 262144; // below this the bounds are computed on the calling thread
+
+	// Vertices with the smallest and largest coordinate along each axis
+	struct Extremes
+	{
+		size_t minIndex[3];
+		size_t maxIndex[3];
+	};
+
+	struct Sphere
+	{
+		float center[3];
+		float radius;
+	};
+
+	struct Slices
+	{
+		int count;
+		size_t size;
+	};
+
+	Slices slices(size_t vertexCount)
+	{
+		Slices result = { 1, vertexCount };
+		const int threads = QThreadPool::globalInstance()->maxThreadCount();
+		if (vertexCount >= PARALLEL_BOUNDS_VERTICES && threads > 1)
+		{
+			result.size = (vertexCount + threads - 1) / threads;
+			result.count = static_cast<int>((vertexCount + result.size - 1) / result.size); // no empty slices
+		}
+		return result;
+	}
+
+	// Runs task(slice, first, last) for every slice, the calling thread takes the first one
+	template <typename Task>
+	void runSlices(const Slices& slices, size_t vertexCount, const Task& task)
+	{
+		auto runSlice = [&slices, vertexCount, &task](int slice)
+		{
+			const size_t first = slice * slices.size;
+			task(slice, first, std::min(vertexCount, first + slices.size));
+		};
+
+		QThreadPool* pool = QThreadPool::globalInstance();
+		QSemaphore done;
+		for (int slice = 1; slice < slices.count; slice++)
+		{
+			pool->start([&runSlice, &done, slice]()
+				{
+					runSlice(slice);
+					done.release();
+				});
+		}
+		runSlice(0);
+		done.acquire(slices.count - 1);
+	}
+
+	void findExtremes(const float* points, size_t first, size_t last, Extremes& out)
+	{
+		for (int c = 0; c < 3; c++)
+			out.minIndex[c] = out.maxIndex[c] = first;
+
+		size_t i = first + 1;
+#ifdef MESH_BOUNDS_SSE2
+		// Unaligned xyz loads; lane 3 holds the next vertex's x and is ignored.
+		// The last vertex is left to the scalar loop so no load reads past the array.
+		if (last - first > 1 && last - first <= static_cast<size_t>(INT_MAX))
+		{
+			__m128 minValues = _mm_loadu_ps(points + 3 * first);
+			__m128 maxValues = minValues;
+			__m128i minOffsets = _mm_setzero_si128();
+			__m128i maxOffsets = minOffsets;
+			for (; i + 1 < last; i++)
+			{
+				const __m128 v = _mm_loadu_ps(points + 3 * i);
+				const __m128i offset = _mm_set1_epi32(static_cast<int>(i - first));
+				const __m128i less = _mm_castps_si128(_mm_cmplt_ps(v, minValues));
+				const __m128i greater = _mm_castps_si128(_mm_cmpgt_ps(v, maxValues));
+				minOffsets = _mm_or_si128(_mm_and_si128(less, offset), _mm_andnot_si128(less, minOffsets));
+				maxOffsets = _mm_or_si128(_mm_and_si128(greater, offset), _mm_andnot_si128(greater, maxOffsets));
+				minValues = _mm_min_ps(v, minValues);
+				maxValues = _mm_max_ps(v, maxValues);
+			}
+
+			alignas(16) int mins[4], maxs[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(mins), minOffsets);
+			_mm_store_si128(reinterpret_cast<__m128i*>(maxs), maxOffsets);
+			for (int c = 0; c < 3; c++)
+			{
+				out.minIndex[c] = first + mins[c];
+				out.maxIndex[c] = first + maxs[c];
+			}
+		}
+#endif
+		for (; i < last; i++)
+		{
+			const float* p = points + 3 * i;
+			for (int c = 0; c < 3; c++)
+			{
+				if (p[c] < points[3 * out.minIndex[c] + c])
+					out.minIndex[c] = i;
+				if (p[c] > points[3 * out.maxIndex[c] + c])
+					out.maxIndex[c] = i;
+			}
+		}
+	}
+
+	void mergeExtremes(const float* points, Extremes& extremes, const Extremes& other)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			if (points[3 * other.minIndex[c] + c] < points[3 * extremes.minIndex[c] + c])
+				extremes.minIndex[c] = other.minIndex[c];
+			if (points[3 * other.maxIndex[c] + c] > points[3 * extremes.maxIndex[c] + c])
+				extremes.maxIndex[c] = other.maxIndex[c];
+		}
+	}
+
+	// Ritter's growth step over [first, last)
+	void growSphere(const float* points, size_t first, size_t last, Sphere& sphere)
+	{
+		float sqRadius = sphere.radius * sphere.radius;
+		for (size_t i = first; i < last; i++)
+		{
+			const float* p = points + 3 * i;
+			const float dx = p[0] - sphere.center[0];
+			const float dy = p[1] - sphere.center[1];
+			const float dz = p[2] - sphere.center[2];
+			const float d = dx * dx + dy * dy + dz * dz;
+			if (d > sqRadius)
+			{
+				const float r = std::sqrt(d);
+				sphere.radius = (sphere.radius + r) * 0.5f;
+				sqRadius = sphere.radius * sphere.radius;
+				const float offset = r - sphere.radius;
+				for (int c = 0; c < 3; c++)
+					sphere.center[c] = (sphere.radius * sphere.center[c] + offset * p[c]) / r;
+			}
+		}
+	}
+
+	// Smallest sphere enclosing both spheres
+	void mergeSphere(Sphere& sphere, const Sphere& other)
+	{
+		float delta[3];
+		for (int c = 0; c < 3; c++)
+			delta[c] = other.center[c] - sphere.center[c];
+		const float distance = std::sqrt(delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2]);
+		if (distance + other.radius <= sphere.radius)
+			return;
+		if (distance + sphere.radius <= other.radius)
+		{
+			sphere = other;
+			return;
+		}
+		const float radius = (distance + sphere.radius + other.radius) * 0.5f;
+		const float t = (radius - sphere.radius) / distance;
+		for (int c = 0; c < 3; c++)
+			sphere.center[c] += delta[c] * t;
+		sphere.radius = radius;
+	}
+}
+
+namespace MeshBounds
+{
+	Bounds compute(const float* points, size_t vertexCount)
+	{
+		Bounds bounds = {};
+		if (points == nullptr || vertexCount == 0)
+		{
+			bounds.valid = false;
+			return bounds;
+		}
+
+		const Slices parts = slices(vertexCount);
+
+		// Pass 1: extreme points per axis, they are the box and seed the sphere
+		std::vector<Extremes> sliceExtremes(parts.count);
+		runSlices(parts, vertexCount, [points, &sliceExtremes](int slice, size_t first, size_t last)
+			{
+				findExtremes(points, first, last, sliceExtremes[slice]);
+			});
+		Extremes extremes = sliceExtremes[0];
+		for (int slice = 1; slice < parts.count; slice++)
+			mergeExtremes(points, extremes, sliceExtremes[slice]);
+
+		for (int c = 0; c < 3; c++)
+		{
+			bounds.boxMin[c] = points[3 * extremes.minIndex[c] + c];
+			bounds.boxMax[c] = points[3 * extremes.maxIndex[c] + c];
+		}
+
+		// Initial sphere over the most distant pair of extreme points
+		float maxSpan = -1.0f;
+		int axis = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			const float* pMin = points + 3 * extremes.minIndex[c];
+			const float* pMax = points + 3 * extremes.maxIndex[c];
+			float span = 0.0f;
+			for (int k = 0; k < 3; k++)
+				span += (pMax[k] - pMin[k]) * (pMax[k] - pMin[k]);
+			if (span > maxSpan)
+			{
+				maxSpan = span;
+				axis = c;
+			}
+		}
+		Sphere initial;
+		for (int c = 0; c < 3; c++)
+			initial.center[c] = (points[3 * extremes.minIndex[axis] + c] + points[3 * extremes.maxIndex[axis] + c]) * 0.5f;
+		initial.radius = std::sqrt(maxSpan) * 0.5f;
+
+		// Pass 2: every slice grows its own copy, the union encloses all points
+		std::vector<Sphere> sliceSpheres(parts.count, initial);
+		runSlices(parts, vertexCount, [points, &sliceSpheres](int slice, size_t first, size_t last)
+			{
+				growSphere(points, first, last, sliceSpheres[slice]);
+			});
+		Sphere sphere = sliceSpheres[0];
+		for (int slice = 1; slice < parts.count; slice++)
+			mergeSphere(sphere, sliceSpheres[slice]);
+
+		for (int c = 0; c < 3; c++)
+			bounds.center[c] = sphere.center[c];
+		bounds.radius = sphere.radius;
+		bounds.valid = true;
+		return bounds;
+	}
+
+	Bounds transformed(const Bounds& bounds, const QMatrix4x4& transformation)
+	{
+		Bounds result = bounds;
+		if (!bounds.valid)
+			return result;
+
+		// Box: transformed center plus the extents projected on the absolute matrix
+		float boxCenter[3], boxExtent[3];
+		for (int c = 0; c < 3; c++)
+		{
+			boxCenter[c] = (bounds.boxMin[c] + bounds.boxMax[c]) * 0.5f;
+			boxExtent[c] = (bounds.boxMax[c] - bounds.boxMin[c]) * 0.5f;
+		}
+		for (int r = 0; r < 3; r++)
+		{
+			float center = transformation(r, 3);
+			float extent = 0.0f;
+			float sphereCenter = transformation(r, 3);
+			for (int c = 0; c < 3; c++)
+			{
+				center += transformation(r, c) * boxCenter[c];
+				extent += std::fabs(transformation(r, c)) * boxExtent[c];
+				sphereCenter += transformation(r, c) * bounds.center[c];
+			}
+			result.boxMin[r] = center - extent;
+			result.boxMax[r] = center + extent;
+			result.center[r] = sphereCenter;
+		}
+
+		// Sphere: the radius grows with the largest axis scale
+		float maxScale = 0.0f;
+		for (int c = 0; c < 3; c++)
+		{
+			const float scale = std::sqrt(transformation(0, c) * transformation(0, c) +
+				transformation(1, c) * transformation(1, c) +
+				transformation(2, c) * transformation(2, c));
+			maxScale = std::max(maxScale, scale);
+		}
+		result.radius = bounds.radius * maxScale;
+		return result;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+class QMatrix4x4;
+
+// Bounds of a mesh's points: the axis aligned box and a Ritter sphere. The box
+// and the extreme points seeding the sphere come out of one pass over the
+// points (SSE2 where available), the sphere is then grown in a second pass.
+// Large meshes are split into slices on the global thread pool whose results
+// are merged. Transformed bounds are derived from the object space bounds
+// without visiting the points again.
+namespace MeshBounds
+{
+	struct Bounds
+	{
+		float boxMin[3];
+		float boxMax[3];
+		float center[3];
+		float radius;
+		bool valid; // false for an empty point set
+	};
+
+	// points holds vertexCount xyz triples
+	Bounds compute(const float* points, size_t vertexCount);
+
+	// Bounds enclosing the given ones after an affine transformation
+	Bounds transformed(const Bounds& bounds, const QMatrix4x4& transformation);
+}
@@ -879,7 +879,7 @@ void ModelViewer::displaySelectedMeshInfo()
 		for (int id : selected)
 		{
 			mesh = meshes.at(id);
-			points += mesh->getPoints().size() / 3;
+			points += mesh->vertexCount();
 			triangles += mesh->getIndices().size() / 3;
 			rawmem += mesh->memorySize();
 			try
@@ -0,0 +1,201 @@
+#include "OcclusionCuller.h"
+#include "IndirectDraws.h"
+#include "TriangleMesh.h"
+
+#include <QOpenGLShaderProgram>
+#include <QVector2D>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	constexpr GLuint BOUNDS_BINDING = 5;
+	constexpr GLuint VISIBILITY_BINDING = 6;
+	constexpr GLuint COMMANDS_BINDING = 7;
+	constexpr GLuint DEPTH_UNIT = 7; // left free by the foreground shaders
+	constexpr GLuint NO_ID = 0xFFFFFFFFu;
+	constexpr GLuint MIN_VISIBILITY_CAPACITY = 1024;
+	constexpr int PYRAMID_GROUP_SIZE = 8;
+	constexpr int CULL_GROUP_SIZE = 64;
+
+	bool buildComputeProgram(QOpenGLShaderProgram* prog, const QString& fileName)
+	{
+		if (!prog->addCacheableShaderFromSourceFile(QOpenGLShader::Compute, fileName))
+		{
+			qDebug() << "Error in compute shader:" << prog->objectName() << prog->log();
+			return false;
+		}
+		if (!prog->link())
+		{
+			qDebug() << "Error linking shader program:" << prog->objectName() << prog->log();
+			return false;
+		}
+		return true;
+	}
+}
+
+OcclusionCuller::OcclusionCuller(const QString& shaderPath) : _pyramidProg(new QOpenGLShaderProgram()),
+_cullProg(new QOpenGLShaderProgram()),
+_valid(false),
+_boundsBuffer(0),
+_visibilityBuffer(0),
+_visibilityCapacity(0),
+_depthTexture(0),
+_depthFramebuffer(0),
+_pyramidTexture(0),
+_width(0),
+_height(0),
+_levels(0)
+{
+	initializeOpenGLFunctions();
+	_pyramidProg->setObjectName("_pyramidProg");
+	_cullProg->setObjectName("_cullProg");
+	_valid = buildComputeProgram(_pyramidProg, shaderPath + "hiz_downsample.comp") &&
+		buildComputeProgram(_cullProg, shaderPath + "occlusion_cull.comp");
+
+	glCreateBuffers(1, &_boundsBuffer);
+	glCreateFramebuffers(1, &_depthFramebuffer);
+	reserveVisibility(MIN_VISIBILITY_CAPACITY);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	delete _pyramidProg;
+	delete _cullProg;
+	glDeleteBuffers(1, &_boundsBuffer);
+	glDeleteBuffers(1, &_visibilityBuffer);
+	glDeleteFramebuffers(1, &_depthFramebuffer);
+	if (_depthTexture)
+		glDeleteTextures(1, &_depthTexture);
+	if (_pyramidTexture)
+		glDeleteTextures(1, &_pyramidTexture);
+}
+
+void OcclusionCuller::selectVisible(const IndirectDraws& draws)
+{
+	if (draws.isEmpty())
+		return;
+	uploadBounds(draws);
+	dispatchCull(draws, 0);
+}
+
+void OcclusionCuller::selectDisoccluded(const IndirectDraws& draws, GLuint framebuffer, int width, int height, const QMatrix4x4& viewProjection)
+{
+	if (draws.isEmpty())
+		return;
+	resizePyramid(width, height);
+	buildPyramid(framebuffer);
+
+	_cullProg->bind();
+	_cullProg->setUniformValue("viewProjection", viewProjection);
+	_cullProg->setUniformValue("viewportSize", QVector2D(static_cast<float>(_width), static_cast<float>(_height)));
+	glBindTextureUnit(DEPTH_UNIT, _pyramidTexture);
+	dispatchCull(draws, 1);
+}
+
+void OcclusionCuller::uploadBounds(const IndirectDraws& draws)
+{
+	GLuint idCount = 0;
+	_bounds.clear();
+	for (size_t i = 0; i < draws.size(); i++)
+	{
+		const BoundingBox box = draws.mesh(i)->getBoundingBox();
+		const int id = draws.id(i);
+		_bounds.push_back({ { static_cast<GLfloat>(box.xMin()), static_cast<GLfloat>(box.yMin()), static_cast<GLfloat>(box.zMin()) },
+			id < 0 ? NO_ID : static_cast<GLuint>(id),
+			{ static_cast<GLfloat>(box.xMax()), static_cast<GLfloat>(box.yMax()), static_cast<GLfloat>(box.zMax()) }, 0.0f });
+		if (id >= 0)
+			idCount = std::max(idCount, static_cast<GLuint>(id) + 1);
+	}
+	reserveVisibility(idCount);
+	// Orphaned every frame like the draws themselves
+	glNamedBufferData(_boundsBuffer, _bounds.size() * sizeof(DrawBounds), _bounds.data(), GL_STREAM_DRAW);
+}
+
+void OcclusionCuller::reserveVisibility(GLuint count)
+{
+	if (count <= _visibilityCapacity)
+		return;
+
+	// Entries of new ids start out hidden, the second phase finds them
+	const GLuint capacity = std::max(count, _visibilityCapacity * 2);
+	GLuint buffer = 0;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, capacity * sizeof(GLuint), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	const GLuint zero = 0;
+	glClearNamedBufferData(buffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	if (_visibilityBuffer)
+	{
+		glCopyNamedBufferSubData(_visibilityBuffer, buffer, 0, 0, _visibilityCapacity * sizeof(GLuint));
+		glDeleteBuffers(1, &_visibilityBuffer);
+	}
+	_visibilityBuffer = buffer;
+	_visibilityCapacity = capacity;
+}
+
+void OcclusionCuller::resizePyramid(int width, int height)
+{
+	width = std::max(width, 1);
+	height = std::max(height, 1);
+	if (width == _width && height == _height)
+		return;
+
+	if (_depthTexture)
+		glDeleteTextures(1, &_depthTexture);
+	if (_pyramidTexture)
+		glDeleteTextures(1, &_pyramidTexture);
+	_width = width;
+	_height = height;
+	_levels = static_cast<int>(std::floor(std::log2(std::max(width, height)))) + 1;
+
+	// The widget's framebuffer has a combined depth and stencil buffer
+	glCreateTextures(GL_TEXTURE_2D, 1, &_depthTexture);
+	glTextureStorage2D(_depthTexture, 1, GL_DEPTH24_STENCIL8, width, height);
+	glNamedFramebufferTexture(_depthFramebuffer, GL_DEPTH_STENCIL_ATTACHMENT, _depthTexture, 0);
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &_pyramidTexture);
+	glTextureStorage2D(_pyramidTexture, _levels, GL_R32F, width, height);
+	glTextureParameteri(_pyramidTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTextureParameteri(_pyramidTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTextureParameteri(_pyramidTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(_pyramidTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void OcclusionCuller::buildPyramid(GLuint framebuffer)
+{
+	glBlitNamedFramebuffer(framebuffer, _depthFramebuffer, 0, 0, _width, _height, 0, 0, _width, _height,
+		GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	_pyramidProg->bind();
+	glBindTextureUnit(DEPTH_UNIT, _depthTexture);
+	for (int level = 0; level < _levels; level++)
+	{
+		_pyramidProg->setUniformValue("fromDepthBuffer", level == 0);
+		if (level > 0)
+			glBindImageTexture(0, _pyramidTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, _pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		const int width = std::max(_width >> level, 1);
+		const int height = std::max(_height >> level, 1);
+		glDispatchCompute((width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	_pyramidProg->release();
+}
+
+void OcclusionCuller::dispatchCull(const IndirectDraws& draws, int phase)
+{
+	const GLuint drawCount = static_cast<GLuint>(draws.size());
+	_cullProg->bind();
+	_cullProg->setUniformValue("phase", phase);
+	_cullProg->setUniformValue("drawCount", drawCount);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BOUNDS_BINDING, _boundsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_BINDING, _visibilityBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, draws.commandBuffer());
+	glDispatchCompute((drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	// The commands are read by the multi draws next, the visibility by the following phase
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	_cullProg->release();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QOpenGLFunctions_4_5_Core>
+#include <QMatrix4x4>
+#include <vector>
+
+class QOpenGLShaderProgram;
+class IndirectDraws;
+
+// Two phase hierarchical depth occlusion culling of prepared IndirectDraws,
+// decided on the GPU by setting the instanceCount of their commands. The first
+// phase keeps the meshes that were visible last frame. Once these are drawn
+// their depth is reduced to a pyramid of farthest depths, and the second phase
+// tests every box against it. It keeps the newly visible meshes and records the
+// results as the next frame's visible set. Meshes are tracked by their id in
+// the scene; a stale entry only moves a mesh to the other phase.
+class OcclusionCuller : public QOpenGLFunctions_4_5_Core
+{
+public:
+	explicit OcclusionCuller(const QString& shaderPath); // needs a current context with compute shaders
+	~OcclusionCuller(); // needs the same context current
+
+	bool isValid() const { return _valid; }
+
+	// Keeps the draws of the meshes visible last frame
+	void selectVisible(const IndirectDraws& draws);
+	// Keeps the draws that turn out visible against the depth of the framebuffer drawn so far and
+	// that the first phase left out, viewProjection takes the boxes to clip space
+	void selectDisoccluded(const IndirectDraws& draws, GLuint framebuffer, int width, int height, const QMatrix4x4& viewProjection);
+
+private:
+	// std430 layout of the bounds occlusion_cull.comp reads
+	struct DrawBounds
+	{
+		GLfloat boxMin[3];
+		GLuint id;
+		GLfloat boxMax[3];
+		GLfloat padding;
+	};
+
+	void uploadBounds(const IndirectDraws& draws);
+	void reserveVisibility(GLuint count);
+	void resizePyramid(int width, int height);
+	void buildPyramid(GLuint framebuffer);
+	void dispatchCull(const IndirectDraws& draws, int phase);
+
+	QOpenGLShaderProgram* _pyramidProg;
+	QOpenGLShaderProgram* _cullProg;
+	bool _valid;
+
+	std::vector<DrawBounds> _bounds;
+	GLuint _boundsBuffer;
+	GLuint _visibilityBuffer;
+	GLuint _visibilityCapacity;
+
+	GLuint _depthTexture;     // copy of the framebuffer's depth, same format as blits need
+	GLuint _depthFramebuffer;
+	GLuint _pyramidTexture;
+	int _width;
+	int _height;
+	int _levels;
+};
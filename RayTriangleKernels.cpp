@@ -0,0 +1,598 @@
+#include "RayTriangleKernels.h"
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RTK_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define RTK_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define RTK_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RTK_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace RayTriangleKernels
+{
+	namespace
+	{
+		const float EPSILON = 0.0000001f;                       // same as TriangleMollerTrumbore
+		const float T_NEAR = std::numeric_limits<float>::min(); // same as TriangleBaldwinWeber
+
+		using Kernel = bool (*)(const float* const*, size_t, size_t, const Ray&, Hit&);
+
+		//
+		// Scalar fallback
+		//
+		bool mollerTrumboreScalar(const float* const* c, size_t first, size_t count, const Ray& ray, Hit& hit)
+		{
+			const float* o = ray.orig;
+			const float* d = ray.dir;
+			bool found = false;
+			for (size_t i = first; i < first + count; i++)
+			{
+				const float v0[3] = { c[0][i], c[1][i], c[2][i] };
+				const float e1[3] = { c[3][i], c[4][i], c[5][i] };
+				const float e2[3] = { c[6][i], c[7][i], c[8][i] };
+				const float h[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+				const float a = e1[0] * h[0] + e1[1] * h[1] + e1[2] * h[2];
+				if (a > -EPSILON && a < EPSILON)
+					continue; // This ray is parallel to this triangle.
+				const float f = 1.0f / a;
+				const float s[3] = { o[0] - v0[0], o[1] - v0[1], o[2] - v0[2] };
+				const float u = f * (s[0] * h[0] + s[1] * h[1] + s[2] * h[2]);
+				if (u < 0.0f || u > 1.0f)
+					continue;
+				const float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+				const float v = f * (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]);
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+				const float t = f * (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]);
+				if (t > EPSILON && t < hit.t)
+				{
+					hit = { t, u, v, i };
+					found = true;
+				}
+			}
+			return found;
+		}
+
+		bool baldwinWeberScalar(const float* const* c, size_t first, size_t count, const Ray& ray, Hit& hit)
+		{
+			const float* o = ray.orig;
+			const float* d = ray.dir;
+			bool found = false;
+			for (size_t i = first; i < first + count; i++)
+			{
+				const float transS = c[8][i] * o[0] + c[9][i] * o[1] + c[10][i] * o[2] + c[11][i];
+				const float transD = c[8][i] * d[0] + c[9][i] * d[1] + c[10][i] * d[2];
+				const float t = -transS / transD;
+				if (!(t > T_NEAR && t < hit.t))
+					continue;
+				const float w[3] = { o[0] + t * d[0], o[1] + t * d[1], o[2] + t * d[2] };
+				const float xg = c[0][i] * w[0] + c[1][i] * w[1] + c[2][i] * w[2] + c[3][i];
+				const float yg = c[4][i] * w[0] + c[5][i] * w[1] + c[6][i] * w[2] + c[7][i];
+				if (xg >= 0.0f && yg >= 0.0f && xg + yg < 1.0f)
+				{
+					hit = { t, xg, yg, i };
+					found = true;
+				}
+			}
+			return found;
+		}
+
+#ifdef RTK_X86
+		//
+		// SSE2, 4 triangles per iteration (baseline on x86-64)
+		//
+		bool mollerTrumboreSSE2(const float* const* c, size_t first, size_t count, const Ray& ray, Hit& hit)
+		{
+			const __m128 ox = _mm_set1_ps(ray.orig[0]), oy = _mm_set1_ps(ray.orig[1]), oz = _mm_set1_ps(ray.orig[2]);
+			const __m128 dx = _mm_set1_ps(ray.dir[0]), dy = _mm_set1_ps(ray.dir[1]), dz = _mm_set1_ps(ray.dir[2]);
+			const __m128 eps = _mm_set1_ps(EPSILON), negEps = _mm_set1_ps(-EPSILON);
+			const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+			const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			const size_t end = first + count;
+			bool found = false;
+			for (size_t base = first; base < end; base += 4)
+			{
+				const __m128 v0x = _mm_loadu_ps(c[0] + base), v0y = _mm_loadu_ps(c[1] + base), v0z = _mm_loadu_ps(c[2] + base);
+				const __m128 e1x = _mm_loadu_ps(c[3] + base), e1y = _mm_loadu_ps(c[4] + base), e1z = _mm_loadu_ps(c[5] + base);
+				const __m128 e2x = _mm_loadu_ps(c[6] + base), e2y = _mm_loadu_ps(c[7] + base), e2z = _mm_loadu_ps(c[8] + base);
+
+				const __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+				const __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+				const __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+				const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+				__m128 valid = _mm_or_ps(_mm_cmpge_ps(a, eps), _mm_cmple_ps(a, negEps));
+				valid = _mm_and_ps(valid, _mm_cmplt_ps(lanes, _mm_set1_ps(static_cast<float>(end - base))));
+
+				const __m128 f = _mm_div_ps(one, a);
+				const __m128 sx = _mm_sub_ps(ox, v0x), sy = _mm_sub_ps(oy, v0y), sz = _mm_sub_ps(oz, v0z);
+				const __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+				const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+				const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+				const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+				const __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+				const __m128 t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(t, eps), _mm_cmplt_ps(t, _mm_set1_ps(hit.t))));
+
+				const int mask = _mm_movemask_ps(valid);
+				if (mask)
+				{
+					alignas(16) float ts[4], us[4], vs[4];
+					_mm_store_ps(ts, t);
+					_mm_store_ps(us, u);
+					_mm_store_ps(vs, v);
+					for (int lane = 0; lane < 4; lane++)
+					{
+						if ((mask & (1 << lane)) && ts[lane] < hit.t)
+						{
+							hit = { ts[lane], us[lane], vs[lane], base + lane };
+							found = true;
+						}
+					}
+				}
+			}
+			return found;
+		}
+
+		bool baldwinWeberSSE2(const float* const* c, size_t first, size_t count, const Ray& ray, Hit& hit)
+		{
+			const __m128 ox = _mm_set1_ps(ray.orig[0]), oy = _mm_set1_ps(ray.orig[1]), oz = _mm_set1_ps(ray.orig[2]);
+			const __m128 dx = _mm_set1_ps(ray.dir[0]), dy = _mm_set1_ps(ray.dir[1]), dz = _mm_set1_ps(ray.dir[2]);
+			const __m128 tNear = _mm_set1_ps(T_NEAR);
+			const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+			const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			const size_t end = first + count;
+			bool found = false;
+			for (size_t base = first; base < end; base += 4)
+			{
+				const __m128 m8 = _mm_loadu_ps(c[8] + base), m9 = _mm_loadu_ps(c[9] + base);
+				const __m128 m10 = _mm_loadu_ps(c[10] + base), m11 = _mm_loadu_ps(c[11] + base);
+				const __m128 transS = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m8, ox), _mm_mul_ps(m9, oy)), _mm_add_ps(_mm_mul_ps(m10, oz), m11));
+				const __m128 transD = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m8, dx), _mm_mul_ps(m9, dy)), _mm_mul_ps(m10, dz));
+				const __m128 t = _mm_div_ps(_mm_sub_ps(zero, transS), transD);
+				__m128 valid = _mm_and_ps(_mm_cmpgt_ps(t, tNear), _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+				valid = _mm_and_ps(valid, _mm_cmplt_ps(lanes, _mm_set1_ps(static_cast<float>(end - base))));
+				if (!_mm_movemask_ps(valid))
+					continue;
+
+				const __m128 wx = _mm_add_ps(ox, _mm_mul_ps(t, dx));
+				const __m128 wy = _mm_add_ps(oy, _mm_mul_ps(t, dy));
+				const __m128 wz = _mm_add_ps(oz, _mm_mul_ps(t, dz));
+				const __m128 xg = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(c[0] + base), wx), _mm_mul_ps(_mm_loadu_ps(c[1] + base), wy)),
+					_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(c[2] + base), wz), _mm_loadu_ps(c[3] + base)));
+				const __m128 yg = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(c[4] + base), wx), _mm_mul_ps(_mm_loadu_ps(c[5] + base), wy)),
+					_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(c[6] + base), wz), _mm_loadu_ps(c[7] + base)));
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(xg, zero), _mm_cmpge_ps(yg, zero)));
+				valid = _mm_and_ps(valid, _mm_cmplt_ps(_mm_add_ps(xg, yg), one));
+
+				const int mask = _mm_movemask_ps(valid);
+				if (mask)
+				{
+					alignas(16) float ts[4], us[4], vs[4];
+					_mm_store_ps(ts, t);
+					_mm_store_ps(us, xg);
+					_mm_store_ps(vs, yg);
+					for (int lane = 0; lane < 4; lane++)
+					{
+						if ((mask & (1 << lane)) && ts[lane] < hit.t)
+						{
+							hit = { ts[lane], us[lane], vs[lane], base + lane };
+							found = true;
+						}
+					}
+				}
+			}
+			return found;
+		}
+
+		//
+		// AVX2, 8 triangles per iteration
+		//
+		RTK_TARGET_AVX2 bool mollerTrumboreAVX2(const float* const* c, size_t first, size_t count, const Ray& ray, Hit& hit)
+		{
+			const __m256 ox = _mm256_set1_ps(ray.orig[0]), oy = _mm256_set1_ps(ray.orig[1]), oz = _mm256_set1_ps(ray.orig[2]);
+			const __m256 dx = _mm256_set1_ps(ray.dir[0]), dy = _mm256_set1_ps(ray.dir[1]), dz = _mm256_set1_ps(ray.dir[2]);
+			const __m256 eps = _mm256_set1_ps(EPSILON), negEps = _mm256_set1_ps(-EPSILON);
+			const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+			const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+			const size_t end = first + count;
+			bool found = false;
+			for (size_t base = first; base < end; base += 8)
+			{
+				const __m256 v0x = _mm256_loadu_ps(c[0] + base), v0y = _mm256_loadu_ps(c[1] + base), v0z = _mm256_loadu_ps(c[2] + base);
+				const __m256 e1x = _mm256_loadu_ps(c[3] + base), e1y = _mm256_loadu_ps(c[4] + base), e1z = _mm256_loadu_ps(c[5] + base);
+				const __m256 e2x = _mm256_loadu_ps(c[6] + base), e2y = _mm256_loadu_ps(c[7] + base), e2z = _mm256_loadu_ps(c[8] + base);
+
+				const __m256 hx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+				const __m256 hy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+				const __m256 hz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+				const __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, hx), _mm256_mul_ps(e1y, hy)), _mm256_mul_ps(e1z, hz));
+				__m256 valid = _mm256_or_ps(_mm256_cmp_ps(a, eps, _CMP_GE_OQ), _mm256_cmp_ps(a, negEps, _CMP_LE_OQ));
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(lanes, _mm256_set1_ps(static_cast<float>(end - base)), _CMP_LT_OQ));
+
+				const __m256 f = _mm256_div_ps(one, a);
+				const __m256 sx = _mm256_sub_ps(ox, v0x), sy = _mm256_sub_ps(oy, v0y), sz = _mm256_sub_ps(oz, v0z);
+				const __m256 u = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, hx), _mm256_mul_ps(sy, hy)), _mm256_mul_ps(sz, hz)));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+
+				const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+				const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+				const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+				const __m256 v = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+
+				const __m256 t = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, eps, _CMP_GT_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(hit.t), _CMP_LT_OQ)));
+
+				const int mask = _mm256_movemask_ps(valid);
+				if (mask)
+				{
+					alignas(32) float ts[8], us[8], vs[8];
+					_mm256_store_ps(ts, t);
+					_mm256_store_ps(us, u);
+					_mm256_store_ps(vs, v);
+					for (int lane = 0; lane < 8; lane++)
+					{
+						if ((mask & (1 << lane)) && ts[lane] < hit.t)
+						{
+							hit = { ts[lane], us[lane], vs[lane], base + lane };
+							found = true;
+						}
+					}
+				}
+			}
+			return found;
+		}
+
+		RTK_TARGET_AVX2 bool baldwinWeberAVX2(const float* const* c, size_t first, size_t count, const Ray& ray, Hit& hit)
+		{
+			const __m256 ox = _mm256_set1_ps(ray.orig[0]), oy = _mm256_set1_ps(ray.orig[1]), oz = _mm256_set1_ps(ray.orig[2]);
+			const __m256 dx = _mm256_set1_ps(ray.dir[0]), dy = _mm256_set1_ps(ray.dir[1]), dz = _mm256_set1_ps(ray.dir[2]);
+			const __m256 tNear = _mm256_set1_ps(T_NEAR);
+			const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+			const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+			const size_t end = first + count;
+			bool found = false;
+			for (size_t base = first; base < end; base += 8)
+			{
+				const __m256 m8 = _mm256_loadu_ps(c[8] + base), m9 = _mm256_loadu_ps(c[9] + base);
+				const __m256 m10 = _mm256_loadu_ps(c[10] + base), m11 = _mm256_loadu_ps(c[11] + base);
+				const __m256 transS = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m8, ox), _mm256_mul_ps(m9, oy)), _mm256_add_ps(_mm256_mul_ps(m10, oz), m11));
+				const __m256 transD = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m8, dx), _mm256_mul_ps(m9, dy)), _mm256_mul_ps(m10, dz));
+				const __m256 t = _mm256_div_ps(_mm256_sub_ps(zero, transS), transD);
+				__m256 valid = _mm256_and_ps(_mm256_cmp_ps(t, tNear, _CMP_GT_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(hit.t), _CMP_LT_OQ));
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(lanes, _mm256_set1_ps(static_cast<float>(end - base)), _CMP_LT_OQ));
+				if (!_mm256_movemask_ps(valid))
+					continue;
+
+				const __m256 wx = _mm256_add_ps(ox, _mm256_mul_ps(t, dx));
+				const __m256 wy = _mm256_add_ps(oy, _mm256_mul_ps(t, dy));
+				const __m256 wz = _mm256_add_ps(oz, _mm256_mul_ps(t, dz));
+				const __m256 xg = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(c[0] + base), wx), _mm256_mul_ps(_mm256_loadu_ps(c[1] + base), wy)),
+					_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(c[2] + base), wz), _mm256_loadu_ps(c[3] + base)));
+				const __m256 yg = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(c[4] + base), wx), _mm256_mul_ps(_mm256_loadu_ps(c[5] + base), wy)),
+					_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(c[6] + base), wz), _mm256_loadu_ps(c[7] + base)));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(xg, zero, _CMP_GE_OQ), _mm256_cmp_ps(yg, zero, _CMP_GE_OQ)));
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(xg, yg), one, _CMP_LT_OQ));
+
+				const int mask = _mm256_movemask_ps(valid);
+				if (mask)
+				{
+					alignas(32) float ts[8], us[8], vs[8];
+					_mm256_store_ps(ts, t);
+					_mm256_store_ps(us, xg);
+					_mm256_store_ps(vs, yg);
+					for (int lane = 0; lane < 8; lane++)
+					{
+						if ((mask & (1 << lane)) && ts[lane] < hit.t)
+						{
+							hit = { ts[lane], us[lane], vs[lane], base + lane };
+							found = true;
+						}
+					}
+				}
+			}
+			return found;
+		}
+
+		void cpuid(int leaf, int subLeaf, unsigned int regs[4])
+		{
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuidex(info, leaf, subLeaf);
+			for (int i = 0; i < 4; i++)
+				regs[i] = static_cast<unsigned int>(info[i]);
+#else
+			__cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		}
+
+		unsigned long long xgetbv0()
+		{
+#if defined(_MSC_VER)
+			return _xgetbv(0);
+#else
+			unsigned int eax, edx;
+			__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+		}
+#endif // RTK_X86
+
+#ifdef RTK_NEON
+		//
+		// NEON, 4 triangles per iteration
+		//
+		inline int neonMask(uint32x4_t valid)
+		{
+			alignas(16) uint32_t bits[4];
+			vst1q_u32(bits, valid);
+			return (bits[0] ? 1 : 0) | (bits[1] ? 2 : 0) | (bits[2] ? 4 : 0) | (bits[3] ? 8 : 0);
+		}
+
+		bool mollerTrumboreNEON(const float* const* c, size_t first, size_t count, const Ray& ray, Hit& hit)
+		{
+			const float32x4_t ox = vdupq_n_f32(ray.orig[0]), oy = vdupq_n_f32(ray.orig[1]), oz = vdupq_n_f32(ray.orig[2]);
+			const float32x4_t dx = vdupq_n_f32(ray.dir[0]), dy = vdupq_n_f32(ray.dir[1]), dz = vdupq_n_f32(ray.dir[2]);
+			const float32x4_t eps = vdupq_n_f32(EPSILON), negEps = vdupq_n_f32(-EPSILON);
+			const float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+			const float laneInit[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+			const float32x4_t lanes = vld1q_f32(laneInit);
+			const size_t end = first + count;
+			bool found = false;
+			for (size_t base = first; base < end; base += 4)
+			{
+				const float32x4_t v0x = vld1q_f32(c[0] + base), v0y = vld1q_f32(c[1] + base), v0z = vld1q_f32(c[2] + base);
+				const float32x4_t e1x = vld1q_f32(c[3] + base), e1y = vld1q_f32(c[4] + base), e1z = vld1q_f32(c[5] + base);
+				const float32x4_t e2x = vld1q_f32(c[6] + base), e2y = vld1q_f32(c[7] + base), e2z = vld1q_f32(c[8] + base);
+
+				const float32x4_t hx = vsubq_f32(vmulq_f32(dy, e2z), vmulq_f32(dz, e2y));
+				const float32x4_t hy = vsubq_f32(vmulq_f32(dz, e2x), vmulq_f32(dx, e2z));
+				const float32x4_t hz = vsubq_f32(vmulq_f32(dx, e2y), vmulq_f32(dy, e2x));
+				const float32x4_t a = vaddq_f32(vaddq_f32(vmulq_f32(e1x, hx), vmulq_f32(e1y, hy)), vmulq_f32(e1z, hz));
+				uint32x4_t valid = vorrq_u32(vcgeq_f32(a, eps), vcleq_f32(a, negEps));
+				valid = vandq_u32(valid, vcltq_f32(lanes, vdupq_n_f32(static_cast<float>(end - base))));
+
+				const float32x4_t f = vdivq_f32(one, a);
+				const float32x4_t sx = vsubq_f32(ox, v0x), sy = vsubq_f32(oy, v0y), sz = vsubq_f32(oz, v0z);
+				const float32x4_t u = vmulq_f32(f, vaddq_f32(vaddq_f32(vmulq_f32(sx, hx), vmulq_f32(sy, hy)), vmulq_f32(sz, hz)));
+				valid = vandq_u32(valid, vandq_u32(vcgeq_f32(u, zero), vcleq_f32(u, one)));
+
+				const float32x4_t qx = vsubq_f32(vmulq_f32(sy, e1z), vmulq_f32(sz, e1y));
+				const float32x4_t qy = vsubq_f32(vmulq_f32(sz, e1x), vmulq_f32(sx, e1z));
+				const float32x4_t qz = vsubq_f32(vmulq_f32(sx, e1y), vmulq_f32(sy, e1x));
+				const float32x4_t v = vmulq_f32(f, vaddq_f32(vaddq_f32(vmulq_f32(dx, qx), vmulq_f32(dy, qy)), vmulq_f32(dz, qz)));
+				valid = vandq_u32(valid, vandq_u32(vcgeq_f32(v, zero), vcleq_f32(vaddq_f32(u, v), one)));
+
+				const float32x4_t t = vmulq_f32(f, vaddq_f32(vaddq_f32(vmulq_f32(e2x, qx), vmulq_f32(e2y, qy)), vmulq_f32(e2z, qz)));
+				valid = vandq_u32(valid, vandq_u32(vcgtq_f32(t, eps), vcltq_f32(t, vdupq_n_f32(hit.t))));
+
+				const int mask = neonMask(valid);
+				if (mask)
+				{
+					alignas(16) float ts[4], us[4], vs[4];
+					vst1q_f32(ts, t);
+					vst1q_f32(us, u);
+					vst1q_f32(vs, v);
+					for (int lane = 0; lane < 4; lane++)
+					{
+						if ((mask & (1 << lane)) && ts[lane] < hit.t)
+						{
+							hit = { ts[lane], us[lane], vs[lane], base + lane };
+							found = true;
+						}
+					}
+				}
+			}
+			return found;
+		}
+
+		bool baldwinWeberNEON(const float* const* c, size_t first, size_t count, const Ray& ray, Hit& hit)
+		{
+			const float32x4_t ox = vdupq_n_f32(ray.orig[0]), oy = vdupq_n_f32(ray.orig[1]), oz = vdupq_n_f32(ray.orig[2]);
+			const float32x4_t dx = vdupq_n_f32(ray.dir[0]), dy = vdupq_n_f32(ray.dir[1]), dz = vdupq_n_f32(ray.dir[2]);
+			const float32x4_t tNear = vdupq_n_f32(T_NEAR);
+			const float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+			const float laneInit[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+			const float32x4_t lanes = vld1q_f32(laneInit);
+			const size_t end = first + count;
+			bool found = false;
+			for (size_t base = first; base < end; base += 4)
+			{
+				const float32x4_t m8 = vld1q_f32(c[8] + base), m9 = vld1q_f32(c[9] + base);
+				const float32x4_t m10 = vld1q_f32(c[10] + base), m11 = vld1q_f32(c[11] + base);
+				const float32x4_t transS = vaddq_f32(vaddq_f32(vmulq_f32(m8, ox), vmulq_f32(m9, oy)), vaddq_f32(vmulq_f32(m10, oz), m11));
+				const float32x4_t transD = vaddq_f32(vaddq_f32(vmulq_f32(m8, dx), vmulq_f32(m9, dy)), vmulq_f32(m10, dz));
+				const float32x4_t t = vdivq_f32(vnegq_f32(transS), transD);
+				uint32x4_t valid = vandq_u32(vcgtq_f32(t, tNear), vcltq_f32(t, vdupq_n_f32(hit.t)));
+				valid = vandq_u32(valid, vcltq_f32(lanes, vdupq_n_f32(static_cast<float>(end - base))));
+				if (!neonMask(valid))
+					continue;
+
+				const float32x4_t wx = vaddq_f32(ox, vmulq_f32(t, dx));
+				const float32x4_t wy = vaddq_f32(oy, vmulq_f32(t, dy));
+				const float32x4_t wz = vaddq_f32(oz, vmulq_f32(t, dz));
+				const float32x4_t xg = vaddq_f32(vaddq_f32(vmulq_f32(vld1q_f32(c[0] + base), wx), vmulq_f32(vld1q_f32(c[1] + base), wy)),
+					vaddq_f32(vmulq_f32(vld1q_f32(c[2] + base), wz), vld1q_f32(c[3] + base)));
+				const float32x4_t yg = vaddq_f32(vaddq_f32(vmulq_f32(vld1q_f32(c[4] + base), wx), vmulq_f32(vld1q_f32(c[5] + base), wy)),
+					vaddq_f32(vmulq_f32(vld1q_f32(c[6] + base), wz), vld1q_f32(c[7] + base)));
+				valid = vandq_u32(valid, vandq_u32(vcgeq_f32(xg, zero), vcgeq_f32(yg, zero)));
+				valid = vandq_u32(valid, vcltq_f32(vaddq_f32(xg, yg), one));
+
+				const int mask = neonMask(valid);
+				if (mask)
+				{
+					alignas(16) float ts[4], us[4], vs[4];
+					vst1q_f32(ts, t);
+					vst1q_f32(us, xg);
+					vst1q_f32(vs, yg);
+					for (int lane = 0; lane < 4; lane++)
+					{
+						if ((mask & (1 << lane)) && ts[lane] < hit.t)
+						{
+							hit = { ts[lane], us[lane], vs[lane], base + lane };
+							found = true;
+						}
+					}
+				}
+			}
+			return found;
+		}
+#endif // RTK_NEON
+
+		InstructionSet detectInstructionSet()
+		{
+#if defined(RTK_X86)
+			unsigned int regs[4];
+			cpuid(0, 0, regs);
+			const unsigned int maxLeaf = regs[0];
+			cpuid(1, 0, regs);
+			const bool osxsave = (regs[2] & (1u << 27)) != 0;
+			const bool avx = (regs[2] & (1u << 28)) != 0;
+			// The OS must save the YMM registers on context switches
+			if (osxsave && avx && (xgetbv0() & 0x6) == 0x6 && maxLeaf >= 7)
+			{
+				cpuid(7, 0, regs);
+				if (regs[1] & (1u << 5))
+					return InstructionSet::AVX2;
+			}
+			return InstructionSet::SSE2;
+#elif defined(RTK_NEON)
+			return InstructionSet::NEON;
+#else
+			return InstructionSet::Scalar;
+#endif
+		}
+
+		std::atomic<int>& activeSet()
+		{
+			static std::atomic<int> active(static_cast<int>(supportedInstructionSet()));
+			return active;
+		}
+	}
+
+	InstructionSet supportedInstructionSet()
+	{
+		static const InstructionSet supported = detectInstructionSet();
+		return supported;
+	}
+
+	InstructionSet activeInstructionSet()
+	{
+		return static_cast<InstructionSet>(activeSet().load(std::memory_order_relaxed));
+	}
+
+	void setInstructionSet(InstructionSet isa)
+	{
+		const InstructionSet supported = supportedInstructionSet();
+		bool available = isa == InstructionSet::Scalar || isa == supported;
+		if (supported == InstructionSet::AVX2 && isa == InstructionSet::SSE2)
+			available = true;
+		activeSet().store(static_cast<int>(available ? isa : supported), std::memory_order_relaxed);
+	}
+
+	const char* instructionSetName(InstructionSet isa)
+	{
+		switch (isa)
+		{
+		case InstructionSet::SSE2:
+			return "SSE2";
+		case InstructionSet::AVX2:
+			return "AVX2";
+		case InstructionSet::NEON:
+			return "NEON";
+		default:
+			return "Scalar";
+		}
+	}
+
+	bool baldwinWeberTransformation(const float* v0, const float* edge1, const float* edge2, float* coeffs)
+	{
+		for (int i = 0; i < BALDWIN_WEBER_COMPONENTS; i++)
+			coeffs[i] = 0.0f;
+
+		const float v1[3] = { v0[0] + edge1[0], v0[1] + edge1[1], v0[2] + edge1[2] };
+		const float v2[3] = { v0[0] + edge2[0], v0[1] + edge2[1], v0[2] + edge2[2] };
+		const float n[3] = {
+			edge1[1] * edge2[2] - edge1[2] * edge2[1],
+			edge1[2] * edge2[0] - edge1[0] * edge2[2],
+			edge1[0] * edge2[1] - edge1[1] * edge2[0]
+		};
+		const float num = v0[0] * n[0] + v0[1] * n[1] + v0[2] * n[2];
+
+		// Pick the dominant normal axis (the fixed column) and its two projection axes
+		int fixed, p, q;
+		if (std::fabs(n[0]) > std::fabs(n[1]) && std::fabs(n[0]) > std::fabs(n[2]))
+		{
+			fixed = 0; p = 1; q = 2;
+		}
+		else if (std::fabs(n[1]) > std::fabs(n[2]))
+		{
+			fixed = 1; p = 2; q = 0;
+		}
+		else if (std::fabs(n[2]) > 0.0f)
+		{
+			fixed = 2; p = 0; q = 1;
+		}
+		else
+		{
+			return false;
+		}
+
+		const float x1 = v1[p] * v0[q] - v1[q] * v0[p];
+		const float x2 = v2[p] * v0[q] - v2[q] * v0[p];
+		const float inv = 1.0f / n[fixed];
+
+		// Row 0: first barycentric coordinate
+		coeffs[p] = edge2[q] * inv;
+		coeffs[q] = -edge2[p] * inv;
+		coeffs[3] = x2 * inv;
+		// Row 1: second barycentric coordinate
+		coeffs[4 + p] = -edge1[q] * inv;
+		coeffs[4 + q] = edge1[p] * inv;
+		coeffs[7] = -x1 * inv;
+		// Row 2: signed distance to the triangle plane
+		coeffs[8 + fixed] = 1.0f;
+		coeffs[8 + p] = n[p] * inv;
+		coeffs[8 + q] = n[q] * inv;
+		coeffs[11] = -num * inv;
+		return true;
+	}
+
+	bool intersect(Method method, const float* const* components, size_t first, size_t count, const Ray& ray, Hit& hit)
+	{
+		Kernel kernel = method == Method::BaldwinWeber ? baldwinWeberScalar : mollerTrumboreScalar;
+		switch (activeInstructionSet())
+		{
+#if defined(RTK_X86)
+		case InstructionSet::AVX2:
+			kernel = method == Method::BaldwinWeber ? baldwinWeberAVX2 : mollerTrumboreAVX2;
+			break;
+		case InstructionSet::SSE2:
+			kernel = method == Method::BaldwinWeber ? baldwinWeberSSE2 : mollerTrumboreSSE2;
+			break;
+#elif defined(RTK_NEON)
+		case InstructionSet::NEON:
+			kernel = method == Method::BaldwinWeber ? baldwinWeberNEON : mollerTrumboreNEON;
+			break;
+#endif
+		default:
+			break;
+		}
+		return kernel(components, first, count, ray, hit);
+	}
+}
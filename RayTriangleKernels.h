@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+
+// Vectorized ray-triangle intersection kernels used by TriangleStore to test a
+// whole BVH leaf at once. Triangles are read from structure-of-arrays data:
+// one float array per component, all indexed by the same triangle record.
+//
+// Möller–Trumbore reads 9 arrays: v0.xyz, edge1.xyz, edge2.xyz
+// Baldwin–Weber reads 12 arrays: the 3x4 global-to-barycentric transformation
+// in row order, with the fixed column expanded so the kernel does not branch.
+//
+// The widest instruction set supported by the running CPU is picked once at
+// runtime (CPUID on x86, NEON is always present on ARM64), with a scalar
+// fallback for everything else.
+namespace RayTriangleKernels
+{
+	enum class InstructionSet { Scalar, SSE2, AVX2, NEON };
+	enum class Method { MollerTrumbore, BaldwinWeber };
+
+	constexpr int MOLLER_TRUMBORE_COMPONENTS = 9;
+	constexpr int BALDWIN_WEBER_COMPONENTS = 12;
+	constexpr int MAX_PACKET_WIDTH = 8; // arrays must be padded by this many floats
+
+	struct Ray
+	{
+		float orig[3];
+		float dir[3];
+	};
+
+	// Closest hit so far; kernels only replace it with nearer hits
+	struct Hit
+	{
+		float t;
+		float u;
+		float v;
+		size_t index;
+	};
+
+	InstructionSet supportedInstructionSet();
+	InstructionSet activeInstructionSet();
+	void setInstructionSet(InstructionSet isa); // clamped to what the CPU supports
+	const char* instructionSetName(InstructionSet isa);
+
+	// Baldwin–Weber coefficients of one triangle given v0 and its two edges.
+	// Returns false for degenerate triangles, whose coefficients never hit.
+	bool baldwinWeberTransformation(const float* v0, const float* edge1, const float* edge2, float* coeffs);
+
+	// Tests triangles [first, first + count) of the component arrays
+	bool intersect(Method method, const float* const* components, size_t first, size_t count, const Ray& ray, Hit& hit);
+}
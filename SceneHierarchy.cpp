@@ -0,0 +1,395 @@
+#include "SceneHierarchy.h"
+
+#include <QThreadPool>
+#include <QSemaphore>
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	constexpr unsigned int MAX_LEAF_SIZE = 4;
+	constexpr unsigned int NO_NODE = std::numeric_limits<unsigned int>::max();
+	constexpr int TRAVERSAL_STACK_SIZE = 64;
+	constexpr float NO_HIT = std::numeric_limits<float>::max();
+	constexpr size_t PARALLEL_PICK_TRIANGLES = 1000000; // below this picking stays on the calling thread
+
+	// Slab test, returns the entry distance or NO_HIT
+	inline float intersectsBox(const float* boundsMin, const float* boundsMax, const float* orig, const float* invDir, float tBest)
+	{
+		float tmin = -NO_HIT, tmax = NO_HIT;
+		for (int a = 0; a < 3; a++)
+		{
+			float t1 = (boundsMin[a] - orig[a]) * invDir[a];
+			float t2 = (boundsMax[a] - orig[a]) * invDir[a];
+			tmin = std::max(tmin, std::min(t1, t2));
+			tmax = std::min(tmax, std::max(t1, t2));
+		}
+		if (tmax >= tmin && tmin < tBest && tmax > 0.0f)
+			return tmin;
+		return NO_HIT;
+	}
+}
+
+SceneHierarchy::SceneHierarchy() : _dirty(false)
+{
+}
+
+void SceneHierarchy::sync(const std::vector<int>& ids, const std::vector<TriangleMesh*>& meshStore)
+{
+	std::vector<char> seen(_instances.size(), 0);
+	for (int id : ids)
+	{
+		if (id < 0 || static_cast<size_t>(id) >= meshStore.size() || !meshStore[id])
+			continue;
+		const TriangleMesh* mesh = meshStore[id];
+		auto it = _instanceIndex.find(id);
+		if (it == _instanceIndex.end())
+		{
+			insert(id, mesh);
+			seen.push_back(1);
+			continue;
+		}
+
+		const size_t index = it->second;
+		Instance& instance = _instances[index];
+		seen[index] = 1;
+		if (instance.mesh != mesh)
+		{
+			// The id now refers to another mesh
+			instance.mesh = mesh;
+			updateInstanceBounds(instance);
+			_dirty = true;
+		}
+		else if (instance.revision != mesh->pickingRevision())
+		{
+			updateInstanceBounds(instance);
+			refit(index);
+		}
+	}
+
+	std::vector<int> removed;
+	for (size_t i = 0; i < seen.size(); i++)
+	{
+		if (!seen[i])
+			removed.push_back(_instances[i].id);
+	}
+	for (int id : removed)
+		remove(id);
+}
+
+void SceneHierarchy::update(int id)
+{
+	auto it = _instanceIndex.find(id);
+	if (it == _instanceIndex.end())
+		return;
+	updateInstanceBounds(_instances[it->second]);
+	refit(it->second);
+}
+
+void SceneHierarchy::clear()
+{
+	_instances.clear();
+	_instanceIndex.clear();
+	_nodes.clear();
+	_parents.clear();
+	_order.clear();
+	_leafOf.clear();
+	_dirty = false;
+}
+
+void SceneHierarchy::insert(int id, const TriangleMesh* mesh)
+{
+	Instance instance;
+	instance.id = id;
+	instance.mesh = mesh;
+	updateInstanceBounds(instance);
+	_instanceIndex[id] = _instances.size();
+	_instances.push_back(instance);
+	_dirty = true;
+}
+
+void SceneHierarchy::remove(int id)
+{
+	auto it = _instanceIndex.find(id);
+	if (it == _instanceIndex.end())
+		return;
+
+	// Move the last instance into the freed slot
+	const size_t index = it->second;
+	_instanceIndex.erase(it);
+	if (index != _instances.size() - 1)
+	{
+		_instances[index] = _instances.back();
+		_instanceIndex[_instances[index].id] = index;
+	}
+	_instances.pop_back();
+	_dirty = true;
+}
+
+void SceneHierarchy::updateInstanceBounds(Instance& instance)
+{
+	instance.revision = instance.mesh->pickingRevision();
+	instance.valid = instance.mesh->pickingBounds(instance.boundsMin, instance.boundsMax);
+}
+
+void SceneHierarchy::refit(size_t instanceIndex)
+{
+	if (_dirty)
+		return; // rebuilt on the next query anyway
+
+	const Instance& instance = _instances[instanceIndex];
+	unsigned int nodeIdx = instanceIndex < _leafOf.size() ? _leafOf[instanceIndex] : NO_NODE;
+	if ((nodeIdx == NO_NODE) == instance.valid)
+	{
+		// The mesh gained or lost its triangles
+		_dirty = true;
+		return;
+	}
+	if (nodeIdx == NO_NODE)
+		return;
+
+	// Walk up to the root, recomputing every bound on the way
+	while (true)
+	{
+		Node& node = _nodes[nodeIdx];
+		for (int a = 0; a < 3; a++)
+		{
+			node.boundsMin[a] = NO_HIT;
+			node.boundsMax[a] = -NO_HIT;
+		}
+		if (node.count)
+		{
+			for (unsigned int i = 0; i < node.count; i++)
+				growNode(node, _instances[_order[node.leftFirst + i]]);
+		}
+		else
+		{
+			for (unsigned int child = node.leftFirst; child <= node.leftFirst + 1; child++)
+			{
+				for (int a = 0; a < 3; a++)
+				{
+					node.boundsMin[a] = std::min(node.boundsMin[a], _nodes[child].boundsMin[a]);
+					node.boundsMax[a] = std::max(node.boundsMax[a], _nodes[child].boundsMax[a]);
+				}
+			}
+		}
+		if (_parents[nodeIdx] == nodeIdx)
+			break;
+		nodeIdx = _parents[nodeIdx];
+	}
+}
+
+void SceneHierarchy::growNode(Node& node, const Instance& instance) const
+{
+	for (int a = 0; a < 3; a++)
+	{
+		node.boundsMin[a] = std::min(node.boundsMin[a], instance.boundsMin[a]);
+		node.boundsMax[a] = std::max(node.boundsMax[a], instance.boundsMax[a]);
+	}
+}
+
+void SceneHierarchy::build()
+{
+	_dirty = false;
+	_nodes.clear();
+	_parents.clear();
+	_order.clear();
+	_leafOf.assign(_instances.size(), NO_NODE);
+
+	for (size_t i = 0; i < _instances.size(); i++)
+	{
+		if (_instances[i].valid)
+			_order.push_back(static_cast<unsigned int>(i));
+	}
+	if (_order.empty())
+		return;
+
+	auto centroid = [this](unsigned int instanceIndex, int axis)
+	{
+		const Instance& instance = _instances[instanceIndex];
+		return instance.boundsMin[axis] + instance.boundsMax[axis];
+	};
+
+	_nodes.reserve(2 * _order.size() - 1);
+	_parents.reserve(2 * _order.size() - 1);
+	Node root;
+	root.leftFirst = 0;
+	root.count = static_cast<unsigned int>(_order.size());
+	_nodes.push_back(root);
+	_parents.push_back(0);
+
+	std::vector<unsigned int> buildStack;
+	buildStack.push_back(0);
+	while (!buildStack.empty())
+	{
+		const unsigned int nodeIdx = buildStack.back();
+		buildStack.pop_back();
+
+		Node& node = _nodes[nodeIdx];
+		float centroidMin[3] = { NO_HIT, NO_HIT, NO_HIT };
+		float centroidMax[3] = { -NO_HIT, -NO_HIT, -NO_HIT };
+		for (int a = 0; a < 3; a++)
+		{
+			node.boundsMin[a] = NO_HIT;
+			node.boundsMax[a] = -NO_HIT;
+		}
+		for (unsigned int i = 0; i < node.count; i++)
+		{
+			const unsigned int instanceIndex = _order[node.leftFirst + i];
+			growNode(node, _instances[instanceIndex]);
+			for (int a = 0; a < 3; a++)
+			{
+				centroidMin[a] = std::min(centroidMin[a], centroid(instanceIndex, a));
+				centroidMax[a] = std::max(centroidMax[a], centroid(instanceIndex, a));
+			}
+		}
+
+		if (node.count <= MAX_LEAF_SIZE)
+		{
+			for (unsigned int i = 0; i < node.count; i++)
+				_leafOf[_order[node.leftFirst + i]] = nodeIdx;
+			continue;
+		}
+
+		// Median split along the widest centroid extent keeps the tree balanced
+		int axis = 0;
+		for (int a = 1; a < 3; a++)
+		{
+			if (centroidMax[a] - centroidMin[a] > centroidMax[axis] - centroidMin[axis])
+				axis = a;
+		}
+		const unsigned int first = node.leftFirst;
+		const unsigned int leftCount = node.count / 2;
+		std::nth_element(_order.begin() + first, _order.begin() + first + leftCount, _order.begin() + first + node.count,
+			[&centroid, axis](unsigned int a, unsigned int b) { return centroid(a, axis) < centroid(b, axis); });
+
+		const unsigned int leftIdx = static_cast<unsigned int>(_nodes.size());
+		Node left, right;
+		left.leftFirst = first;
+		left.count = leftCount;
+		right.leftFirst = first + leftCount;
+		right.count = node.count - leftCount;
+
+		node.leftFirst = leftIdx;
+		node.count = 0;
+
+		// Storage was reserved up front, so node stays valid across these
+		_nodes.push_back(left);
+		_nodes.push_back(right);
+		_parents.push_back(nodeIdx);
+		_parents.push_back(nodeIdx);
+		buildStack.push_back(leftIdx);
+		buildStack.push_back(leftIdx + 1);
+	}
+
+	// Interior bounds from the children, deepest nodes come last
+	for (size_t i = _nodes.size(); i-- > 0;)
+	{
+		Node& node = _nodes[i];
+		if (node.count)
+			continue;
+		for (int a = 0; a < 3; a++)
+		{
+			node.boundsMin[a] = std::min(_nodes[node.leftFirst].boundsMin[a], _nodes[node.leftFirst + 1].boundsMin[a]);
+			node.boundsMax[a] = std::max(_nodes[node.leftFirst].boundsMax[a], _nodes[node.leftFirst + 1].boundsMax[a]);
+		}
+	}
+}
+
+int SceneHierarchy::nearestHit(const QVector3D& rayPos, const QVector3D& rayDir, TriangleMesh::RayHit& outHit)
+{
+	if (_dirty)
+		build();
+	if (_nodes.empty())
+		return -1;
+
+	const float orig[3] = { rayPos.x(), rayPos.y(), rayPos.z() };
+	float invDir[3];
+	for (int a = 0; a < 3; a++)
+		invDir[a] = rayDir[a] != 0.0f ? 1.0f / rayDir[a] : 1e30f;
+
+	// Instances whose bounds are crossed by the ray, with their entry distance
+	std::vector<std::pair<float, unsigned int>> candidates;
+	size_t candidateTriangles = 0;
+	unsigned int stack[TRAVERSAL_STACK_SIZE];
+	int stackPtr = 0;
+	stack[stackPtr++] = 0;
+	while (stackPtr > 0)
+	{
+		const Node& node = _nodes[stack[--stackPtr]];
+		if (intersectsBox(node.boundsMin, node.boundsMax, orig, invDir, NO_HIT) == NO_HIT)
+			continue;
+		if (node.count == 0)
+		{
+			stack[stackPtr++] = node.leftFirst;
+			stack[stackPtr++] = node.leftFirst + 1;
+			continue;
+		}
+		for (unsigned int i = 0; i < node.count; i++)
+		{
+			const unsigned int instanceIndex = _order[node.leftFirst + i];
+			const Instance& instance = _instances[instanceIndex];
+			float entry = intersectsBox(instance.boundsMin, instance.boundsMax, orig, invDir, NO_HIT);
+			if (entry == NO_HIT)
+				continue;
+			candidates.push_back({ entry, instanceIndex });
+			candidateTriangles += instance.mesh->triangleCount();
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	float tBest = NO_HIT;
+	int hitId = -1;
+	QThreadPool* pool = QThreadPool::globalInstance();
+	const int taskCount = std::min(pool->maxThreadCount(), static_cast<int>(candidates.size()));
+	if (taskCount > 1 && candidateTriangles >= PARALLEL_PICK_TRIANGLES)
+	{
+		// Query the meshes in slices on the pool, the calling thread takes the first slice
+		std::vector<TriangleMesh::RayHit> hits(candidates.size());
+		std::vector<char> hitFound(candidates.size(), 0);
+		auto pickSlice = [&](int task)
+		{
+			for (size_t c = task; c < candidates.size(); c += taskCount)
+				hitFound[c] = _instances[candidates[c].second].mesh->nearestHit(rayPos, rayDir, hits[c]);
+		};
+		QSemaphore done;
+		for (int task = 1; task < taskCount; task++)
+		{
+			pool->start([&pickSlice, &done, task]()
+				{
+					pickSlice(task);
+					done.release();
+				});
+		}
+		pickSlice(0);
+		done.acquire(taskCount - 1);
+
+		for (size_t c = 0; c < candidates.size(); c++)
+		{
+			if (hitFound[c] && hits[c].t < tBest)
+			{
+				tBest = hits[c].t;
+				hitId = _instances[candidates[c].second].id;
+				outHit = hits[c];
+			}
+		}
+		return hitId;
+	}
+
+	// Front to back, stops once the next mesh starts behind the closest hit
+	for (const auto& candidate : candidates)
+	{
+		if (candidate.first >= tBest)
+			break;
+		const Instance& instance = _instances[candidate.second];
+		TriangleMesh::RayHit hit;
+		if (instance.mesh->nearestHit(rayPos, rayDir, hit) && hit.t < tBest)
+		{
+			tBest = hit.t;
+			hitId = instance.id;
+			outHit = hit;
+		}
+	}
+	return hitId;
+}
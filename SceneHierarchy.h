@@ -0,0 +1,63 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <QVector3D>
+
+#include "TriangleMesh.h"
+
+// Top level acceleration structure over the pickable meshes of a scene. Every
+// instance is a mesh id with the world space bounds of the mesh's own picking
+// hierarchy (the bottom level); the mesh maps world rays into the space of its
+// triangles itself. Adding or removing instances marks the tree for a rebuild on
+// the next query, changed instance bounds are refitted up to the root.
+class SceneHierarchy
+{
+public:
+	SceneHierarchy();
+
+	// Matches the instances to the given mesh ids; new, removed and rebuilt meshes are detected
+	void sync(const std::vector<int>& ids, const std::vector<TriangleMesh*>& meshStore);
+	void update(int id); // refits the instance after its mesh moved
+	void clear();
+
+	size_t size() const { return _instances.size(); }
+
+	// Closest mesh hit by the ray, -1 when nothing is hit
+	int nearestHit(const QVector3D& rayPos, const QVector3D& rayDir, TriangleMesh::RayHit& outHit);
+
+private:
+	struct Instance
+	{
+		int id;
+		const TriangleMesh* mesh;
+		unsigned int revision; // mesh picking revision the bounds were taken from
+		bool valid;            // false for meshes without triangles
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	struct Node
+	{
+		float boundsMin[3];
+		unsigned int leftFirst; // left child index for interior nodes, first entry of _order for leaves
+		float boundsMax[3];
+		unsigned int count;     // 0 for interior nodes
+	};
+
+	void insert(int id, const TriangleMesh* mesh);
+	void remove(int id);
+	void updateInstanceBounds(Instance& instance);
+	void refit(size_t instanceIndex);
+	void build();
+	void growNode(Node& node, const Instance& instance) const;
+
+	std::vector<Instance> _instances;
+	std::unordered_map<int, size_t> _instanceIndex; // mesh id to _instances index
+
+	std::vector<Node> _nodes;
+	std::vector<unsigned int> _parents;  // parent node of every node, root points to itself
+	std::vector<unsigned int> _order;    // instance indices in leaf order
+	std::vector<unsigned int> _leafOf;   // leaf node of every instance
+	bool _dirty;
+};
@@ -0,0 +1,69 @@
+#include "ShaderVariants.h"
+
+#include <QOpenGLShaderProgram>
+#include <QDebug>
+
+#include <set>
+
+ShaderVariants::ShaderVariants(const QString& name, Builder builder) : _name(name),
+_builder(builder)
+{
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	// Failed variants share the all features program, delete each once
+	std::set<QOpenGLShaderProgram*> programs;
+	for (const auto& variant : _programs)
+		programs.insert(variant.second);
+	for (QOpenGLShaderProgram* prog : programs)
+		delete prog;
+}
+
+QOpenGLShaderProgram* ShaderVariants::program(Features features)
+{
+	auto it = _programs.find(features);
+	if (it != _programs.end())
+		return it->second;
+
+	QOpenGLShaderProgram* prog = new QOpenGLShaderProgram();
+	prog->setObjectName(QString("%1[%2]").arg(_name).arg(defines(features).join(' ')));
+	// The builder has logged the errors, a broken all features program is kept like any other shader's
+	if (!_builder(prog, features, defines(features)) && features != ALL_FEATURES)
+	{
+		delete prog;
+		if (features & (MULTI_DRAW | MULTI_VIEW))
+		{
+			// Other variants don't read the per draw or per view state, the caller draws another way instead
+			qDebug() << "No" << (features & MULTI_DRAW ? "multi draw" : "multi view") << "build of" << _name << "variant" << defines(features);
+			prog = nullptr;
+		}
+		else
+		{
+			qDebug() << "Falling back to all features for" << _name << "variant" << defines(features);
+			prog = program(ALL_FEATURES);
+		}
+	}
+	_programs[features] = prog;
+	return prog;
+}
+
+QStringList ShaderVariants::defines(Features features)
+{
+	QStringList defines;
+	if (features & WIRESHADED)
+		defines << "WIRESHADED";
+	if (features & PBR_LIGHTING)
+		defines << "PBR_LIGHTING";
+	if (features & TEXTURE_MAPS)
+		defines << "TEXTURE_MAPS";
+	if (features & SHADOWS)
+		defines << "SHADOWS";
+	if (features & ENVIRONMENT_MAP)
+		defines << "ENVIRONMENT_MAP";
+	if (features & MULTI_DRAW)
+		defines << "MULTI_DRAW";
+	if (features & MULTI_VIEW)
+		defines << "MULTI_VIEW";
+	return defines;
+}
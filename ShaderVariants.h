@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QStringList>
+#include <functional>
+#include <map>
+
+class QOpenGLShaderProgram;
+
+// Specialized builds of an uber-shader. Each feature it branches on at runtime
+// is a #define, a variant is compiled with only the features its draws need
+// the first time they ask for it. Features left out are constants the shader
+// compiler removes along with their code.
+class ShaderVariants
+{
+public:
+	enum Feature : unsigned int
+	{
+		WIRESHADED      = 1 << 0, // edge overlay, needs the geometry stage
+		PBR_LIGHTING    = 1 << 1,
+		TEXTURE_MAPS    = 1 << 2, // any material map, texUnit included
+		SHADOWS         = 1 << 3,
+		ENVIRONMENT_MAP = 1 << 4,
+		ALL_FEATURES    = (1 << 5) - 1,
+		// Not shading features: per draw state from the DrawUniforms buffer, IndirectDraws,
+		// and an instance per view of the four view layout, each in its own viewport
+		MULTI_DRAW      = 1 << 5,
+		MULTI_VIEW      = 1 << 6
+	};
+	typedef unsigned int Features;
+
+	// Adds the stages of a variant to the program and links it, the defines go into every stage
+	typedef std::function<bool(QOpenGLShaderProgram* prog, Features features, const QStringList& defines)> Builder;
+
+	ShaderVariants(const QString& name, Builder builder);
+	~ShaderVariants(); // needs the programs' context current
+
+	// The program with the features, the all features variant if it fails to build.
+	// A failed MULTI_DRAW or MULTI_VIEW variant has no fallback and is nullptr.
+	QOpenGLShaderProgram* program(Features features);
+
+	static QStringList defines(Features features);
+
+private:
+	QString _name;
+	Builder _builder;
+	std::map<Features, QOpenGLShaderProgram*> _programs; // failed variants map to the all features one or nullptr
+};
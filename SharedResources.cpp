@@ -0,0 +1,83 @@
+#include "SharedResources.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+namespace
+{
+	std::map<QOpenGLContextGroup*, SharedResources*>& groupResources()
+	{
+		static std::map<QOpenGLContextGroup*, SharedResources*> resources;
+		return resources;
+	}
+}
+
+SharedResources* SharedResources::forContext(QOpenGLContext* context)
+{
+	if (!context)
+		return nullptr;
+
+	QOpenGLContextGroup* group = context->shareGroup();
+	auto& resources = groupResources();
+	auto it = resources.find(group);
+	if (it != resources.end())
+		return it->second;
+
+	SharedResources* shared = new SharedResources();
+	resources[group] = shared;
+	// The textures live as long as any context of the group, forget them with the last one
+	QObject::connect(group, &QObject::destroyed, [group]()
+		{
+			auto& resources = groupResources();
+			auto it = resources.find(group);
+			if (it != resources.end())
+			{
+				delete it->second;
+				resources.erase(it);
+			}
+		});
+	return shared;
+}
+
+SharedResources* SharedResources::current()
+{
+	return forContext(QOpenGLContext::currentContext());
+}
+
+unsigned int SharedResources::acquireTexture(const QString& key)
+{
+	auto found = _textureByKey.find(key);
+	if (found == _textureByKey.end())
+		return 0;
+	_entries[found->second].references++;
+	return found->second;
+}
+
+void SharedResources::insertTexture(const QString& key, unsigned int texture)
+{
+	if (texture == 0 || _textureByKey.count(key))
+		return;
+	_textureByKey[key] = texture;
+	_entries[texture] = { key, 1 };
+	// Other contexts of the group only see what this one made once its commands are flushed
+	if (QOpenGLContext* context = QOpenGLContext::currentContext())
+		context->functions()->glFlush();
+}
+
+void SharedResources::releaseTexture(unsigned int texture)
+{
+	if (texture == 0)
+		return;
+
+	auto it = _entries.find(texture);
+	if (it != _entries.end())
+	{
+		if (--it->second.references > 0)
+			return;
+		_textureByKey.erase(it->second.key);
+		_entries.erase(it);
+	}
+	// Without a current context it lives until the group goes
+	if (QOpenGLContext* context = QOpenGLContext::currentContext())
+		context->functions()->glDeleteTextures(1, &texture);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QString>
+#include <map>
+#include <unordered_map>
+
+class QOpenGLContext;
+class QOpenGLContextGroup;
+
+// Textures every window of a context share group can use, keyed by what they
+// were made from: the environment cubemap and the maps derived from it, the
+// BRDF lookup table and the text glyphs. The first window to need one makes
+// it and inserts it, the others acquire it instead of making their own. Each
+// user holds a reference and the texture is deleted with the last one.
+class SharedResources
+{
+public:
+	static SharedResources* forContext(QOpenGLContext* context);
+	static SharedResources* current(); // nullptr without a current context
+
+	// Referenced texture of the key, 0 when no window has made it yet
+	unsigned int acquireTexture(const QString& key);
+	// Makes the texture available under the key, the caller keeps its reference
+	void insertTexture(const QString& key, unsigned int texture);
+	// The last reference deletes it, with a context of the group current. Textures never inserted go right away
+	void releaseTexture(unsigned int texture);
+
+private:
+	SharedResources() = default;
+
+	struct Entry
+	{
+		QString key;
+		int references;
+	};
+
+	std::map<QString, unsigned int> _textureByKey;
+	std::unordered_map<unsigned int, Entry> _entries;
+};
@@ -5,6 +5,7 @@
 #include FT_FREETYPE_H
 
 #include "TextRenderer.h"
+#include "SharedResources.h"
 
 TextRenderer::TextRenderer(QOpenGLShaderProgram* prog, unsigned int width, unsigned int height) : _prog(prog), _width(width), _height(height)
 {
@@ -48,19 +49,21 @@ TextRenderer::~TextRenderer()
 
 void TextRenderer::deleteTextures()
 {
+	SharedResources* shared = SharedResources::current();
 	for (const auto& el : _characters)
 	{
-		unsigned int texture = el.second.TextureID;
-		//std::cout << "TextRenderer::~TextRenderer : texture = " << texture << std::endl;
-		glDeleteTextures(1, &texture);
+		//std::cout << "TextRenderer::~TextRenderer : texture = " << el.second.TextureID << std::endl;
+		if (shared)
+			shared->releaseTexture(el.second.TextureID);
 	}
+	_characters.clear();
 }
 
 void TextRenderer::Load(std::string font, unsigned int fontSize)
 {
 	_fontSize = fontSize;
-	// First clear the previously loaded Characters
-	this->_characters.clear();
+	// First release the previously loaded Characters
+	deleteTextures();
 	// Then initialize and load the FreeType library
 	FT_Library ft;
 	if (FT_Init_FreeType(&ft)) // All functions return a value different than 0 whenever an error occurred
@@ -73,8 +76,9 @@ void TextRenderer::Load(std::string font, unsigned int fontSize)
 	FT_Set_Pixel_Sizes(face, 0, _fontSize);
 	// Disable byte-alignment restriction
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	// clear existing textures if any
-	deleteTextures();
+	// Glyph textures other windows made from the same font and size are reused
+	SharedResources* shared = SharedResources::current();
+	const QString glyphKey = QString("glyph:%1:%2:").arg(QString::fromStdString(font)).arg(_fontSize);
 	// Then for the first 128 ASCII characters, pre-load/compile their characters and store them
 	for (unsigned char c = 0; c < 128; c++)
 	{
@@ -85,26 +89,31 @@ void TextRenderer::Load(std::string font, unsigned int fontSize)
 			continue;
 		}
 		// Generate texture
-		unsigned int texture;
-		glGenTextures(1, &texture);
-		//std::cout << "TextRenderer::Load : _texture = " << texture << std::endl;
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_RED,
-			face->glyph->bitmap.width,
-			face->glyph->bitmap.rows,
-			0,
-			GL_RED,
-			GL_UNSIGNED_BYTE,
-			face->glyph->bitmap.buffer
-		);
-		// Set texture options
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		const QString key = glyphKey + QString::number(c);
+		unsigned int texture = shared->acquireTexture(key);
+		if (texture == 0)
+		{
+			glGenTextures(1, &texture);
+			//std::cout << "TextRenderer::Load : _texture = " << texture << std::endl;
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glTexImage2D(
+				GL_TEXTURE_2D,
+				0,
+				GL_RED,
+				face->glyph->bitmap.width,
+				face->glyph->bitmap.rows,
+				0,
+				GL_RED,
+				GL_UNSIGNED_BYTE,
+				face->glyph->bitmap.buffer
+			);
+			// Set texture options
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			shared->insertTexture(key, texture);
+		}
 
 		// Now store character for later use
 		Character character = {
@@ -0,0 +1,490 @@
+#include "TextureCache.h"
+#include "Ktx2.h"
+#include "stb_image.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QOpenGLContext>
+#include <QStandardPaths>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+	constexpr qint64 DEFAULT_TEXTURE_BUDGET = 1024ll * 1024 * 1024;
+	constexpr size_t RING_SIZE = 64 * 1024 * 1024;              // larger images are uploaded from client memory
+	constexpr size_t RING_ALIGNMENT = 64;
+	constexpr size_t UPLOAD_BYTES_PER_FRAME = 32 * 1024 * 1024;  // at least one image is uploaded every frame
+
+	std::map<QOpenGLContextGroup*, TextureCache*>& groupCaches()
+	{
+		static std::map<QOpenGLContextGroup*, TextureCache*> caches;
+		return caches;
+	}
+
+	GLenum pixelFormat(int components)
+	{
+		if (components == 1)
+			return GL_RED;
+		if (components == 2)
+			return GL_RG;
+		if (components == 3)
+			return GL_RGB;
+		return GL_RGBA;
+	}
+
+	const char* usageName(TextureCache::Usage usage)
+	{
+		switch (usage)
+		{
+		case TextureCache::Usage::Normal:
+			return "normal";
+		case TextureCache::Usage::Mask:
+			return "mask";
+		default:
+			return "color";
+		}
+	}
+
+	BlockCompression::Image compressImage(const QByteArray& data, TextureCache::Usage usage)
+	{
+		int width = 0, height = 0, components = 0;
+		std::unique_ptr<unsigned char, void (*)(void*)> pixels(stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(data.constData()),
+			data.size(), &width, &height, &components, 4), stbi_image_free);
+		if (!pixels)
+			return { BlockCompression::Format::BC1, 0, 0, {}, {} };
+
+		BlockCompression::Format format = BlockCompression::Format::BC1;
+		if (usage == TextureCache::Usage::Normal)
+			format = BlockCompression::Format::BC5;
+		else if (usage == TextureCache::Usage::Mask)
+			format = BlockCompression::Format::BC4;
+		else if (components == 2 || components == 4)
+		{
+			const unsigned char* end = pixels.get() + static_cast<size_t>(width) * height * 4;
+			for (const unsigned char* texel = pixels.get(); texel < end; texel += 4)
+			{
+				if (texel[3] != 255)
+				{
+					format = BlockCompression::Format::BC3;
+					break;
+				}
+			}
+		}
+		return BlockCompression::compress(pixels.get(), width, height, format);
+	}
+}
+
+TextureCache::TextureCache(QOpenGLContext* context) : _context(context),
+_shareGroup(context->shareGroup()),
+_budget(DEFAULT_TEXTURE_BUDGET),
+_residentBytes(0),
+_useClock(0),
+_s3tcSupported(context->hasExtension("GL_EXT_texture_compression_s3tc")),
+_cacheDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)),
+_decodeQueue(std::make_shared<DecodeQueue>()),
+_ringBuffer(0),
+_ringData(nullptr),
+_ringHead(0)
+{
+	initializeOpenGLFunctions();
+	// The flip happens inside stbi's decode; the flag is global and every user in the
+	// application sets it to true, so it is fixed here before any worker decodes
+	stbi_set_flip_vertically_on_load(true);
+}
+
+TextureCache::~TextureCache()
+{
+	// Only clean up while a context of the group is current, otherwise everything goes with the group
+	QOpenGLContext* current = QOpenGLContext::currentContext();
+	if (!current || current->shareGroup() != _shareGroup)
+		return;
+
+	for (const RingRegion& region : _ringInFlight)
+		glDeleteSync(region.fence);
+	if (_ringBuffer)
+	{
+		glUnmapNamedBuffer(_ringBuffer);
+		glDeleteBuffers(1, &_ringBuffer);
+	}
+	for (const auto& entry : _entries)
+		glDeleteTextures(1, &entry.first);
+}
+
+TextureCache* TextureCache::forContext(QOpenGLContext* context)
+{
+	if (!context)
+		return nullptr;
+
+	auto& caches = groupCaches();
+	TextureCache* cache = nullptr;
+	auto it = caches.find(context->shareGroup());
+	if (it != caches.end())
+	{
+		cache = it->second;
+		if (cache->_contexts.count(context))
+		{
+			// The functions are resolved for the context that last asked with itself current
+			if (cache->_context != context && QOpenGLContext::currentContext() == context)
+			{
+				cache->_context = context;
+				cache->initializeOpenGLFunctions();
+			}
+			return cache;
+		}
+	}
+	else
+	{
+		cache = new TextureCache(context);
+		caches[context->shareGroup()] = cache;
+	}
+
+	// The textures are shared by the group and die with its last context
+	cache->_contexts.insert(context);
+	QObject::connect(context, &QOpenGLContext::aboutToBeDestroyed, context, [context]()
+		{
+			auto& caches = groupCaches();
+			auto it = caches.find(context->shareGroup());
+			if (it == caches.end())
+				return;
+			TextureCache* cache = it->second;
+			cache->_contexts.erase(context);
+			if (cache->_contexts.empty())
+			{
+				// The context is current while it is about to be destroyed
+				if (cache->_context != context)
+				{
+					cache->_context = context;
+					cache->initializeOpenGLFunctions();
+				}
+				delete cache;
+				caches.erase(it);
+			}
+			else if (cache->_context == context)
+			{
+				cache->_context = nullptr; // rebound by the next forContext
+			}
+		});
+	return cache;
+}
+
+TextureCache* TextureCache::current()
+{
+	return forContext(QOpenGLContext::currentContext());
+}
+
+unsigned int TextureCache::acquire(const QString& path, Usage usage)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		std::cout << "Texture failed to load at path: " << path.toStdString() << std::endl;
+		return 0;
+	}
+	const QByteArray data = file.readAll();
+	const QString hash = QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex());
+	const QString key = QFileInfo(path).canonicalFilePath() + "#" + hash + "#" + usageName(usage);
+
+	auto found = _textureByKey.find(key);
+	if (found != _textureByKey.end())
+	{
+		Entry& entry = _entries[found->second];
+		entry.references++;
+		entry.lastUse = ++_useClock;
+		return found->second;
+	}
+
+	// White placeholder until the decoded image is uploaded
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	unsigned int texture = 0;
+	glGenTextures(1, &texture);
+	glActiveTexture(GL_TEXTURE0); // unit 0 belongs to the meshes, which bind it before drawing
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	_textureByKey[key] = texture;
+	_entries[texture] = { key, 4, 1, ++_useClock, true };
+	_residentBytes += 4;
+
+	// Color stays uncompressed without S3TC
+	const bool compress = usage != Usage::Color || _s3tcSupported;
+	const QString ktxFile = compress && !_cacheDir.isEmpty() ?
+		_cacheDir + "/textures/" + hash + "-" + usageName(usage) + ".ktx2" : QString();
+
+	std::shared_ptr<DecodeQueue> queue = _decodeQueue;
+	queue->pending++;
+	QThreadPool::globalInstance()->start([queue, data, texture, key, usage, compress, ktxFile]()
+		{
+			Decoded image = { texture, key, 0, 0, 0, { nullptr, stbi_image_free }, {} };
+			if (compress)
+			{
+				if (ktxFile.isEmpty() || !Ktx2::read(ktxFile, image.compressed))
+				{
+					image.compressed = compressImage(data, usage);
+					if (!image.compressed.levels.empty() && !ktxFile.isEmpty() && QDir().mkpath(QFileInfo(ktxFile).path()))
+						Ktx2::write(ktxFile, image.compressed);
+				}
+				image.width = image.compressed.width;
+				image.height = image.compressed.height;
+			}
+			else
+			{
+				image.pixels.reset(stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(data.constData()), data.size(),
+					&image.width, &image.height, &image.components, 0));
+			}
+
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			queue->done.push_back(std::move(image));
+		});
+
+	evict();
+	return texture;
+}
+
+void TextureCache::retain(unsigned int texture)
+{
+	auto it = _entries.find(texture);
+	if (it == _entries.end())
+		return;
+	it->second.references++;
+	it->second.lastUse = ++_useClock;
+}
+
+void TextureCache::release(unsigned int texture)
+{
+	if (texture == 0)
+		return;
+
+	auto it = _entries.find(texture);
+	if (it == _entries.end())
+	{
+		glDeleteTextures(1, &texture);
+		return;
+	}
+	if (it->second.references > 0)
+		it->second.references--;
+	it->second.lastUse = ++_useClock;
+	evict();
+}
+
+void TextureCache::setBudget(qint64 bytes)
+{
+	_budget = bytes;
+	evict();
+}
+
+bool TextureCache::hasPendingUploads() const
+{
+	return _decodeQueue->pending > 0;
+}
+
+bool TextureCache::isPending(unsigned int texture) const
+{
+	auto it = _entries.find(texture);
+	return it != _entries.end() && it->second.pending;
+}
+
+void TextureCache::processUploads()
+{
+	// Retire the ring regions the GPU is done with
+	while (!_ringInFlight.empty())
+	{
+		const GLenum status = glClientWaitSync(_ringInFlight.front().fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(_ringInFlight.front().fence);
+		_ringInFlight.pop_front();
+	}
+
+	std::vector<Decoded> batch;
+	{
+		std::lock_guard<std::mutex> lock(_decodeQueue->mutex);
+		std::vector<Decoded>& done = _decodeQueue->done;
+		size_t count = 0, bytes = 0;
+		while (count < done.size() && (count == 0 || bytes < UPLOAD_BYTES_PER_FRAME))
+		{
+			bytes += done[count].compressed.levels.empty() ?
+				static_cast<size_t>(done[count].width) * done[count].height * done[count].components : done[count].compressed.data.size();
+			count++;
+		}
+		std::move(done.begin(), done.begin() + count, std::back_inserter(batch));
+		done.erase(done.begin(), done.begin() + count);
+	}
+
+	for (const Decoded& image : batch)
+	{
+		upload(image);
+		_decodeQueue->pending--;
+	}
+	// The other contexts of the group draw them too
+	if (!batch.empty())
+		glFlush();
+}
+
+void TextureCache::upload(const Decoded& image)
+{
+	auto it = _entries.find(image.texture);
+	if (it == _entries.end() || it->second.key != image.key)
+		return; // evicted while decoding
+	it->second.pending = false;
+	if (!image.pixels && image.compressed.levels.empty())
+	{
+		std::cout << "Texture failed to decode: " << image.key.toStdString() << std::endl;
+		return; // keeps the placeholder
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, image.texture);
+	const qint64 bytes = image.compressed.levels.empty() ? uploadPixels(image) : uploadCompressed(image);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	_residentBytes += bytes - it->second.bytes;
+	it->second.bytes = bytes;
+	evict();
+}
+
+qint64 TextureCache::uploadPixels(const Decoded& image)
+{
+	const GLenum format = pixelFormat(image.components);
+	const size_t size = static_cast<size_t>(image.width) * image.height * image.components;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	size_t offset = 0;
+	if (stage(image.pixels.get(), size, offset))
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+		unstage(offset, size);
+	}
+	else
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+	}
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	if (format == GL_RED)
+		swizzleRed();
+	return static_cast<qint64>(size) * 4 / 3;
+}
+
+qint64 TextureCache::uploadCompressed(const Decoded& image)
+{
+	const BlockCompression::Image& compressed = image.compressed;
+	const GLenum format = BlockCompression::glFormat(compressed.format);
+	const size_t size = compressed.data.size();
+
+	size_t offset = 0;
+	const bool staged = stage(compressed.data.constData(), size, offset);
+	qint64 bytes = 0;
+	for (size_t l = 0; l < compressed.levels.size(); l++)
+	{
+		const BlockCompression::Level& level = compressed.levels[l];
+		const void* data = staged ? reinterpret_cast<const void*>(offset + level.offset) : compressed.data.constData() + level.offset;
+		glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(l), format, level.width, level.height, 0, static_cast<GLsizei>(level.size), data);
+		bytes += level.size;
+	}
+	if (staged)
+		unstage(offset, size);
+	// The mipmaps come with the image, glGenerateMipmap can't make them for compressed formats
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(compressed.levels.size()) - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	if (compressed.format == BlockCompression::Format::BC4)
+		swizzleRed();
+	return bytes;
+}
+
+void TextureCache::swizzleRed()
+{
+	// Grey images read the same in all channels, as the loader's RGBA copies did
+	const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+bool TextureCache::stage(const void* data, size_t size, size_t& offset)
+{
+	if (size > RING_SIZE || (!_ringData && !createRing()))
+		return false;
+	offset = allocateRing(size);
+	std::memcpy(_ringData + offset, data, size);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _ringBuffer);
+	return true;
+}
+
+void TextureCache::unstage(size_t offset, size_t size)
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	_ringInFlight.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), offset, size });
+}
+
+bool TextureCache::createRing()
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &_ringBuffer);
+	glNamedBufferStorage(_ringBuffer, RING_SIZE, nullptr, flags);
+	_ringData = static_cast<unsigned char*>(glMapNamedBufferRange(_ringBuffer, 0, RING_SIZE, flags));
+	if (!_ringData)
+	{
+		glDeleteBuffers(1, &_ringBuffer);
+		_ringBuffer = 0;
+		return false;
+	}
+	_ringHead = 0;
+	return true;
+}
+
+size_t TextureCache::allocateRing(size_t size)
+{
+	size_t offset = (_ringHead + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+	if (offset + size > RING_SIZE)
+		offset = 0;
+
+	// Regions are handed out in ring order, so the ones in the way are the oldest
+	auto overlaps = [offset, size](const RingRegion& region)
+	{
+		return offset < region.offset + region.size && region.offset < offset + size;
+	};
+	while (std::any_of(_ringInFlight.begin(), _ringInFlight.end(), overlaps))
+	{
+		const GLsync fence = _ringInFlight.front().fence;
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+		glDeleteSync(fence);
+		_ringInFlight.pop_front();
+	}
+
+	_ringHead = offset + size;
+	return offset;
+}
+
+void TextureCache::evict()
+{
+	while (_residentBytes > _budget)
+	{
+		auto oldest = _entries.end();
+		for (auto it = _entries.begin(); it != _entries.end(); ++it)
+		{
+			if (it->second.references == 0 && (oldest == _entries.end() || it->second.lastUse < oldest->second.lastUse))
+				oldest = it;
+		}
+		if (oldest == _entries.end())
+			return; // everything left is in use
+
+		unsigned int texture = oldest->first;
+		glDeleteTextures(1, &texture);
+		_residentBytes -= oldest->second.bytes;
+		_textureByKey.erase(oldest->second.key);
+		_entries.erase(oldest);
+	}
+}
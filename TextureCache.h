@@ -0,0 +1,133 @@
+#pragma once
+
+#include "BlockCompression.h"
+
+#include <QString>
+#include <QOpenGLFunctions_4_5_Core>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+class QOpenGLContext;
+class QOpenGLContextGroup;
+
+// Image textures of one OpenGL context share group, keyed by file path and
+// content hash so a file is decoded and uploaded once however many meshes and
+// windows use it, and again only after its content changed. The group's
+// contexts share the cache. Users hold references: acquire() returns a
+// referenced texture, retain() and release() pass it around. Unreferenced
+// textures stay resident for reuse until the estimated video memory of all
+// textures exceeds the budget, then the least recently used ones are deleted.
+//
+// Images are decoded on the global thread pool. Until its image arrives a
+// texture holds a white placeholder pixel, so meshes can bind it right away.
+// processUploads() runs on the GL thread once per frame and streams decoded
+// images through a persistently mapped pixel buffer ring.
+//
+// Images are block compressed by how they are sampled: normal maps to BC5,
+// single channel maps to BC4 and color to BC1, or BC3 with alpha. The result
+// is written to a KTX2 file in the cache directory named after the source's
+// content hash, later loads read it back instead of decoding and compressing.
+class TextureCache : public QOpenGLFunctions_4_5_Core
+{
+public:
+	enum class Usage
+	{
+		Color,
+		Normal, // tangent space, the shaders rebuild z from x and y
+		Mask    // single channel read from red: metallic, roughness, AO, height, opacity
+	};
+
+	static TextureCache* forContext(QOpenGLContext* context);
+	static TextureCache* current(); // nullptr without a current context
+
+	~TextureCache();
+
+	// Referenced texture of the image file, 0 when it can't be read
+	unsigned int acquire(const QString& path, Usage usage = Usage::Color);
+	void retain(unsigned int texture);
+	// Textures the cache did not create are deleted right away
+	void release(unsigned int texture);
+
+	void setBudget(qint64 bytes);
+	qint64 budget() const { return _budget; }
+	qint64 residentBytes() const { return _residentBytes; }
+
+	// Uploads decoded images, call with the context current before drawing
+	void processUploads();
+	bool hasPendingUploads() const;
+	// True while the texture holds its placeholder, it is specified again on upload
+	bool isPending(unsigned int texture) const;
+
+private:
+	explicit TextureCache(QOpenGLContext* context);
+
+	struct Decoded
+	{
+		unsigned int texture;
+		QString key;
+		int width;
+		int height;
+		int components;
+		std::unique_ptr<unsigned char, void (*)(void*)> pixels; // null when decoding failed or compressed
+		BlockCompression::Image compressed;                     // no levels when uncompressed
+	};
+
+	// Shared with the decoding tasks, which may outlive the cache
+	struct DecodeQueue
+	{
+		std::mutex mutex;
+		std::vector<Decoded> done;
+		std::atomic<int> pending{ 0 };
+	};
+
+	struct Entry
+	{
+		QString key;
+		qint64 bytes;        // estimated video memory including mipmaps
+		int references;
+		quint64 lastUse;
+		bool pending;        // the image is not uploaded yet
+	};
+
+	struct RingRegion
+	{
+		GLsync fence;
+		size_t offset;
+		size_t size;
+	};
+
+	void upload(const Decoded& image);
+	qint64 uploadPixels(const Decoded& image);     // bound texture, returns its estimated bytes
+	qint64 uploadCompressed(const Decoded& image);
+	void swizzleRed();
+	// Copies data into the ring and binds it for unpacking, false when it has to come from client memory
+	bool stage(const void* data, size_t size, size_t& offset);
+	void unstage(size_t offset, size_t size);
+	bool createRing();
+	size_t allocateRing(size_t size);
+	void evict();
+
+	QOpenGLContext* _context; // the functions are resolved for it
+	QOpenGLContextGroup* _shareGroup;
+	std::set<QOpenGLContext*> _contexts; // of the group, that asked for the cache
+	std::map<QString, unsigned int> _textureByKey;
+	std::unordered_map<unsigned int, Entry> _entries;
+	qint64 _budget;
+	qint64 _residentBytes;
+	quint64 _useClock;
+	bool _s3tcSupported; // BC1 and BC3, BC4 and BC5 are core
+	QString _cacheDir; // compressed textures go to its textures folder
+
+	std::shared_ptr<DecodeQueue> _decodeQueue;
+
+	unsigned int _ringBuffer;
+	unsigned char* _ringData; // persistently mapped
+	size_t _ringHead;
+	std::deque<RingRegion> _ringInFlight;
+};
@@ -20,7 +20,7 @@ TriangleBaldwinWeber::TriangleBaldwinWeber(const QVector3D& vertex1, const QVect
 	if (fabs(normal.x()) > fabs(normal.y()) && fabs(normal.x()) > fabs(normal.z()))
 	{
 		x1 = _vertex1.y() * _vertex0.z() - _vertex1.z() * _vertex0.y();
-		x2 = _vertex2.y() * _vertex0.z() - _vertex2.z() * _vertex1.y();
+		x2 = _vertex2.y() * _vertex0.z() - _vertex2.z() * _vertex0.y();
 
 		//Do matrix set up here for when a = 1, b = c = 0 formula
 		_fixedColumn = 1;
@@ -2,14 +2,17 @@
 #include <QApplication>
 
 #include "TriangleMesh.h"
-#include "TriangleMollerTrumbore.h"
-#include "TriangleBaldwinWeber.h"
+#include "DefaultTexture.h"
+#include "TextureCache.h"
+#include "MaterialTextures.h"
 #include "Point.h"
-#include "Utils.h"
-#include "config.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <limits>
 
 TriangleMesh::TriangleMesh(QOpenGLShaderProgram* prog, const QString name) : Drawable(prog),
 _texture(0),
@@ -47,6 +50,12 @@ _opacityPBRMapInverted(false)
 {
 	setAutoIncrName(name);
 	_memorySize = 0;
+	_pickingRevision = 0;
+	_nVerts = 0;
+	_vertexFormat = VertexFormat::Separate;
+	_indexType = GL_UNSIGNED_INT;
+	_trsfDirty = true;
+	_objectBoundsDirty = true;
 	_transX = _transY = _transZ = 0.0f;
 	_rotateX = _rotateY = _rotateZ = 0.0f;
 	_scaleX = _scaleY = _scaleZ = 1.0f;
@@ -66,27 +75,26 @@ _opacityPBRMapInverted(false)
 	_tangentBuf.create();
 	_bitangentBuf.create();
 
-	_vertexArrayObject.create();
-
-    const QString path = QString(MODELVIEWER_DATA_DIR) + "/";
-    if (!_texBuffer.load(path + "textures/opengllogo.png"))
-	{ // Load first image from file
-		qWarning("TriangleMesh::TriangleMesh - Could not read image file, using single-color instead.");
-		QImage dummy(128, 128, QImage::Format_ARGB32);
-		dummy.fill(Qt::white);
-		_texBuffer = dummy;
-	}
-	_texImage = convertToGLFormat(_texBuffer);
+	// Typed as a vertex buffer for QOpenGLBuffer, it is only ever bound as a uniform buffer
+	_materialUniformBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	_materialUniformBuffer.create();
+	_materialUniforms = MaterialUniforms();
+	_materialUniformsUploaded = false;
 
-	glGenTextures(1, &_texture);
-	//std::cout << "TriangleMesh::TriangleMesh : _texture = " << _texture << std::endl;
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, _texture);
+	_vertexArrayObject.create();
+	_instanceCount = 1;
+	_useGeometryArena = false;
+	_arenaAllocation = { -1, 0, 0, 0, 0 };
+	_arenaContext = nullptr;
+
+	// No image of its own until setTexureImage, the shared default texture is used meanwhile
+	_texImageDirty = false;
+	_defaultTexture = 0;
+	_defaultTextureContext = nullptr;
+	_materialIndex = -1;
+	_materialContext = nullptr;
+	_materialTexturesDirty = true;
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 }
 
@@ -104,11 +112,11 @@ void TriangleMesh::initBuffers(
 
 	_indices = *indices;
 	_points = *points;
-	_trsfpoints = _points;
 	_normals = *normals;
-
-	// build the triangles for selection
-	buildTriangles();
+	_trsfpoints.clear();
+	_trsfnormals.clear();
+	_trsfDirty = true;
+	_objectBoundsDirty = true;
 
 	if (texCoords)
 		_texCoords = *texCoords;
@@ -120,92 +128,322 @@ void TriangleMesh::initBuffers(
 	_memorySize = 0;
 	_memorySize = (_points.size() + _normals.size() + _indices.size()) * sizeof(float);
 
+	// build the triangles and the hierarchy for selection
+	_triangles.clear();
+	_bvh.clear();
+	buildTriangles();
+	buildBVH();
+
 	_nVerts = (unsigned int)indices->size();
 
+	if (_texCoords.size())
+		_memorySize += _texCoords.size() * sizeof(float);
+	if (_tangents.size())
+		_memorySize += _tangents.size() * sizeof(float);
+	if (_bitangents.size())
+		_memorySize += _bitangents.size() * sizeof(float);
+
+	uploadBuffers();
+	setupAttributes();
+}
+
+TriangleMesh::VertexFormat TriangleMesh::vertexFormat() const
+{
+	return _vertexFormat;
+}
+
+void TriangleMesh::setVertexFormat(VertexFormat format)
+{
+	if (_vertexFormat == format)
+		return;
+	_vertexFormat = format;
+
+	// Re-upload when the buffers were already filled
+	if (_nVerts)
+	{
+		uploadBuffers();
+		setupAttributes();
+	}
+}
+
+GLenum TriangleMesh::indexType() const
+{
+	return _indexType;
+}
+
+void TriangleMesh::uploadBuffers()
+{
+	for (QOpenGLBuffer& buff : _buffers)
+		buff.destroy();
+	_buffers.clear();
+	GeometryArena::release(_arenaContext, _arenaAllocation);
+	_arenaContext = nullptr;
+
+	if (_useGeometryArena && GeometryArena::current())
+	{
+		uploadArenaBuffers();
+		return;
+	}
+
+	if (!_indexBuffer.isCreated())
+		_indexBuffer.create();
+
+	if (_vertexFormat == VertexFormat::Compressed)
+		uploadCompressedBuffers();
+	else
+		uploadSeparateBuffers();
+}
+
+void TriangleMesh::uploadSeparateBuffers()
+{
+	_indexType = GL_UNSIGNED_INT;
+
 	_buffers.push_back(_indexBuffer);
 	_indexBuffer.bind();
 	_indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-	_indexBuffer.allocate(indices->data(), static_cast<int>(indices->size() * sizeof(unsigned int)));
+	_indexBuffer.allocate(_indices.data(), static_cast<int>(_indices.size() * sizeof(unsigned int)));
 
+	if (!_positionBuffer.isCreated())
+		_positionBuffer.create();
 	_buffers.push_back(_positionBuffer);
 	_positionBuffer.bind();
 	_positionBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-	_positionBuffer.allocate(points->data(), static_cast<int>(points->size() * sizeof(float)));
+	_positionBuffer.allocate(_points.data(), static_cast<int>(_points.size() * sizeof(float)));
 
+	if (!_normalBuffer.isCreated())
+		_normalBuffer.create();
 	_buffers.push_back(_normalBuffer);
 	_normalBuffer.bind();
 	_normalBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-	_normalBuffer.allocate(normals->data(), static_cast<int>(normals->size() * sizeof(float)));
+	_normalBuffer.allocate(_normals.data(), static_cast<int>(_normals.size() * sizeof(float)));
 
 	if (_texCoords.size())
 	{
+		if (!_texCoordBuffer.isCreated())
+			_texCoordBuffer.create();
 		_buffers.push_back(_texCoordBuffer);
 		_texCoordBuffer.bind();
 		_texCoordBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
 		_texCoordBuffer.allocate(_texCoords.data(), static_cast<int>(_texCoords.size() * sizeof(float)));
-		_memorySize += _texCoords.size() * sizeof(float);
 	}
 
 	if (_tangents.size())
 	{
+		if (!_tangentBuf.isCreated())
+			_tangentBuf.create();
 		_buffers.push_back(_tangentBuf);
 		_tangentBuf.bind();
 		_tangentBuf.setUsagePattern(QOpenGLBuffer::StaticDraw);
 		_tangentBuf.allocate(_tangents.data(), static_cast<int>(_tangents.size() * sizeof(float)));
-		_memorySize += _tangents.size() * sizeof(float);
 	}
 
 	if (_bitangents.size())
 	{
+		if (!_bitangentBuf.isCreated())
+			_bitangentBuf.create();
 		_buffers.push_back(_bitangentBuf);
 		_bitangentBuf.bind();
 		_bitangentBuf.setUsagePattern(QOpenGLBuffer::StaticDraw);
 		_bitangentBuf.allocate(_bitangents.data(), static_cast<int>(_bitangents.size() * sizeof(float)));
-		_memorySize += _bitangents.size() * sizeof(float);
 	}
+}
+
+// Packs a vector into the xyz components of a GL_INT_2_10_10_10_REV, w holds the sign
+static quint32 packSnorm2101010(float x, float y, float z, float w)
+{
+	const float len = std::sqrt(x * x + y * y + z * z);
+	if (len > 0.0f)
+	{
+		x /= len;
+		y /= len;
+		z /= len;
+	}
+	auto pack = [](float v, float scale, unsigned int bits) -> quint32
+	{
+		const int i = static_cast<int>(std::lround(std::max(-1.0f, std::min(1.0f, v)) * scale));
+		return static_cast<quint32>(i) & ((1u << bits) - 1);
+	};
+	return pack(x, 511.0f, 10) | (pack(y, 511.0f, 10) << 10) | (pack(z, 511.0f, 10) << 20) | (pack(w, 1.0f, 2) << 30);
+}
 
+std::vector<GeometryArena::CompressedVertex> TriangleMesh::compressedVertices() const
+{
+	const size_t vertexCount = _points.size() / 3;
+	const bool hasTexCoords = _texCoords.size() >= 2 * vertexCount;
+	const bool hasTangents = _tangents.size() >= 3 * vertexCount;
+	const bool hasBitangents = _bitangents.size() >= 3 * vertexCount;
+
+	std::vector<CompressedVertex> vertices(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		CompressedVertex& vertex = vertices[i];
+		const float* p = &_points[3 * i];
+		const float* n = &_normals[3 * i];
+		vertex.position[0] = p[0];
+		vertex.position[1] = p[1];
+		vertex.position[2] = p[2];
+		vertex.normal = packSnorm2101010(n[0], n[1], n[2], 0.0f);
+		vertex.tangent = 0;
+		if (hasTangents)
+		{
+			const float* t = &_tangents[3 * i];
+			float sign = 1.0f;
+			if (hasBitangents)
+			{
+				// handedness of the stored frame, the shader rebuilds the bitangent from it
+				const float* b = &_bitangents[3 * i];
+				const QVector3D c = QVector3D::crossProduct(QVector3D(n[0], n[1], n[2]), QVector3D(t[0], t[1], t[2]));
+				if (QVector3D::dotProduct(c, QVector3D(b[0], b[1], b[2])) < 0.0f)
+					sign = -1.0f;
+			}
+			vertex.tangent = packSnorm2101010(t[0], t[1], t[2], sign);
+		}
+		vertex.texCoord[0] = hasTexCoords ? _texCoords[2 * i] : 0.0f;
+		vertex.texCoord[1] = hasTexCoords ? _texCoords[2 * i + 1] : 0.0f;
+	}
+	return vertices;
+}
+
+std::vector<GeometryArena::FullVertex> TriangleMesh::fullVertices() const
+{
+	const size_t vertexCount = _points.size() / 3;
+	const bool hasTexCoords = _texCoords.size() >= 2 * vertexCount;
+	const bool hasTangents = _tangents.size() >= 3 * vertexCount;
+	const bool hasBitangents = _bitangents.size() >= 3 * vertexCount;
+
+	std::vector<GeometryArena::FullVertex> vertices(vertexCount, GeometryArena::FullVertex());
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		GeometryArena::FullVertex& vertex = vertices[i];
+		std::copy_n(&_points[3 * i], 3, vertex.position);
+		std::copy_n(&_normals[3 * i], 3, vertex.normal);
+		if (hasTexCoords)
+			std::copy_n(&_texCoords[2 * i], 2, vertex.texCoord);
+		if (hasTangents)
+			std::copy_n(&_tangents[3 * i], 3, vertex.tangent);
+		if (hasBitangents)
+			std::copy_n(&_bitangents[3 * i], 3, vertex.bitangent);
+	}
+	return vertices;
+}
+
+void TriangleMesh::uploadCompressedBuffers()
+{
+	const size_t vertexCount = _points.size() / 3;
+	const std::vector<CompressedVertex> vertices = compressedVertices();
+
+	if (!_interleavedBuffer.isCreated())
+		_interleavedBuffer.create();
+	_buffers.push_back(_interleavedBuffer);
+	_interleavedBuffer.bind();
+	_interleavedBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+	_interleavedBuffer.allocate(vertices.data(), static_cast<int>(vertices.size() * sizeof(CompressedVertex)));
+
+	_buffers.push_back(_indexBuffer);
+	_indexBuffer.bind();
+	_indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+	if (vertexCount <= std::numeric_limits<quint16>::max())
+	{
+		_indexType = GL_UNSIGNED_SHORT;
+		std::vector<quint16> shortIndices(_indices.begin(), _indices.end());
+		_indexBuffer.allocate(shortIndices.data(), static_cast<int>(shortIndices.size() * sizeof(quint16)));
+	}
+	else
+	{
+		_indexType = GL_UNSIGNED_INT;
+		_indexBuffer.allocate(_indices.data(), static_cast<int>(_indices.size() * sizeof(unsigned int)));
+	}
+}
+
+void TriangleMesh::uploadArenaBuffers()
+{
+	QOpenGLContext* context = QOpenGLContext::currentContext();
+	GeometryArena* arena = GeometryArena::forContext(context);
+	const GLuint vertexCount = static_cast<GLuint>(_points.size() / 3);
+	const GLsizei indexCount = static_cast<GLsizei>(_indices.size());
+
+	if (_vertexFormat == VertexFormat::Compressed)
+	{
+		const std::vector<CompressedVertex> vertices = compressedVertices();
+		if (vertexCount <= std::numeric_limits<quint16>::max())
+		{
+			std::vector<quint16> shortIndices(_indices.begin(), _indices.end());
+			_arenaAllocation = arena->allocate(GeometryArena::Layout::Compressed, GL_UNSIGNED_SHORT, vertices.data(), vertexCount, shortIndices.data(), indexCount);
+		}
+		else
+		{
+			_arenaAllocation = arena->allocate(GeometryArena::Layout::Compressed, GL_UNSIGNED_INT, vertices.data(), vertexCount, _indices.data(), indexCount);
+		}
+	}
+	else
+	{
+		const std::vector<GeometryArena::FullVertex> vertices = fullVertices();
+		_arenaAllocation = arena->allocate(GeometryArena::Layout::Full, GL_UNSIGNED_INT, vertices.data(), vertexCount, _indices.data(), indexCount);
+	}
+	_arenaContext = context;
+	_indexType = arena->indexType(_arenaAllocation.pool);
+}
+
+void TriangleMesh::setupAttributes()
+{
+	// The arena's VAO has its attributes at the same locations
+	if (inGeometryArena())
+		return;
+
+	// The locations are the same in every mesh shader, the VAO only changes with the buffers
 	_vertexArrayObject.bind();
+	for (GLuint location : { VertexAttributes::POSITION, VertexAttributes::NORMAL, VertexAttributes::TEX_COORD,
+		VertexAttributes::TANGENT, VertexAttributes::BITANGENT })
+		glDisableVertexAttribArray(location);
 
 	_indexBuffer.bind();
 
-	// _position
+	auto attribute = [this](GLuint location, GLint size, GLenum type, GLboolean normalized, GLsizei stride, size_t offset)
+	{
+		glVertexAttribPointer(location, size, type, normalized, stride, reinterpret_cast<const void*>(offset));
+		glEnableVertexAttribArray(location);
+	};
+
+	if (_vertexFormat == VertexFormat::Compressed)
+	{
+		const GLsizei stride = static_cast<GLsizei>(sizeof(CompressedVertex));
+		_interleavedBuffer.bind();
+
+		attribute(VertexAttributes::POSITION, 3, GL_FLOAT, GL_FALSE, stride, offsetof(CompressedVertex, position));
+		// packed attributes are read normalized, they need all four components
+		attribute(VertexAttributes::NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, offsetof(CompressedVertex, normal));
+		if (_texCoords.size())
+			attribute(VertexAttributes::TEX_COORD, 2, GL_FLOAT, GL_FALSE, stride, offsetof(CompressedVertex, texCoord));
+		if (_tangents.size())
+			attribute(VertexAttributes::TANGENT, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, offsetof(CompressedVertex, tangent));
+		// the bitangent is rebuilt from the normal and the tangent sign
+
+		_vertexArrayObject.release();
+		return;
+	}
+
 	_positionBuffer.bind();
-	//glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	//glEnableVertexAttribArray(0);  // Vertex position
-	_prog->enableAttributeArray("vertexPosition");
-	_prog->setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3);
+	attribute(VertexAttributes::POSITION, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-	// Normal
 	_normalBuffer.bind();
-	//glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	//glEnableVertexAttribArray(1);  // Normal
-	_prog->enableAttributeArray("vertexNormal");
-	_prog->setAttributeBuffer("vertexNormal", GL_FLOAT, 0, 3);
+	attribute(VertexAttributes::NORMAL, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-	// Tex coords
 	if (_texCoords.size())
 	{
 		_texCoordBuffer.bind();
-		//glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-		//glEnableVertexAttribArray(2);  // Tex coord
-		_prog->enableAttributeArray("texCoord2d");
-		_prog->setAttributeBuffer("texCoord2d", GL_FLOAT, 0, 2);
+		attribute(VertexAttributes::TEX_COORD, 2, GL_FLOAT, GL_FALSE, 0, 0);
 	}
 
 	if (_tangents.size())
 	{
 		_tangentBuf.bind();
-		//glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, 0);
-		//glEnableVertexAttribArray(3);  // Tangents
-		_prog->enableAttributeArray("vertexTangent");
-		_prog->setAttributeBuffer("vertexTangent", GL_FLOAT, 0, 3);
+		attribute(VertexAttributes::TANGENT, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	}
 
 	if (_bitangents.size())
 	{
 		_bitangentBuf.bind();
-		_prog->enableAttributeArray("vertexBitangent");
-		_prog->setAttributeBuffer("vertexBitangent", GL_FLOAT, 0, 3);
+		attribute(VertexAttributes::BITANGENT, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	}
 
 	_vertexArrayObject.release();
@@ -213,181 +451,224 @@ void TriangleMesh::initBuffers(
 
 void TriangleMesh::buildTriangles()
 {
-	if (_triangles.size())
-	{
-		for (Triangle* t : _triangles)
-			delete t;
-		_memorySize -= _triangles.size() * sizeof(Triangle);
-		_triangles.clear();
-	}
+	_memorySize -= _triangles.memorySize();
 	try {
-		size_t offset = 3; // each index points to 3 floats
-		for (size_t i = 0; i < _indices.size();)
-		{
-			// Vertex 1
-			QVector3D v1(_trsfpoints.at(offset * _indices.at(i) + 0), // x coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 1),          // y coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 2));         // z coordinate
-			i++;
-
-			// Vertex 2
-			QVector3D v2(_trsfpoints.at(offset * _indices.at(i) + 0), // x coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 1),          // y coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 2));         // z coordinate
-			i++;
-
-			// Vertex 3
-			QVector3D v3(_trsfpoints[offset * _indices.at(i) + 0], // x coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 1),          // y coordinate
-				_trsfpoints.at(offset * _indices.at(i) + 2));         // z coordinate
-			i++;
-
-			_triangles.push_back(new TriangleMollerTrumbore(v1, v2, v3, this));
-		}
-		_memorySize += _triangles.size() * sizeof(Triangle);
+		_triangles.build(_points, _indices);
 	}
 	catch (const std::exception& ex) {
+		_triangles.clear();
 		std::cout << "Exception raised in TriangleMesh::buildTriangles\n" << ex.what() << std::endl;
 	}
+	_memorySize += _triangles.memorySize();
+}
+
+void TriangleMesh::buildBVH()
+{
+	_memorySize -= _bvh.memorySize();
+	_bvh.build(_triangles);
+	_memorySize += _bvh.memorySize();
+	_pickingRevision++;
 }
 
 void TriangleMesh::setProg(QOpenGLShaderProgram* prog)
 {
 	_prog = prog;
 
-	_vertexArrayObject.bind();
-
-	//_indexBuffer.bind();
-
-	// _position
-	_positionBuffer.bind();
-	//glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	//glEnableVertexAttribArray(0);  // Vertex position
-	_prog->enableAttributeArray("vertexPosition");
-	_prog->setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3);
+	// The vertex array doesn't depend on the program, only the uniforms are set
+	setupTransformationUniforms();
+}
 
-	// Normal
-	_normalBuffer.bind();
-	//glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	//glEnableVertexAttribArray(1);  // Normal
-	_prog->enableAttributeArray("vertexNormal");
-	_prog->setAttributeBuffer("vertexNormal", GL_FLOAT, 0, 3);
+void TriangleMesh::setupTextures()
+{
+	QOpenGLContext* context = QOpenGLContext::currentContext();
+	MaterialTextures* materialTextures = MaterialTextures::forContext(context);
 
-	if (_texCoords.size())
+	if (!_texImage.isNull())
 	{
-		_texCoordBuffer.bind();
-		//glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-		//glEnableVertexAttribArray(2);  // Tex coord
-		_prog->enableAttributeArray("texCoord2d");
-		_prog->setAttributeBuffer("texCoord2d", GL_FLOAT, 0, 2);
+		// The image stays resident, it is only uploaded again after setTexureImage
+		if (_texImageDirty)
+		{
+			glActiveTexture(GL_TEXTURE0); // units of other textures are left alone
+			// A bindless handle freezes the texture, a new image needs a new one
+			if (_texture != 0 && materialTextures->bindless())
+			{
+				glDeleteTextures(1, &_texture);
+				_texture = 0;
+			}
+			if (_texture == 0)
+			{
+				glGenTextures(1, &_texture);
+				glBindTexture(GL_TEXTURE_2D, _texture);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			}
+			glBindTexture(GL_TEXTURE_2D, _texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _texImage.width(), _texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, _texImage.bits());
+			glGenerateMipmap(GL_TEXTURE_2D);
+			_texImageDirty = false;
+			_materialTexturesDirty = true;
+		}
 	}
-
-	if (_tangents.size())
+	else if (_hasTexture && _defaultTextureContext == nullptr)
 	{
-		_tangentBuf.bind();
-		//glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, 0);
-		//glEnableVertexAttribArray(3);  // Tangents
-		_prog->enableAttributeArray("vertexTangent");
-		_prog->setAttributeBuffer("vertexTangent", GL_FLOAT, 0, 3);
+		glActiveTexture(GL_TEXTURE0);
+		_defaultTexture = DefaultTexture::acquire();
+		_defaultTextureContext = context;
+		_materialTexturesDirty = true;
 	}
 
-	if (_bitangents.size())
+	if (materialTextures->bindless())
 	{
-		_bitangentBuf.bind();
-		_prog->enableAttributeArray("vertexBitangent");
-		_prog->setAttributeBuffer("vertexBitangent", GL_FLOAT, 0, 3);
+		// The shader picks our row through materialIndex, nothing is bound
+		if (_materialIndex < 0)
+		{
+			_materialIndex = materialTextures->allocate();
+			_materialContext = context;
+			_materialTexturesDirty = true;
+		}
+		if (_materialTexturesDirty)
+			_materialTexturesDirty = !materialTextures->update(_materialIndex, textureSlots());
+	}
+	else
+	{
+		materialTextures->bind(textureSlots());
 	}
-
-	_vertexArrayObject.release();
 }
 
-void TriangleMesh::setupTextures()
+MaterialTextures::Slots TriangleMesh::textureSlots() const
 {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, _texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _texImage.width(), _texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, _texImage.bits());
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	glActiveTexture(GL_TEXTURE10);
-	glBindTexture(GL_TEXTURE_2D, _diffuseADSMap);
-	glActiveTexture(GL_TEXTURE11);
-	glBindTexture(GL_TEXTURE_2D, _specularADSMap);
-	glActiveTexture(GL_TEXTURE12);
-	glBindTexture(GL_TEXTURE_2D, _emissiveADSMap);
-	glActiveTexture(GL_TEXTURE13);
-	glBindTexture(GL_TEXTURE_2D, _normalADSMap);
-	glActiveTexture(GL_TEXTURE14);
-	glBindTexture(GL_TEXTURE_2D, _heightADSMap);
-	glActiveTexture(GL_TEXTURE15);
-	glBindTexture(GL_TEXTURE_2D, _opacityADSMap);
-
-	glActiveTexture(GL_TEXTURE20);
-	glBindTexture(GL_TEXTURE_2D, _albedoPBRMap);
-	glActiveTexture(GL_TEXTURE21);
-	glBindTexture(GL_TEXTURE_2D, _normalPBRMap);
-	glActiveTexture(GL_TEXTURE22);
-	glBindTexture(GL_TEXTURE_2D, _metallicPBRMap);
-	glActiveTexture(GL_TEXTURE23);
-	glBindTexture(GL_TEXTURE_2D, _roughnessPBRMap);
-	glActiveTexture(GL_TEXTURE24);
-	glBindTexture(GL_TEXTURE_2D, _aoPBRMap);
-	glActiveTexture(GL_TEXTURE25);
-	glBindTexture(GL_TEXTURE_2D, _heightPBRMap);
-	glActiveTexture(GL_TEXTURE26);
-	glBindTexture(GL_TEXTURE_2D, _opacityPBRMap);
+	unsigned int texture = 0;
+	if (!_texImage.isNull())
+		texture = _texture;
+	else if (_hasTexture)
+		texture = _defaultTexture;
+
+	return { texture,
+		_diffuseADSMap, _specularADSMap, _emissiveADSMap, _normalADSMap, _heightADSMap, _opacityADSMap,
+		_albedoPBRMap, _normalPBRMap, _metallicPBRMap, _roughnessPBRMap, _aoPBRMap, _heightPBRMap, _opacityPBRMap };
 }
 
 void TriangleMesh::setupUniforms()
 {
 	_prog->bind();
-	_prog->setUniformValue("texEnabled", _hasTexture);
-	_prog->setUniformValue("texUnit", 0);
-	_prog->setUniformValue("material.ambient", _material.ambient());
-	_prog->setUniformValue("material.diffuse", _material.diffuse());
-	_prog->setUniformValue("material.specular", _material.specular());
-	_prog->setUniformValue("material.emission", _material.emissive());
-	_prog->setUniformValue("material.shininess", _material.shininess());
-	_prog->setUniformValue("material.metallic", _material.metallic());
-	_prog->setUniformValue("opacity", _material.opacity());
-	// ADS light texture maps
-	_prog->setUniformValue("hasDiffuseTexture", _hasDiffuseADSMap);
-	_prog->setUniformValue("hasSpecularTexture", _hasSpecularADSMap);
-	_prog->setUniformValue("hasEmissiveTexture", _hasEmissiveADSMap);
-	_prog->setUniformValue("hasNormalTexture", _hasNormalADSMap);
-	_prog->setUniformValue("hasHeightTexture", _hasHeightADSMap);
-	_prog->setUniformValue("hasOpacityTexture", _hasOpacityADSMap);
-	_prog->setUniformValue("opacityTextureInverted", _opacityADSMapInverted);
-
-	_prog->setUniformValue("texture_diffuse", 10);
-	_prog->setUniformValue("texture_specular", 11);
-	_prog->setUniformValue("texture_emissive", 12);
-	_prog->setUniformValue("texture_normal", 13);
-	_prog->setUniformValue("texture_height", 14);
-	_prog->setUniformValue("texture_opacity", 15);
+	setupTransformationUniforms();
+	_prog->setUniformValue("selected", _selected);
+
+	// The material block only goes up again when something in it changed
+	const MaterialUniforms uniforms = materialUniforms();
+	if (!_materialUniformsUploaded)
+	{
+		glNamedBufferData(_materialUniformBuffer.bufferId(), sizeof(MaterialUniforms), &uniforms, GL_DYNAMIC_DRAW);
+		_materialUniforms = uniforms;
+		_materialUniformsUploaded = true;
+	}
+	else if (memcmp(&uniforms, &_materialUniforms, sizeof(MaterialUniforms)) != 0)
+	{
+		glNamedBufferSubData(_materialUniformBuffer.bufferId(), 0, sizeof(MaterialUniforms), &uniforms);
+		_materialUniforms = uniforms;
+	}
+	glBindBufferBase(GL_UNIFORM_BUFFER, MaterialUniforms::BINDING, _materialUniformBuffer.bufferId());
+}
+
+bool TriangleMesh::hasTextureMaps() const
+{
+	return _hasTexture ||
+		_hasDiffuseADSMap || _hasSpecularADSMap || _hasEmissiveADSMap || _hasNormalADSMap || _hasHeightADSMap || _hasOpacityADSMap ||
+		_hasAlbedoPBRMap || _hasMetallicPBRMap || _hasRoughnessPBRMap || _hasNormalPBRMap || _hasAOPBRMap || _hasHeightPBRMap || _hasOpacityPBRMap;
+}
+
+bool TriangleMesh::isTransparent() const
+{
+	return _material.opacity() < 1.0f || _hasOpacityADSMap || _hasOpacityPBRMap;
+}
+
+bool TriangleMesh::mirrored() const
+{
+	return (_scaleX < 0 && _scaleY > 0 && _scaleZ > 0) ||
+		(_scaleX > 0 && _scaleY < 0 && _scaleZ > 0) ||
+		(_scaleX > 0 && _scaleY > 0 && _scaleZ < 0) ||
+		(_scaleX < 0 && _scaleY < 0 && _scaleZ < 0);
+}
+
+DrawUniforms TriangleMesh::drawUniforms(bool withMaterial)
+{
+	DrawUniforms uniforms = DrawUniforms();
+	Std140::set(uniforms.meshMatrix, _transformation);
+	Std140::set(uniforms.meshNormalMatrix, _transformation.normalMatrix());
+	uniforms.bitangentFromTangent = _vertexFormat == VertexFormat::Compressed;
+	uniforms.selected = _selected;
+	if (withMaterial)
+	{
+		// Fills our row of the bindless table, materialIndex points at it
+		if (hasTextureMaps())
+			setupTextures();
+		uniforms.material = materialUniforms();
+	}
+	return uniforms;
+}
+
+MaterialUniforms TriangleMesh::materialUniforms() const
+{
+	MaterialUniforms uniforms = MaterialUniforms(); // zeroed padding, blocks are compared bytewise
+	Std140::set(uniforms.emission, _material.emissive());
+	Std140::set(uniforms.ambient, _material.ambient());
+	Std140::set(uniforms.diffuse, _material.diffuse());
+	Std140::set(uniforms.specular, _material.specular());
+	uniforms.shininess = _material.shininess();
+	uniforms.metallic = _material.metallic();
 	// PBR Direct Lighting
-	_prog->setUniformValue("pbrLighting.albedo", _material.albedoColor());
-	_prog->setUniformValue("pbrLighting.metallic", _material.metalness());
-	_prog->setUniformValue("pbrLighting.roughness", _material.roughness());
-	_prog->setUniformValue("pbrLighting.ambientOcclusion", 1.0f);
+	Std140::set(uniforms.albedo, _material.albedoColor());
+	uniforms.metalness = _material.metalness();
+	uniforms.roughness = _material.roughness();
+	uniforms.ambientOcclusion = 1.0f;
+	uniforms.opacity = _material.opacity();
+	uniforms.heightScale = _heightPBRMapScale;
+	uniforms.materialIndex = _materialIndex;
+	uniforms.texEnabled = _hasTexture;
+	// ADS light texture maps
+	uniforms.hasDiffuseTexture = _hasDiffuseADSMap;
+	uniforms.hasSpecularTexture = _hasSpecularADSMap;
+	uniforms.hasEmissiveTexture = _hasEmissiveADSMap;
+	uniforms.hasNormalTexture = _hasNormalADSMap;
+	uniforms.hasHeightTexture = _hasHeightADSMap;
+	uniforms.hasOpacityTexture = _hasOpacityADSMap;
+	uniforms.opacityTextureInverted = _opacityADSMapInverted;
 	// PBR Texture Maps
-	_prog->setUniformValue("albedoMap", 20);
-	_prog->setUniformValue("normalMap", 21);
-	_prog->setUniformValue("metallicMap", 22);
-	_prog->setUniformValue("roughnessMap", 23);
-	_prog->setUniformValue("aoMap", 24);
-	_prog->setUniformValue("heightMap", 25);
-	_prog->setUniformValue("opacityMap", 26);
-	_prog->setUniformValue("heightScale", _heightPBRMapScale);
-	_prog->setUniformValue("hasAlbedoMap", _hasAlbedoPBRMap);
-	_prog->setUniformValue("hasMetallicMap", _hasMetallicPBRMap);
-	_prog->setUniformValue("hasRoughnessMap", _hasRoughnessPBRMap);
-	_prog->setUniformValue("hasNormalMap", _hasNormalPBRMap);
-	_prog->setUniformValue("hasAOMap", _hasAOPBRMap);
-	_prog->setUniformValue("hasOpacityMap", _hasOpacityPBRMap);
-	_prog->setUniformValue("opacityMapInverted", _opacityPBRMapInverted);
-	_prog->setUniformValue("hasHeightMap", _hasHeightPBRMap);
+	uniforms.hasAlbedoMap = _hasAlbedoPBRMap;
+	uniforms.hasMetallicMap = _hasMetallicPBRMap;
+	uniforms.hasRoughnessMap = _hasRoughnessPBRMap;
+	uniforms.hasNormalMap = _hasNormalPBRMap;
+	uniforms.hasAOMap = _hasAOPBRMap;
+	uniforms.hasHeightMap = _hasHeightPBRMap;
+	uniforms.hasOpacityMap = _hasOpacityPBRMap;
+	uniforms.opacityMapInverted = _opacityPBRMapInverted;
+	return uniforms;
+}
 
-	_prog->setUniformValue("selected", _selected);
+void TriangleMesh::setupTransformationUniforms()
+{
+	// The vertex buffers hold untransformed data, the shaders apply the transformation
+	_prog->bind();
+	_prog->setUniformValue("meshMatrix", _transformation);
+	_prog->setUniformValue("meshNormalMatrix", _transformation.normalMatrix());
+	_prog->setUniformValue("bitangentFromTangent", _vertexFormat == VertexFormat::Compressed);
+}
+
+void TriangleMesh::setTextureMap(unsigned int& map, unsigned int texture)
+{
+	_materialTexturesDirty = true;
+	// Maps are shared through the texture cache, the old one is released rather than deleted
+	TextureCache* cache = TextureCache::current();
+	if (!cache)
+	{
+		map = texture;
+		return;
+	}
+	cache->retain(texture);
+	cache->release(map);
+	map = texture;
 }
 
 void TriangleMesh::enableOpacityADSMap(bool enable)
@@ -402,8 +683,7 @@ void TriangleMesh::invertOpacityADSMap(bool invert)
 
 void TriangleMesh::setOpacityADSMap(unsigned int opacityTex)
 {
-	glDeleteTextures(1, &_opacityADSMap);
-	_opacityADSMap = opacityTex;
+	setTextureMap(_opacityADSMap, opacityTex);
 	_hasOpacityADSMap = true;
 }
 
@@ -414,8 +694,7 @@ void TriangleMesh::enableHeightADSMap(bool enable)
 
 void TriangleMesh::setHeightADSMap(unsigned int heightTex)
 {
-	glDeleteTextures(1, &_heightADSMap);
-	_heightADSMap = heightTex;
+	setTextureMap(_heightADSMap, heightTex);
 	_hasHeightADSMap = true;
 }
 
@@ -426,8 +705,7 @@ void TriangleMesh::enableNormalADSMap(bool enable)
 
 void TriangleMesh::setNormalADSMap(unsigned int normalTex)
 {
-	glDeleteTextures(1, &_normalADSMap);
-	_normalADSMap = normalTex;
+	setTextureMap(_normalADSMap, normalTex);
 	_hasNormalADSMap = true;
 }
 
@@ -438,8 +716,7 @@ void TriangleMesh::enableSpecularADSMap(bool enable)
 
 void TriangleMesh::setSpecularADSMap(unsigned int specularTex)
 {
-	glDeleteTextures(1, &_specularADSMap);
-	_specularADSMap = specularTex;
+	setTextureMap(_specularADSMap, specularTex);
 	_hasSpecularADSMap = true;
 }
 
@@ -450,8 +727,7 @@ void TriangleMesh::enableEmissiveADSMap(bool enable)
 
 void TriangleMesh::setEmissiveADSMap(unsigned int emissiveTex)
 {
-	glDeleteTextures(1, &_emissiveADSMap);
-	_emissiveADSMap = emissiveTex;
+	setTextureMap(_emissiveADSMap, emissiveTex);
 	_hasEmissiveADSMap = true;
 }
 
@@ -462,59 +738,47 @@ void TriangleMesh::enableDiffuseADSMap(bool enable)
 
 void TriangleMesh::setDiffuseADSMap(unsigned int diffuseTex)
 {
-	glDeleteTextures(1, &_diffuseADSMap);
-	_diffuseADSMap = diffuseTex;
+	setTextureMap(_diffuseADSMap, diffuseTex);
 	_hasDiffuseADSMap = true;
 }
 
 void TriangleMesh::clearDiffuseADSMap()
 {
-	glDeleteTextures(1, &_diffuseADSMap);
-	_diffuseADSMap = 0;
+	setTextureMap(_diffuseADSMap, 0);
 }
 
 void TriangleMesh::clearSpecularADSMap()
 {
-	glDeleteTextures(1, &_specularADSMap);
-	_specularADSMap = 0;
+	setTextureMap(_specularADSMap, 0);
 }
 
 void TriangleMesh::clearEmissiveADSMap()
 {
-	glDeleteTextures(1, &_emissiveADSMap);
-	_emissiveADSMap = 0;
+	setTextureMap(_emissiveADSMap, 0);
 }
 
 void TriangleMesh::clearNormalADSMap()
 {
-	glDeleteTextures(1, &_normalADSMap);
-	_normalADSMap = 0;
+	setTextureMap(_normalADSMap, 0);
 }
 
 void TriangleMesh::clearHeightADSMap()
 {
-	glDeleteTextures(1, &_heightADSMap);
-	_heightADSMap = 0;
+	setTextureMap(_heightADSMap, 0);
 }
 
 void TriangleMesh::clearOpacityADSMap()
 {
-	glDeleteTextures(1, &_opacityADSMap);
-	_opacityADSMap = 0;
+	setTextureMap(_opacityADSMap, 0);
 }
 
 void TriangleMesh::clearAllADSMaps()
 {
-	glDeleteTextures(1, &_diffuseADSMap);
-	_diffuseADSMap = 0;
-	glDeleteTextures(1, &_specularADSMap);
-	_specularADSMap = 0;
-	glDeleteTextures(1, &_emissiveADSMap);
-	_emissiveADSMap = 0;
-	glDeleteTextures(1, &_normalADSMap);
-	_normalADSMap = 0;
-	glDeleteTextures(1, &_heightADSMap);
-	_heightADSMap = 0;
+	setTextureMap(_diffuseADSMap, 0);
+	setTextureMap(_specularADSMap, 0);
+	setTextureMap(_emissiveADSMap, 0);
+	setTextureMap(_normalADSMap, 0);
+	setTextureMap(_heightADSMap, 0);
 }
 
 GLMaterial TriangleMesh::getMaterial() const
@@ -536,7 +800,7 @@ void TriangleMesh::render()
 
 	setupUniforms();
 
-	if (_material.opacity() < 1.0f || _hasOpacityADSMap || _hasOpacityPBRMap)
+	if (isTransparent())
 	{
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -549,24 +813,29 @@ void TriangleMesh::render()
 	}
 
 	// Handle lighting normal for negative scaling
-	if ((_scaleX < 0 && _scaleY > 0 && _scaleZ > 0) ||
-		(_scaleX > 0 && _scaleY < 0 && _scaleZ > 0) ||
-		(_scaleX > 0 && _scaleY > 0 && _scaleZ < 0) ||
-		(_scaleX < 0 && _scaleY < 0 && _scaleZ < 0))
-	{
-		glFrontFace(GL_CW);
-	}
-	else
+	glFrontFace(mirrored() ? GL_CW : GL_CCW);
+	drawElements(_instanceCount);
+	_prog->release();
+
+	glDisable(GL_BLEND);
+}
+
+void TriangleMesh::drawElements(GLsizei instanceCount)
+{
+	if (inGeometryArena())
 	{
-		glFrontFace(GL_CCW);
+		GeometryArena* arena = GeometryArena::forContext(_arenaContext);
+		const size_t indexSize = _indexType == GL_UNSIGNED_SHORT ? sizeof(quint16) : sizeof(unsigned int);
+		arena->bind(_arenaAllocation.pool, instanceCount);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, _nVerts, _indexType,
+			reinterpret_cast<const void*>(_arenaAllocation.firstIndex * indexSize), instanceCount, _arenaAllocation.baseVertex);
+		arena->release();
+		return;
 	}
+
 	_vertexArrayObject.bind();
-	glDrawElements(GL_TRIANGLES, _nVerts, GL_UNSIGNED_INT, 0);
+	glDrawElementsInstanced(GL_TRIANGLES, _nVerts, _indexType, 0, instanceCount);
 	_vertexArrayObject.release();
-	_prog->release();
-
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glDisable(GL_BLEND);
 }
 
 void TriangleMesh::deleteTextures()
@@ -574,29 +843,30 @@ void TriangleMesh::deleteTextures()
 	//std::cout << "TriangleMesh::deleteTextures : _texture = " << _texture << std::endl;
 
 	glDeleteTextures(1, &_texture);
-	glDeleteTextures(1, &_diffuseADSMap);
-	glDeleteTextures(1, &_specularADSMap);
-	glDeleteTextures(1, &_emissiveADSMap);
-	glDeleteTextures(1, &_normalADSMap);
-	glDeleteTextures(1, &_heightADSMap);
-	glDeleteTextures(1, &_opacityADSMap);
-	glDeleteTextures(1, &_albedoPBRMap);
-	glDeleteTextures(1, &_metallicPBRMap);
-	glDeleteTextures(1, &_roughnessPBRMap);
-	glDeleteTextures(1, &_normalPBRMap);
-	glDeleteTextures(1, &_aoPBRMap);
-	glDeleteTextures(1, &_heightPBRMap);
-	glDeleteTextures(1, &_opacityPBRMap);
+	_texture = 0;
+	_texImageDirty = true;
+	setTextureMap(_diffuseADSMap, 0);
+	setTextureMap(_specularADSMap, 0);
+	setTextureMap(_emissiveADSMap, 0);
+	setTextureMap(_normalADSMap, 0);
+	setTextureMap(_heightADSMap, 0);
+	setTextureMap(_opacityADSMap, 0);
+	setTextureMap(_albedoPBRMap, 0);
+	setTextureMap(_metallicPBRMap, 0);
+	setTextureMap(_roughnessPBRMap, 0);
+	setTextureMap(_normalPBRMap, 0);
+	setTextureMap(_aoPBRMap, 0);
+	setTextureMap(_heightPBRMap, 0);
+	setTextureMap(_opacityPBRMap, 0);
 }
 
 TriangleMesh::~TriangleMesh()
 {
 	deleteBuffers();
-#ifdef Q_OS_WIN
-	deleteTextures(); // causes wrong texture deletion on Linux
-#endif
-	for (Triangle* t : _triangles)
-		delete t;
+	if (_defaultTextureContext)
+		DefaultTexture::release(_defaultTextureContext);
+	MaterialTextures::release(_materialContext, _materialIndex);
+	deleteTextures();
 }
 
 void TriangleMesh::deleteBuffers()
@@ -609,6 +879,8 @@ void TriangleMesh::deleteBuffers()
 		}
 		_buffers.clear();
 	}
+	GeometryArena::release(_arenaContext, _arenaAllocation);
+	_arenaContext = nullptr;
 
 	if (_vertexArrayObject.isCreated())
 	{
@@ -618,80 +890,22 @@ void TriangleMesh::deleteBuffers()
 
 void TriangleMesh::computeBounds()
 {
-	// Ritter's algorithm
-	std::vector<QVector3D> aPoints;
-	for (size_t i = 0; i < _trsfpoints.size(); i += 3)
+	// The points are only visited after the geometry changed, transformations map the object space bounds
+	if (_objectBoundsDirty)
 	{
-		aPoints.push_back(QVector3D(_trsfpoints[i], _trsfpoints[i + 1], _trsfpoints[i + 2]));
-	}
-	QVector3D xmin, xmax, ymin, ymax, zmin, zmax;
-	xmin = ymin = zmin = QVector3D(1, 1, 1) * INFINITY;
-	xmax = ymax = zmax = QVector3D(1, 1, 1) * -INFINITY;
-	for (auto p : aPoints)
-	{
-		if (p.x() < xmin.x())
-			xmin = p;
-		if (p.x() > xmax.x())
-			xmax = p;
-		if (p.y() < ymin.y())
-			ymin = p;
-		if (p.y() > ymax.y())
-			ymax = p;
-		if (p.z() < zmin.z())
-			zmin = p;
-		if (p.z() > zmax.z())
-			zmax = p;
-	}
-	auto xSpan = (xmax - xmin).lengthSquared();
-	auto ySpan = (ymax - ymin).lengthSquared();
-	auto zSpan = (zmax - zmin).lengthSquared();
-	auto dia1 = xmin;
-	auto dia2 = xmax;
-	auto maxSpan = xSpan;
-	if (ySpan > maxSpan)
-	{
-		maxSpan = ySpan;
-		dia1 = ymin;
-		dia2 = ymax;
-	}
-	if (zSpan > maxSpan)
-	{
-		dia1 = zmin;
-		dia2 = zmax;
-	}
-	auto center = (dia1 + dia2) * 0.5f;
-	auto sqRad = (dia2 - center).lengthSquared();
-	auto radius = sqrt(sqRad);
-	for (auto p : aPoints)
-	{
-		float d = (p - center).lengthSquared();
-		if (d > sqRad)
-		{
-			auto r = sqrt(d);
-			radius = (radius + r) * 0.5f;
-			sqRad = radius * radius;
-			auto offset = r - radius;
-			center = (radius * center + offset * p) / r;
-		}
+		_objectBounds = MeshBounds::compute(_points.data(), vertexCount());
+		_objectBoundsDirty = false;
 	}
 
-	_boundingSphere.setCenter(center);
-	_boundingSphere.setRadius(radius);
+	const MeshBounds::Bounds bounds = MeshBounds::transformed(_objectBounds, _transformation);
+	if (!bounds.valid)
+		return;
 
-	QList<float> xVals, yVals, zVals;
-	for (size_t i = 0; i < _trsfpoints.size(); i += 3)
-	{
-		xVals.push_back(_trsfpoints.at(i));
-		yVals.push_back(_trsfpoints.at(i + 1));
-		zVals.push_back(_trsfpoints.at(i + 2));
-	}
-	std::sort(xVals.begin(), xVals.end(), std::less<float>());
-	std::sort(yVals.begin(), yVals.end(), std::less<float>());
-	std::sort(zVals.begin(), zVals.end(), std::less<float>());
-	_boundingBox.setLimits(xVals.first(), xVals.last(),
-		yVals.first(), yVals.last(),
-		zVals.first(), zVals.last());
-	Point cen = _boundingBox.center();
+	_boundingSphere.setCenter(bounds.center[0], bounds.center[1], bounds.center[2]);
+	_boundingSphere.setRadius(bounds.radius);
+	_boundingBox.setLimits(bounds.boxMin[0], bounds.boxMax[0],
+		bounds.boxMin[1], bounds.boxMax[1],
+		bounds.boxMin[2], bounds.boxMax[2]);
 }
 
 float TriangleMesh::getHighestXValue() const
@@ -726,71 +940,96 @@ float TriangleMesh::getLowestZValue() const
 
 QRect TriangleMesh::projectedRect(const QMatrix4x4& modelView, const QMatrix4x4& projection, const QRect& viewport, const QRect& window) const
 {
-	QList<float> xVals;
-	QList<float> yVals;
-	for (size_t i = 0; i < _trsfpoints.size(); i += 3)
+	// Window coordinates as QVector3D::project computes them, only the extremes are kept
+	const QMatrix4x4 mvp = projection * modelView * _transformation;
+	float xMin = std::numeric_limits<float>::max(), xMax = -std::numeric_limits<float>::max();
+	float yMin = std::numeric_limits<float>::max(), yMax = -std::numeric_limits<float>::max();
+	for (size_t i = 0; i + 2 < _points.size(); i += 3)
 	{
-		QVector3D point(_trsfpoints.at(i + 0), _trsfpoints.at(i + 1), _trsfpoints.at(i + 2));
-		QVector3D projPoint = point.project(modelView, projection, viewport);
-		xVals.push_back(projPoint.x());
-		yVals.push_back(projPoint.y());
+		QVector4D projPoint = mvp * QVector4D(_points[i + 0], _points[i + 1], _points[i + 2], 1.0f);
+		if (qFuzzyIsNull(projPoint.w()))
+			projPoint.setW(1.0f);
+		const float x = (projPoint.x() / projPoint.w() * 0.5f + 0.5f) * viewport.width() + viewport.x();
+		const float y = (projPoint.y() / projPoint.w() * 0.5f + 0.5f) * viewport.height() + viewport.y();
+		xMin = std::min(xMin, x);
+		xMax = std::max(xMax, x);
+		yMin = std::min(yMin, y);
+		yMax = std::max(yMax, y);
 	}
-	std::sort(xVals.begin(), xVals.end(), std::less<float>());
-	std::sort(yVals.begin(), yVals.end(), std::less<float>());
-	QRect rect(xVals.first(), (window.height() - yVals.last()), (xVals.last() - xVals.first()), (yVals.last() - yVals.first()));
+	if (xMin > xMax)
+		return QRect();
+
+	QRect rect(static_cast<int>(xMin), static_cast<int>(window.height() - yMax), static_cast<int>(xMax - xMin), static_cast<int>(yMax - yMin));
 
 	return rect;
 }
 
-std::vector<float> TriangleMesh::getNormals() const
+const std::vector<float>& TriangleMesh::getNormals() const
 {
 	return _normals;
 }
 
-std::vector<float> TriangleMesh::getTexCoords() const
+const std::vector<float>& TriangleMesh::getTexCoords() const
 {
 	return _texCoords;
 }
 
-std::vector<float> TriangleMesh::getTrsfPoints() const
+const std::vector<float>& TriangleMesh::getTrsfPoints() const
 {
-	return _trsfpoints;
+	return transformedPoints();
 }
 
-void TriangleMesh::resetTransformations()
+const std::vector<float>& TriangleMesh::transformedPoints() const
 {
-	_transX = _transY = _transZ = 0.0f;
-	_rotateX = _rotateY = _rotateZ = 0.0f;
-	_scaleX = _scaleY = _scaleZ = 1.0f;
+	updateTransformedData();
+	return _trsfpoints;
+}
 
-	_transformation.setToIdentity();
+void TriangleMesh::updateTransformedData() const
+{
+	if (!_trsfDirty)
+		return;
 
 	_trsfpoints.clear();
+	_trsfpoints.reserve(_points.size());
+	for (size_t i = 0; i < _points.size(); i += 3)
+	{
+		QVector3D tp = _transformation.map(QVector3D(_points[i + 0], _points[i + 1], _points[i + 2]));
+		_trsfpoints.push_back(tp.x());
+		_trsfpoints.push_back(tp.y());
+		_trsfpoints.push_back(tp.z());
+	}
+
 	_trsfnormals.clear();
+	_trsfnormals.reserve(_normals.size());
+	const QMatrix3x3 normalMatrix = _transformation.normalMatrix();
+	for (size_t i = 0; i < _normals.size(); i += 3)
+	{
+		const float* n = &_normals[i];
+		for (int r = 0; r < 3; r++)
+			_trsfnormals.push_back(normalMatrix(r, 0) * n[0] + normalMatrix(r, 1) * n[1] + normalMatrix(r, 2) * n[2]);
+	}
 
-	_trsfpoints = _points;
-	_trsfnormals = _normals;
+	_trsfDirty = false;
+}
 
-	_prog->bind();
-	_positionBuffer.bind();
-	_positionBuffer.allocate(_points.data(), static_cast<int>(_points.size() * sizeof(float)));
-	_prog->enableAttributeArray("vertexPosition");
-	_prog->setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3);
+void TriangleMesh::resetTransformations()
+{
+	_transX = _transY = _transZ = 0.0f;
+	_rotateX = _rotateY = _rotateZ = 0.0f;
+	_scaleX = _scaleY = _scaleZ = 1.0f;
 
-	_normalBuffer.bind();
-	_normalBuffer.allocate(_normals.data(), static_cast<int>(_normals.size() * sizeof(float)));
-	_prog->enableAttributeArray("vertexNormal");
-	_prog->setAttributeBuffer("vertexNormal", GL_FLOAT, 0, 3);
+	_transformation.setToIdentity();
 
-	computeBounds();
+	setupTransformation();
 }
 
-std::vector<unsigned int> TriangleMesh::getIndices() const
+const std::vector<unsigned int>& TriangleMesh::getIndices() const
 {
 	return _indices;
 }
 
-std::vector<float> TriangleMesh::getPoints() const
+const std::vector<float>& TriangleMesh::getPoints() const
 {
 	return _points;
 }
@@ -855,51 +1094,21 @@ QMatrix4x4 TriangleMesh::getTransformation() const
 
 void TriangleMesh::setupTransformation()
 {
-	_prog->bind();
+	// The new matrix reaches the shaders with the next draw, the vertex buffers
+	// are left alone and the CPU copies are transformed again when next needed
 	_trsfpoints.clear();
 	_trsfnormals.clear();
+	_trsfDirty = true;
 
-	// transform points
-	for (size_t i = 0; i < _points.size(); i += 3)
-	{
-		QVector3D p(_points[i + 0], _points[i + 1], _points[i + 2]);
-		QVector3D tp = _transformation.map(p);
-		_trsfpoints.push_back(tp.x());
-		_trsfpoints.push_back(tp.y());
-		_trsfpoints.push_back(tp.z());
-	}
-	_positionBuffer.bind();
-	_positionBuffer.allocate(_trsfpoints.data(), static_cast<int>(_trsfpoints.size() * sizeof(float)));
-	_prog->enableAttributeArray("vertexPosition");
-	_prog->setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3);
-
-	// transform normals
-	for (size_t i = 0; i < _normals.size(); i += 3)
-	{
-		QVector3D n(_normals[i + 0], _normals[i + 1], _normals[i + 2]);
-		QMatrix4x4 rotMat = _transformation;
-		// use only the rotations
-		rotMat.setColumn(3, QVector4D(0, 0, 0, 1));
-		QVector3D tn = rotMat.map(n);
-		_trsfnormals.push_back(tn.x());
-		_trsfnormals.push_back(tn.y());
-		_trsfnormals.push_back(tn.z());
-	}
-	_normalBuffer.bind();
-	_normalBuffer.allocate(_trsfnormals.data(), static_cast<int>(_trsfnormals.size() * sizeof(float)));
-	_prog->enableAttributeArray("vertexNormal");
-	_prog->setAttributeBuffer("vertexNormal", GL_FLOAT, 0, 3);
-
-	buildTriangles();
+	// Picking stays in object space, only the world bounds moved
+	_pickingRevision++;
 	computeBounds();
 }
 
 void TriangleMesh::setTexureImage(const QImage& texImage)
 {
 	_texImage = texImage;
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, _texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _texImage.width(), _texImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, _texImage.bits());
+	_texImageDirty = true; // uploaded by the next setupTextures
 }
 
 bool TriangleMesh::hasTexture() const
@@ -910,6 +1119,7 @@ bool TriangleMesh::hasTexture() const
 void TriangleMesh::enableTexture(const bool& bHasTexture)
 {
 	_hasTexture = bHasTexture;
+	_materialTexturesDirty = true;
 }
 
 float TriangleMesh::shininess() const
@@ -1008,55 +1218,60 @@ unsigned long long TriangleMesh::memorySize() const
 	return _memorySize + sizeof(TriangleMesh);
 }
 
-/*
 bool TriangleMesh::intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir, QVector3D& outIntersectionPoint)
 {
-	bool intersects = false;
-	if (_triangles.size())
-	{
-		for (Triangle* t : _triangles)
-		{
-			intersects = t->intersectsWithRay(rayPos, rayDir, outIntersectionPoint);
-			if (intersects)
-				break;
-		}
-	}
-	return intersects;
-}
-*/
+	RayHit hit;
+	if (!nearestHit(rayPos, rayDir, hit))
+		return false;
 
-#include <atomic>
-#include <QVector3D>
+	outIntersectionPoint = rayPos + rayDir * hit.t;
+	return true;
+}
 
-bool TriangleMesh::intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir, QVector3D& outIntersectionPoint)
+bool TriangleMesh::nearestHit(const QVector3D& rayPos, const QVector3D& rayDir, RayHit& outHit) const
 {
-    std::atomic<bool> intersectionFound(false); // Atomic flag for thread safety
-    QVector3D localIntersectionPoint;
+	// The hierarchy is built over the untransformed points, so the ray is taken
+	// into object space instead. The direction is not normalized again, which
+	// keeps t the same distance along the world ray.
+	bool invertible = true;
+	const QMatrix4x4 inverse = _transformation.inverted(&invertible);
+	if (!invertible)
+		return false;
+	return _bvh.nearestHit(_triangles, inverse.map(rayPos), inverse.mapVector(rayDir), outHit);
+}
 
-    if (_triangles.size())
-    {
-        #pragma omp parallel for shared(intersectionFound, outIntersectionPoint) private(localIntersectionPoint)
-        for (int i = 0; i < _triangles.size(); ++i)
-        {
-            if (!intersectionFound.load()) // Check if another thread already found an intersection
-            {
-                if (_triangles[i]->intersectsWithRay(rayPos, rayDir, localIntersectionPoint))
-                {
-                    intersectionFound.store(true); // Set the flag to true if an intersection is found
+size_t TriangleMesh::triangleCount() const
+{
+	return _triangles.size();
+}
 
-                    #pragma omp critical
-                    {
-                        outIntersectionPoint = localIntersectionPoint; // Update the output intersection point
-                    }
-                }
-            }
-        }
-    }
+bool TriangleMesh::pickingBounds(float* boundsMin, float* boundsMax) const
+{
+	float objectMin[3], objectMax[3];
+	if (!_bvh.bounds(objectMin, objectMax))
+		return false;
 
-    return intersectionFound.load(); // Return whether an intersection was found
+	// World bounds of the transformed object space box
+	for (int a = 0; a < 3; a++)
+	{
+		boundsMin[a] = std::numeric_limits<float>::max();
+		boundsMax[a] = -std::numeric_limits<float>::max();
+	}
+	for (int corner = 0; corner < 8; corner++)
+	{
+		const QVector3D p = _transformation.map(QVector3D(
+			(corner & 1) ? objectMax[0] : objectMin[0],
+			(corner & 2) ? objectMax[1] : objectMin[1],
+			(corner & 4) ? objectMax[2] : objectMin[2]));
+		for (int a = 0; a < 3; a++)
+		{
+			boundsMin[a] = std::min(boundsMin[a], p[a]);
+			boundsMax[a] = std::max(boundsMax[a], p[a]);
+		}
+	}
+	return true;
 }
 
-
 bool TriangleMesh::hasAlbedoPBRMap() const
 {
 	return _hasAlbedoPBRMap;
@@ -1129,38 +1344,32 @@ void TriangleMesh::enableOpacityPBRMap(bool hasOpacityMap)
 
 void TriangleMesh::setAlbedoPBRMap(unsigned int albedoMap)
 {
-	glDeleteTextures(1, &_albedoPBRMap);
-	_albedoPBRMap = albedoMap;
+	setTextureMap(_albedoPBRMap, albedoMap);
 }
 
 void TriangleMesh::setMetallicPBRMap(unsigned int metallicMap)
 {
-	glDeleteTextures(1, &_metallicPBRMap);
-	_metallicPBRMap = metallicMap;
+	setTextureMap(_metallicPBRMap, metallicMap);
 }
 
 void TriangleMesh::setRoughnessPBRMap(unsigned int roughnessMap)
 {
-	glDeleteTextures(1, &_roughnessPBRMap);
-	_roughnessPBRMap = roughnessMap;
+	setTextureMap(_roughnessPBRMap, roughnessMap);
 }
 
 void TriangleMesh::setNormalPBRMap(unsigned int normalMap)
 {
-	glDeleteTextures(1, &_normalPBRMap);
-	_normalPBRMap = normalMap;
+	setTextureMap(_normalPBRMap, normalMap);
 }
 
 void TriangleMesh::setAOPBRMap(unsigned int aoMap)
 {
-	glDeleteTextures(1, &_aoPBRMap);
-	_aoPBRMap = aoMap;
+	setTextureMap(_aoPBRMap, aoMap);
 }
 
 void TriangleMesh::setHeightPBRMap(unsigned int heightMap)
 {
-	glDeleteTextures(1, &_heightPBRMap);
-	_heightPBRMap = heightMap;
+	setTextureMap(_heightPBRMap, heightMap);
 }
 
 float TriangleMesh::getHeightPBRMapScale() const
@@ -1175,8 +1384,7 @@ void TriangleMesh::setHeightPBRMapScale(float heightScale)
 
 void TriangleMesh::setOpacityPBRMap(unsigned int opacityMap)
 {
-	glDeleteTextures(1, &_opacityPBRMap);
-	_opacityPBRMap = opacityMap;
+	setTextureMap(_opacityPBRMap, opacityMap);
 }
 
 void TriangleMesh::invertOpacityPBRMap(bool invert)
@@ -1186,58 +1394,45 @@ void TriangleMesh::invertOpacityPBRMap(bool invert)
 
 void TriangleMesh::clearAlbedoPBRMap()
 {
-	glDeleteTextures(1, &_albedoPBRMap);
-	_albedoPBRMap = 0;
+	setTextureMap(_albedoPBRMap, 0);
 }
 
 void TriangleMesh::clearMetallicPBRMap()
 {
-	glDeleteTextures(1, &_metallicPBRMap);
-	_metallicPBRMap = 0;
+	setTextureMap(_metallicPBRMap, 0);
 }
 
 void TriangleMesh::clearRoughnessPBRMap()
 {
-	glDeleteTextures(1, &_roughnessPBRMap);
-	_roughnessPBRMap = 0;
+	setTextureMap(_roughnessPBRMap, 0);
 }
 
 void TriangleMesh::clearNormalPBRMap()
 {
-	glDeleteTextures(1, &_normalPBRMap);
-	_normalPBRMap = 0;
+	setTextureMap(_normalPBRMap, 0);
 }
 
 void TriangleMesh::clearAOPBRMap()
 {
-	glDeleteTextures(1, &_aoPBRMap);
-	_aoPBRMap = 0;
+	setTextureMap(_aoPBRMap, 0);
 }
 
 void TriangleMesh::clearHeightPBRMap()
 {
-	glDeleteTextures(1, &_heightPBRMap);
-	_heightPBRMap = 0;
+	setTextureMap(_heightPBRMap, 0);
 }
 
 void TriangleMesh::clearOpacityPBRMap()
 {
-	glDeleteTextures(1, &_opacityPBRMap);
-	_opacityPBRMap = 0;
+	setTextureMap(_opacityPBRMap, 0);
 }
 
 void TriangleMesh::clearAllPBRMaps()
 {
-	glDeleteTextures(1, &_albedoPBRMap);
-	_albedoPBRMap = 0;
-	glDeleteTextures(1, &_metallicPBRMap);
-	_metallicPBRMap = 0;
-	glDeleteTextures(1, &_roughnessPBRMap);
-	_roughnessPBRMap = 0;
-	glDeleteTextures(1, &_normalPBRMap);
-	_normalPBRMap = 0;
-	glDeleteTextures(1, &_aoPBRMap);
-	_aoPBRMap = 0;
-	glDeleteTextures(1, &_heightPBRMap);
-	_heightPBRMap = 0;
+	setTextureMap(_albedoPBRMap, 0);
+	setTextureMap(_metallicPBRMap, 0);
+	setTextureMap(_roughnessPBRMap, 0);
+	setTextureMap(_normalPBRMap, 0);
+	setTextureMap(_aoPBRMap, 0);
+	setTextureMap(_heightPBRMap, 0);
 }
@@ -4,14 +4,27 @@
 #include "Drawable.h"
 #include "BoundingSphere.h"
 #include "BoundingBox.h"
+#include "BoundingVolumeHierarchy.h"
+#include "TriangleStore.h"
+#include "MeshBounds.h"
+#include "MaterialTextures.h"
+#include "UniformBlocks.h"
+#include "GeometryArena.h"
 #include "GLMaterial.h"
 
-class Triangle;
-
 class TriangleMesh : public Drawable
 {
 	Q_OBJECT
 public:
+	using RayHit = BoundingVolumeHierarchy::RayHit;
+
+	// Layout of the vertex data on the GPU
+	enum class VertexFormat
+	{
+		Separate,  // one float buffer per attribute, 32 bit indices
+		Compressed // one interleaved buffer of packed vertices, 16 bit indices when they fit
+	};
+
 	TriangleMesh(QOpenGLShaderProgram* prog, const QString name);
 
 	virtual ~TriangleMesh();
@@ -21,6 +34,14 @@ public:
 	virtual TriangleMesh* clone() = 0;
 
 	virtual void render();
+	// Draws the triangles with the current program, no state set up
+	void drawElements(GLsizei instanceCount = 1);
+	// Instances render() draws, one per view when the views go out in one pass
+	void setInstanceCount(GLsizei count) { _instanceCount = count; }
+
+	VertexFormat vertexFormat() const;
+	void setVertexFormat(VertexFormat format); // re-uploads the buffers, needs a current context
+	GLenum indexType() const;
 	virtual void select()
 	{
 		_selected = true;
@@ -34,6 +55,10 @@ public:
 	virtual BoundingBox getBoundingBox() const { return _boundingBox; }
 
 	virtual QOpenGLVertexArrayObject& getVAO();
+	bool inGeometryArena() const { return _arenaAllocation.pool >= 0; }
+	const GeometryArena::Allocation& arenaAllocation() const { return _arenaAllocation; }
+	// Per draw state of a multi draw batch, the material needs our textures set up
+	DrawUniforms drawUniforms(bool withMaterial);
 	virtual QString getName() const
 	{
 		return _name;
@@ -41,6 +66,10 @@ public:
 
 	virtual unsigned long long memorySize() const;
 
+	bool hasTextureMaps() const; // any texture or material map is shown
+	bool isTransparent() const;  // drawn blended
+	bool mirrored() const;       // negative scaling, the winding is flipped
+
 	QVector3D ambientMaterial() const;
 	void setAmbientMaterial(const QVector3D& ambient);
 
@@ -90,15 +119,23 @@ public:
 
 	QMatrix4x4 getTransformation() const;
 
-	std::vector<unsigned int> getIndices() const;
-	std::vector<float> getPoints() const;
-	std::vector<float> getNormals() const;
-	std::vector<float> getTexCoords() const;
-	std::vector<float> getTrsfPoints() const;
+	// Read only views of the mesh data, valid until the mesh is rebuilt
+	const std::vector<unsigned int>& getIndices() const;
+	const std::vector<float>& getPoints() const;
+	const std::vector<float>& getNormals() const;
+	const std::vector<float>& getTexCoords() const;
+	const std::vector<float>& getTrsfPoints() const; // computed on first use after a transformation change
+
+	size_t vertexCount() const { return _points.size() / 3; }
+	GLsizei indexCount() const { return static_cast<GLsizei>(_nVerts); } // indices uploaded for drawing
 
 	void resetTransformations();
 
 	virtual bool intersectsWithRay(const QVector3D& rayPos, const QVector3D& rayDir, QVector3D& outIntersectionPoint);
+	bool nearestHit(const QVector3D& rayPos, const QVector3D& rayDir, RayHit& outHit) const;
+	size_t triangleCount() const;
+	bool pickingBounds(float* boundsMin, float* boundsMax) const;
+	unsigned int pickingRevision() const { return _pickingRevision; } // bumped whenever the picking data or its transformation changes
 
 	void setAlbedoPBRMap(unsigned int albedoMap);
 	void setNormalPBRMap(unsigned int normalMap);
@@ -179,15 +216,33 @@ protected: // methods
 		std::vector<float>* bitangents = nullptr
 	);
 
+	void uploadBuffers();
+	void uploadSeparateBuffers();
+	void uploadCompressedBuffers();
+	void uploadArenaBuffers();
+	std::vector<GeometryArena::FullVertex> fullVertices() const;
+	std::vector<GeometryArena::CompressedVertex> compressedVertices() const;
+	void setupAttributes(); // the VAO, at the VertexAttributes locations
+
 	void buildTriangles();
+	void buildBVH();
     void computeBounds();
     void deleteBuffers();
 
     virtual void setupTransformation();
 	virtual void setupTextures();
 	virtual void setupUniforms();
+	void setupTransformationUniforms();
+	void setTextureMap(unsigned int& map, unsigned int texture); // swaps cache references
+	MaterialTextures::Slots textureSlots() const;
+	MaterialUniforms materialUniforms() const;
+
+	// CPU transformed copies, only computed when a consumer asks for them
+	const std::vector<float>& transformedPoints() const;
+	void updateTransformedData() const;
 
 protected:
+	typedef GeometryArena::CompressedVertex CompressedVertex;
 
 	QOpenGLBuffer _indexBuffer;
 	QOpenGLBuffer _positionBuffer;
@@ -196,22 +251,45 @@ protected:
 	QOpenGLBuffer _tangentBuf;
 	QOpenGLBuffer _bitangentBuf;
 
+	QOpenGLBuffer _interleavedBuffer;
+
 	QOpenGLBuffer _coordBuf;
 
 	unsigned int _nVerts;     // Number of vertices
+	VertexFormat _vertexFormat;
+	GLenum _indexType;        // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
 	QOpenGLVertexArrayObject _vertexArrayObject;        // The Vertex Array Object
+	GLsizei _instanceCount;
+
+	// Meshes in an arena draw from its buffers and VAO instead of the ones above
+	bool _useGeometryArena;
+	GeometryArena::Allocation _arenaAllocation;
+	QOpenGLContext* _arenaContext;
 
 	// Vertex buffers
 	std::vector<QOpenGLBuffer> _buffers;
 
 	BoundingSphere _boundingSphere;
 	BoundingBox    _boundingBox;
+	MeshBounds::Bounds _objectBounds; // bounds of _points, the ones above are derived from them
+	bool _objectBoundsDirty;
 
-	std::vector<Triangle*> _triangles;
+	TriangleStore _triangles;     // Packed triangles of _points (object space) for picking
+	BoundingVolumeHierarchy _bvh; // Picking acceleration structure over _triangles
+	unsigned int _pickingRevision;
 
 	GLMaterial _material;
 
-	QImage _texImage, _texBuffer;
+	QImage _texImage;    // null until setTexureImage, the default texture is shown instead
+	bool _texImageDirty; // _texImage is not uploaded to _texture yet
+	unsigned int _defaultTexture;
+	QOpenGLContext* _defaultTextureContext; // context holding our default texture reference
+	int _materialIndex;                      // row of our textures in the bindless table, -1 before the first render
+	QOpenGLContext* _materialContext;
+	bool _materialTexturesDirty;             // the row doesn't hold the current textures yet
+	QOpenGLBuffer _materialUniformBuffer;    // MaterialUniforms block, bound per draw
+	MaterialUniforms _materialUniforms;      // contents of _materialUniformBuffer
+	bool _materialUniformsUploaded;
 	// ADS texture light maps
 	unsigned int _texture;
 	unsigned int _diffuseADSMap;
@@ -256,8 +334,9 @@ protected:
 	std::vector<float> _tangents;
 	std::vector<float> _bitangents;
 	std::vector<float> _texCoords;
-	std::vector<float> _trsfpoints;
-	std::vector<float> _trsfnormals;
+	mutable std::vector<float> _trsfpoints;
+	mutable std::vector<float> _trsfnormals;
+	mutable bool _trsfDirty; // _trsfpoints and _trsfnormals are out of date
 
 	// Individual transformation components
 	float _transX;
@@ -0,0 +1,170 @@
+#include "TriangleStore.h"
+#include "TriangleMollerTrumbore.h"
+
+#include <algorithm>
+
+using namespace RayTriangleKernels;
+
+TriangleStore::TriangleStore() : _method(Method::MollerTrumbore),
+_stride(0)
+{
+}
+
+void TriangleStore::build(const std::vector<float>& points, const std::vector<unsigned int>& indices)
+{
+	const size_t triCount = indices.size() / 3;
+	_stride = triCount + MAX_PACKET_WIDTH;
+	_mollerTrumbore.assign(MOLLER_TRUMBORE_COMPONENTS * _stride, 0.0f);
+	_ids.resize(triCount);
+
+	float* data = _mollerTrumbore.data();
+	for (size_t i = 0; i < triCount; i++)
+	{
+		float v[3][3];
+		for (int k = 0; k < 3; k++)
+		{
+			const size_t offset = 3 * static_cast<size_t>(indices[3 * i + k]);
+			v[k][0] = points.at(offset + 0);
+			v[k][1] = points.at(offset + 1);
+			v[k][2] = points.at(offset + 2);
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			data[c * _stride + i] = v[0][c];
+			data[(3 + c) * _stride + i] = v[1][c] - v[0][c];
+			data[(6 + c) * _stride + i] = v[2][c] - v[0][c];
+		}
+		_ids[i] = static_cast<unsigned int>(i);
+	}
+
+	_baldwinWeber.clear();
+	if (_method == Method::BaldwinWeber)
+		buildBaldwinWeber();
+}
+
+void TriangleStore::reorder(const std::vector<unsigned int>& order)
+{
+	if (order.size() != _ids.size())
+		return;
+
+	auto permute = [this, &order](std::vector<float>& data, int components)
+	{
+		std::vector<float> sorted(data.size(), 0.0f);
+		for (int c = 0; c < components; c++)
+		{
+			const float* src = &data[c * _stride];
+			float* dst = &sorted[c * _stride];
+			for (size_t i = 0; i < order.size(); i++)
+				dst[i] = src[order[i]];
+		}
+		data.swap(sorted);
+	};
+
+	permute(_mollerTrumbore, MOLLER_TRUMBORE_COMPONENTS);
+	if (!_baldwinWeber.empty())
+		permute(_baldwinWeber, BALDWIN_WEBER_COMPONENTS);
+
+	std::vector<unsigned int> ids(_ids.size());
+	for (size_t i = 0; i < order.size(); i++)
+		ids[i] = _ids[order[i]];
+	_ids.swap(ids);
+}
+
+void TriangleStore::clear()
+{
+	_stride = 0;
+	_mollerTrumbore.clear();
+	_mollerTrumbore.shrink_to_fit();
+	_baldwinWeber.clear();
+	_baldwinWeber.shrink_to_fit();
+	_ids.clear();
+	_ids.shrink_to_fit();
+}
+
+void TriangleStore::setMethod(Method method)
+{
+	if (_method == method)
+		return;
+	_method = method;
+	if (_method == Method::BaldwinWeber)
+	{
+		buildBaldwinWeber();
+	}
+	else
+	{
+		_baldwinWeber.clear();
+		_baldwinWeber.shrink_to_fit();
+	}
+}
+
+void TriangleStore::buildBaldwinWeber()
+{
+	_baldwinWeber.assign(BALDWIN_WEBER_COMPONENTS * _stride, 0.0f);
+	for (size_t i = 0; i < _ids.size(); i++)
+	{
+		float v0[3], e1[3], e2[3], coeffs[BALDWIN_WEBER_COMPONENTS];
+		for (int c = 0; c < 3; c++)
+		{
+			v0[c] = component(c)[i];
+			e1[c] = component(3 + c)[i];
+			e2[c] = component(6 + c)[i];
+		}
+		baldwinWeberTransformation(v0, e1, e2, coeffs);
+		for (int c = 0; c < BALDWIN_WEBER_COMPONENTS; c++)
+			_baldwinWeber[c * _stride + i] = coeffs[c];
+	}
+}
+
+bool TriangleStore::intersect(size_t first, size_t count, const Ray& ray, Hit& hit) const
+{
+	const float* components[BALDWIN_WEBER_COMPONENTS];
+	if (_method == Method::BaldwinWeber)
+	{
+		for (int c = 0; c < BALDWIN_WEBER_COMPONENTS; c++)
+			components[c] = &_baldwinWeber[c * _stride];
+	}
+	else
+	{
+		for (int c = 0; c < MOLLER_TRUMBORE_COMPONENTS; c++)
+			components[c] = component(c);
+	}
+	return RayTriangleKernels::intersect(_method, components, first, count, ray, hit);
+}
+
+void TriangleStore::vertices(size_t i, float* vertex1, float* vertex2, float* vertex3) const
+{
+	for (int c = 0; c < 3; c++)
+	{
+		vertex1[c] = component(c)[i];
+		vertex2[c] = vertex1[c] + component(3 + c)[i];
+		vertex3[c] = vertex1[c] + component(6 + c)[i];
+	}
+}
+
+void TriangleStore::vertices(size_t i, QVector3D& vertex1, QVector3D& vertex2, QVector3D& vertex3) const
+{
+	float v0[3], v1[3], v2[3];
+	vertices(i, v0, v1, v2);
+	vertex1 = QVector3D(v0[0], v0[1], v0[2]);
+	vertex2 = QVector3D(v1[0], v1[1], v1[2]);
+	vertex3 = QVector3D(v2[0], v2[1], v2[2]);
+}
+
+QVector3D TriangleStore::normal(size_t i) const
+{
+	const QVector3D edge1(component(3)[i], component(4)[i], component(5)[i]);
+	const QVector3D edge2(component(6)[i], component(7)[i], component(8)[i]);
+	return QVector3D::crossProduct(edge1, edge2);
+}
+
+Triangle* TriangleStore::createTriangle(size_t i, QObject* parent) const
+{
+	QVector3D v0, v1, v2;
+	vertices(i, v0, v1, v2);
+	return new TriangleMollerTrumbore(v0, v1, v2, parent);
+}
+
+unsigned long long TriangleStore::memorySize() const
+{
+	return (_mollerTrumbore.capacity() + _baldwinWeber.capacity()) * sizeof(float) + _ids.capacity() * sizeof(unsigned int);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <QVector3D>
+
+#include "RayTriangleKernels.h"
+
+class Triangle;
+class QObject;
+
+// Contiguous storage of mesh triangles used for picking. Triangles are kept as
+// structure-of-arrays (v0, edge1 and edge2, one float array per component) plus
+// the id of the triangle in the mesh index array, so millions of triangles cost
+// a handful of allocations instead of one QObject each and a BVH leaf can be
+// tested by the vectorized RayTriangleKernels in one call. The record order may
+// be permuted (the BVH sorts the records into leaf order), triangleId() maps a
+// record back to the mesh.
+class TriangleStore
+{
+public:
+	using Method = RayTriangleKernels::Method;
+
+	TriangleStore();
+
+	void build(const std::vector<float>& points, const std::vector<unsigned int>& indices);
+	void reorder(const std::vector<unsigned int>& order);
+	void clear();
+
+	size_t size() const { return _ids.size(); }
+	bool isEmpty() const { return _ids.empty(); }
+
+	unsigned int triangleId(size_t i) const { return _ids[i]; }
+
+	// Baldwin–Weber coefficients are only computed while that method is selected
+	Method method() const { return _method; }
+	void setMethod(Method method);
+
+	// Closest hit among records [first, first + count)
+	bool intersect(size_t first, size_t count, const RayTriangleKernels::Ray& ray, RayTriangleKernels::Hit& hit) const;
+
+	void vertices(size_t i, float* vertex1, float* vertex2, float* vertex3) const;
+
+	// Compatibility view matching the Triangle interface
+	void vertices(size_t i, QVector3D& vertex1, QVector3D& vertex2, QVector3D& vertex3) const;
+	QVector3D normal(size_t i) const;
+	Triangle* createTriangle(size_t i, QObject* parent = nullptr) const;
+
+	unsigned long long memorySize() const;
+
+private:
+	const float* component(int c) const { return &_mollerTrumbore[c * _stride]; }
+	void buildBaldwinWeber();
+
+	Method _method;
+	size_t _stride; // triangles per component array, padded for the widest packet
+	std::vector<float> _mollerTrumbore;
+	std::vector<float> _baldwinWeber;
+	std::vector<unsigned int> _ids;
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+#include <cstddef>
+#include <cstring>
+
+// CPU copies of the std140 uniform blocks of the twoside_per_fragment shaders.
+// Every member is laid out by hand with the padding std140 puts in, vec3s take
+// a vec4 slot unless a scalar fits behind them, bools are 4 byte ints. The
+// static_asserts hold the offsets to the ones listed in the shaders.
+
+// Per view state: camera, light, tone mapping and clipping, GLWidget::render
+struct FrameUniforms
+{
+	static constexpr unsigned int BINDING = 0;
+
+	float modelMatrix[16];
+	float viewMatrix[16];
+	float modelViewMatrix[16];
+	float projectionMatrix[16];
+	float viewportMatrix[16];
+	float lightSpaceMatrix[16];
+	float normalMatrix[12];    // mat3, columns padded to vec4
+	float clipPlaneX[4];
+	float clipPlaneY[4];
+	float clipPlaneZ[4];
+	float clipPlane[4];
+	float cameraPos[4];
+	float lightPos[4];
+	// LightSource lightSource
+	float lightAmbient[4];
+	float lightDiffuse[4];
+	float lightSpecular[4];
+	float lightPosition[4];
+	// LightModel lightModel
+	float modelAmbient[4];
+	// LineInfo Line
+	float lineWidth;
+	float linePad[3];
+	float lineColor[4];
+	int displayMode;
+	int renderingMode;
+	int envMapEnabled;
+	int shadowsEnabled;
+	int reflectionMapEnabled;
+	int lockLightAndCamera;
+	int hdrToneMapping;
+	int gammaCorrection;
+	float screenGamma;
+	float shadowSamples;
+	int sectionActive;
+	int floorRendering;
+};
+static_assert(offsetof(FrameUniforms, normalMatrix) == 384, "FrameUniforms layout");
+static_assert(offsetof(FrameUniforms, cameraPos) == 496, "FrameUniforms layout");
+static_assert(offsetof(FrameUniforms, lineColor) == 624, "FrameUniforms layout");
+static_assert(offsetof(FrameUniforms, screenGamma) == 672, "FrameUniforms layout");
+static_assert(sizeof(FrameUniforms) == 688, "FrameUniforms layout");
+
+// Per mesh material state, TriangleMesh::setupUniforms
+struct MaterialUniforms
+{
+	static constexpr unsigned int BINDING = 1;
+
+	// Material material
+	float emission[3];
+	float pad0;
+	float ambient[3];
+	float pad1;
+	float diffuse[3];
+	float pad2;
+	float specular[3];
+	float shininess;
+	int metallic;
+	int pad3[3];
+	// PBRLighting pbrLighting
+	float albedo[3];
+	float metalness;
+	float roughness;
+	float ambientOcclusion;
+	float pad4[2];
+	float opacity;
+	float heightScale;
+	int materialIndex;
+	int texEnabled;
+	int hasDiffuseTexture;
+	int hasSpecularTexture;
+	int hasEmissiveTexture;
+	int hasNormalTexture;
+	int hasHeightTexture;
+	int hasOpacityTexture;
+	int opacityTextureInverted;
+	int hasAlbedoMap;
+	int hasMetallicMap;
+	int hasRoughnessMap;
+	int hasNormalMap;
+	int hasAOMap;
+	int hasHeightMap;
+	int hasOpacityMap;
+	int opacityMapInverted;
+	int pad5;
+};
+static_assert(offsetof(MaterialUniforms, metallic) == 64, "MaterialUniforms layout");
+static_assert(offsetof(MaterialUniforms, albedo) == 80, "MaterialUniforms layout");
+static_assert(offsetof(MaterialUniforms, opacity) == 112, "MaterialUniforms layout");
+static_assert(offsetof(MaterialUniforms, opacityMapInverted) == 184, "MaterialUniforms layout");
+static_assert(sizeof(MaterialUniforms) == 192, "MaterialUniforms layout");
+
+// Per draw state of a multi draw batch, one entry per draw of the std430
+// DrawUniforms buffer, IndirectDraws. The same members as the per mesh
+// uniforms, the struct rules of std430 keep the material at std140 offsets.
+struct DrawUniforms
+{
+	static constexpr unsigned int BINDING = 4;
+
+	float meshMatrix[16];
+	float meshNormalMatrix[12]; // mat3, columns padded to vec4
+	int bitangentFromTangent;
+	int selected;
+	int pad[2];
+	MaterialUniforms material;
+};
+static_assert(offsetof(DrawUniforms, bitangentFromTangent) == 112, "DrawUniforms layout");
+static_assert(offsetof(DrawUniforms, material) == 128, "DrawUniforms layout");
+static_assert(sizeof(DrawUniforms) == 320, "DrawUniforms layout");
+
+// The state that differs between the views of the four view layout, read by
+// the MULTI_VIEW builds that draw all of them in one pass, GLWidget::drawMeshViews
+struct ViewUniforms
+{
+	static constexpr unsigned int BINDING = 2;
+	static constexpr int VIEW_COUNT = 4;
+
+	struct View
+	{
+		float view[16];
+		float modelView[16];
+		float projection[16];
+		float viewport[16];
+		float normalTransform[12]; // mat3, columns padded to vec4
+		int shadows;
+		int pad[3];
+	};
+	View views[VIEW_COUNT];
+};
+static_assert(offsetof(ViewUniforms::View, shadows) == 304, "ViewUniforms layout");
+static_assert(sizeof(ViewUniforms) == 4 * 320, "ViewUniforms layout");
+
+namespace Std140
+{
+	inline void set(float (&dst)[16], const QMatrix4x4& m)
+	{
+		memcpy(dst, m.constData(), sizeof(dst));
+	}
+
+	inline void set(float (&dst)[12], const QMatrix3x3& m)
+	{
+		const float* src = m.constData();
+		for (int col = 0; col < 3; col++)
+		{
+			dst[col * 4 + 0] = src[col * 3 + 0];
+			dst[col * 4 + 1] = src[col * 3 + 1];
+			dst[col * 4 + 2] = src[col * 3 + 2];
+			dst[col * 4 + 3] = 0.0f;
+		}
+	}
+
+	inline void set(float (&dst)[4], const QVector4D& v)
+	{
+		dst[0] = v.x();
+		dst[1] = v.y();
+		dst[2] = v.z();
+		dst[3] = v.w();
+	}
+
+	template <size_t N>
+	inline void set(float (&dst)[N], const QVector3D& v)
+	{
+		static_assert(N == 3 || N == 4, "vec3 slots have 3 or 4 floats");
+		dst[0] = v.x();
+		dst[1] = v.y();
+		dst[2] = v.z();
+		if (N == 4)
+			dst[N - 1] = 0.0f;
+	}
+}
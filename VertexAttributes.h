@@ -0,0 +1,16 @@
+#pragma once
+
+#include <qopengl.h>
+
+// Attribute locations of the mesh vertex data. Every shader drawing a
+// TriangleMesh declares its inputs at them, so a mesh's vertex array works
+// with all of them and is only set up when its buffers are uploaded.
+namespace VertexAttributes
+{
+	constexpr GLuint POSITION   = 0; // vertexPosition
+	constexpr GLuint NORMAL     = 1; // vertexNormal
+	constexpr GLuint TEX_COORD  = 2; // texCoord2d
+	constexpr GLuint TANGENT    = 3; // vertexTangent
+	constexpr GLuint BITANGENT  = 4; // vertexBitangent
+	constexpr GLuint DRAW_INDEX = 5; // drawIndex of the MULTI_DRAW shaders, geometry arena VAOs only
+}
@@ -19,6 +19,8 @@ int main(int argc, char** argv)
 	QCoreApplication::setOrganizationName("Sharjith N");
     QCoreApplication::setApplicationVersion(QT_VERSION_STR);
     QApplication::setAttribute(Qt::AA_DisableHighDpiScaling);
+    // All the document windows' GL contexts share one group, so textures are made once
+    QApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
 
     QApplication app(argc, argv);
 
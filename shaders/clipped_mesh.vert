@@ -5,6 +5,7 @@ layout(location = 0) in vec3 vertexPosition;
 uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 projectionMatrix;
+uniform mat4 meshMatrix; // per mesh transformation
 
 uniform vec4 clipPlaneX;
 uniform vec4 clipPlaneY;
@@ -19,12 +20,13 @@ out float v_clipDist;
 
 void main()
 {
-    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vertexPosition, 1);
+    vec4 position = meshMatrix * vec4(vertexPosition, 1);
+    gl_Position = projectionMatrix * viewMatrix * modelMatrix * position;
 
-    v_clipDistX = dot(clipPlaneX, viewMatrix * modelMatrix * vec4(vertexPosition, 1));
-    v_clipDistY = dot(clipPlaneY, viewMatrix * modelMatrix* vec4(vertexPosition, 1));
-    v_clipDistZ = dot(clipPlaneZ, viewMatrix * modelMatrix* vec4(vertexPosition, 1));
-    v_clipDist =  dot(clipPlane, viewMatrix * modelMatrix* vec4(vertexPosition, 1));
+    v_clipDistX = dot(clipPlaneX, viewMatrix * modelMatrix * position);
+    v_clipDistY = dot(clipPlaneY, viewMatrix * modelMatrix* position);
+    v_clipDistZ = dot(clipPlaneZ, viewMatrix * modelMatrix* position);
+    v_clipDist =  dot(clipPlane, viewMatrix * modelMatrix* position);
 
     gl_ClipDistance[0] = v_clipDistX;
     gl_ClipDistance[1] = v_clipDistY;
@@ -1,7 +1,7 @@
 #version 450 core
 
 layout (location = 0) in vec3 vertexPosition;
-in vec2 texCoord2d;
+layout (location = 2) in vec2 texCoord2d;
 
 uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
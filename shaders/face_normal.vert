@@ -9,6 +9,8 @@ out VS_OUT {
 
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
+uniform mat4 meshMatrix;       // per mesh transformation
+uniform mat3 meshNormalMatrix; // inverse transpose of meshMatrix
 uniform vec4 clipPlaneX;
 uniform vec4 clipPlaneY;
 uniform vec4 clipPlaneZ;
@@ -22,12 +24,14 @@ out float clipDist;
 
 void main()
 {
+    vec4 position = meshMatrix * vec4(vertexPosition, 1);
+    vec3 normal = meshNormalMatrix * vertexNormal;
     mat3 normalMatrix = mat3(transpose(inverse(modelViewMatrix)));
-    vs_out.normal = normalize(vec3(projectionMatrix * vec4(normalMatrix * vertexNormal, 0.0)));
-    gl_Position = projectionMatrix * modelViewMatrix * vec4(vertexPosition, 1.0);
+    vs_out.normal = normalize(vec3(projectionMatrix * vec4(normalMatrix * normal, 0.0)));
+    gl_Position = projectionMatrix * modelViewMatrix * position;
 
-    clipDistX = dot(clipPlaneX, modelViewMatrix* vec4(vertexPosition, 1));
-    clipDistY = dot(clipPlaneY, modelViewMatrix* vec4(vertexPosition, 1));
-    clipDistZ = dot(clipPlaneZ, modelViewMatrix* vec4(vertexPosition, 1));
-    clipDist = dot(clipPlane, modelViewMatrix* vec4(vertexPosition, 1));
+    clipDistX = dot(clipPlaneX, modelViewMatrix* position);
+    clipDistY = dot(clipPlaneY, modelViewMatrix* position);
+    clipDistZ = dot(clipPlaneZ, modelViewMatrix* position);
+    clipDist = dot(clipPlane, modelViewMatrix* position);
 }
\ No newline at end of file
@@ -4,8 +4,10 @@ layout(location = 0) in vec3 vertexPosition;
 
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
+uniform mat4 meshMatrix; // per mesh transformation
 
 void main()
 {
-    gl_Position = projectionMatrix * modelViewMatrix * vec4(vertexPosition, 1);
+    vec4 position = meshMatrix * vec4(vertexPosition, 1);
+    gl_Position = projectionMatrix * modelViewMatrix * position;
 }
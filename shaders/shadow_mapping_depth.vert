@@ -3,8 +3,27 @@ layout (location = 0) in vec3 aPos;
 
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
+#ifdef MULTI_DRAW
+// The DrawUniforms entries of IndirectDraws, only the transformation is used
+layout(location = 5) in uint drawIndex;
+
+struct DrawData
+{
+    mat4 meshMatrix;
+    vec4 rest[16];
+};
+
+layout(std430, binding = 4) readonly buffer DrawUniforms
+{
+    DrawData draws[];
+};
+
+#define meshMatrix draws[drawIndex].meshMatrix
+#else
+uniform mat4 meshMatrix; // per mesh transformation
+#endif
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = lightSpaceMatrix * model * meshMatrix * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -1,14 +1,41 @@
 #version 450 core
 #extension GL_OES_standard_derivatives : enable
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
 
 // Adpated from https://learnopengl.com/
 
+// Compiled in variants, ShaderVariants defines the features a variant has:
+// WIRESHADED, PBR_LIGHTING, TEXTURE_MAPS, SHADOWS and ENVIRONMENT_MAP.
+// MULTI_DRAW variants read the per mesh state from the batch's DrawUniforms.
+// MULTI_VIEW variants draw all views of the four view layout in one pass.
+// Only WIRESHADED runs the geometry shader, the other variants read the
+// vertex shader outputs directly.
+#ifndef WIRESHADED
+#define g_position           v_position
+#define g_normal             v_normal
+#define g_texCoord2d         v_texCoord2d
+#define g_tangent            v_tangent
+#define g_bitangent          v_bitangent
+#define g_reflectionPosition v_reflectionPosition
+#define g_reflectionNormal   v_reflectionNormal
+#define g_tangentLightPos    v_tangentLightPos
+#define g_tangentViewPos     v_tangentViewPos
+#define g_tangentFragPos     v_tangentFragPos
+#define g_drawIndex          v_drawIndex
+#define g_viewIndex          v_viewIndex
+#define GS_OUT_SHADOW        VS_OUT_SHADOW
+#endif
+
 in vec3 g_position;
 in vec3 g_normal;
 in vec2 g_texCoord2d;
 in vec3 g_tangent;
 in vec3 g_bitangent;
+#ifdef WIRESHADED
 noperspective in vec3 g_edgeDistance;
+#endif
 in vec3 g_reflectionPosition;
 in vec3 g_reflectionNormal;
 in vec3 g_tangentLightPos;
@@ -24,74 +51,12 @@ in GS_OUT_SHADOW {
     vec3 lightPos;
 } fs_in_shadow;
 
-uniform float opacity;
-uniform bool texEnabled;
-uniform sampler2D texUnit;
-
-// ADS light maps
-uniform sampler2D texture_diffuse;
-uniform sampler2D texture_specular;
-uniform sampler2D texture_emissive;
-uniform sampler2D texture_normal;
-uniform sampler2D texture_height;
-uniform sampler2D texture_opacity;
-uniform bool hasDiffuseTexture = false;
-uniform bool hasSpecularTexture = false;
-uniform bool hasEmissiveTexture = false;
-uniform bool hasNormalTexture = false;
-uniform bool hasHeightTexture = false;
-uniform bool hasOpacityTexture = false;
-uniform bool opacityTextureInverted = false;
-
-uniform samplerCube envMap;
-uniform sampler2D shadowMap;
-// IBL
-uniform samplerCube irradianceMap;
-uniform samplerCube prefilterMap;
-uniform sampler2D brdfLUT;
-
-// material parameters
-uniform sampler2D albedoMap;
-uniform sampler2D normalMap;
-uniform sampler2D metallicMap;
-uniform sampler2D roughnessMap;
-uniform sampler2D heightMap;
-uniform sampler2D aoMap;
-uniform sampler2D opacityMap;
-uniform bool hasAlbedoMap;
-uniform bool hasMetallicMap;
-uniform bool hasRoughnessMap;
-uniform bool hasNormalMap;
-uniform bool hasAOMap;
-uniform bool hasHeightMap;
-uniform float heightScale;
-uniform bool hasOpacityMap;
-uniform bool opacityMapInverted = false;
-
-uniform bool envMapEnabled;
-uniform bool shadowsEnabled;
-uniform float shadowSamples;
-uniform vec3 cameraPos;
-uniform mat4 viewMatrix;
-uniform bool sectionActive;
-uniform int displayMode;
-uniform int renderingMode;
-uniform bool selected;
-uniform vec4 reflectColor;
-uniform bool floorRendering;
-uniform bool lockLightAndCamera = true;
-uniform bool hdrToneMapping = false;
-uniform bool gammaCorrection = false;
-uniform float screenGamma = 2.2;
-
 struct LineInfo
 {
     float Width;
     vec4 Color;
 };
 
-uniform LineInfo Line;
-
 struct LightSource
 {
     vec3 ambient;
@@ -99,13 +64,44 @@ struct LightSource
     vec3 specular;
     vec3 position;
 };
-uniform LightSource lightSource;
 
 struct LightModel
 {
     vec3 ambient;
 };
-uniform LightModel lightModel;
+
+// Per view state, the same block in all stages, mirrored by FrameUniforms in UniformBlocks.h
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 modelMatrix;
+    mat4 viewMatrix;
+    mat4 modelViewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewportMatrix;
+    mat4 lightSpaceMatrix;
+    mat3 normalMatrix;
+    vec4 clipPlaneX;
+    vec4 clipPlaneY;
+    vec4 clipPlaneZ;
+    vec4 clipPlane;          // user defined clip plane
+    vec3 cameraPos;
+    vec3 lightPos;
+    LightSource lightSource;
+    LightModel lightModel;
+    LineInfo Line;
+    int displayMode;
+    int renderingMode;
+    bool envMapEnabled;
+    bool shadowsEnabled;
+    bool reflectionMapEnabled;
+    bool lockLightAndCamera;
+    bool hdrToneMapping;
+    bool gammaCorrection;
+    float screenGamma;
+    float shadowSamples;
+    bool sectionActive;
+    bool floorRendering;
+};
 
 struct Material {
     vec3  emission;
@@ -115,7 +111,6 @@ struct Material {
     float shininess;
     bool  metallic;
 };
-uniform Material material;
 
 struct PBRLighting {
     vec3 albedo;
@@ -123,7 +118,190 @@ struct PBRLighting {
     float roughness;
     float ambientOcclusion;
 };
-uniform PBRLighting pbrLighting;
+
+// Per mesh material state, mirrored by MaterialUniforms in UniformBlocks.h.
+// The ADS light map flags come before the PBR map ones.
+#define MATERIAL_MEMBERS \
+    Material material; \
+    PBRLighting pbrLighting; \
+    float opacity; \
+    float heightScale; \
+    int materialIndex; \
+    bool texEnabled; \
+    bool hasDiffuseTexture; \
+    bool hasSpecularTexture; \
+    bool hasEmissiveTexture; \
+    bool hasNormalTexture; \
+    bool hasHeightTexture; \
+    bool hasOpacityTexture; \
+    bool opacityTextureInverted; \
+    bool hasAlbedoMap; \
+    bool hasMetallicMap; \
+    bool hasRoughnessMap; \
+    bool hasNormalMap; \
+    bool hasAOMap; \
+    bool hasHeightMap; \
+    bool hasOpacityMap; \
+    bool opacityMapInverted;
+
+#ifdef MULTI_DRAW
+struct MaterialData
+{
+    MATERIAL_MEMBERS
+};
+
+// Per draw state of a multi draw batch, mirrored by DrawUniforms in UniformBlocks.h
+struct DrawData
+{
+    mat4 meshMatrix;
+    mat3 meshNormalMatrix;
+    bool bitangentFromTangent;
+    bool selected;
+    MaterialData materialData;
+};
+
+layout(std430, binding = 4) readonly buffer DrawUniforms
+{
+    DrawData draws[];
+};
+
+flat in uint g_drawIndex;
+
+#define drawMaterial           draws[g_drawIndex].materialData
+#define material               drawMaterial.material
+#define pbrLighting            drawMaterial.pbrLighting
+#define opacity                drawMaterial.opacity
+#define heightScale            drawMaterial.heightScale
+#define materialIndex          drawMaterial.materialIndex
+#define opacityTextureInverted drawMaterial.opacityTextureInverted
+#define opacityMapInverted     drawMaterial.opacityMapInverted
+#define selected               draws[g_drawIndex].selected
+#else
+layout(std140, binding = 1) uniform MaterialUniforms
+{
+    MATERIAL_MEMBERS
+};
+
+uniform bool selected;
+#endif
+
+#ifdef MULTI_VIEW
+// The state that differs between the views of the four view layout, mirrored by ViewUniforms in UniformBlocks.h
+struct ViewData
+{
+    mat4 view;
+    mat4 modelView;
+    mat4 projection;
+    mat4 viewport;
+    mat3 normalTransform;
+    bool shadows;
+};
+
+layout(std140, binding = 2) uniform ViewUniforms
+{
+    ViewData views[4];
+};
+
+flat in int g_viewIndex;
+
+#ifdef SHADOWS
+// Only the views that show shadows have them
+#define shadowsEnabled views[g_viewIndex].shadows
+#endif
+#endif
+
+// Features left out of the variant are constants, their code is compiled away
+#ifndef PBR_LIGHTING
+#define renderingMode 0
+#endif
+#ifndef SHADOWS
+#define shadowsEnabled false
+#endif
+#ifndef ENVIRONMENT_MAP
+#define envMapEnabled false
+#endif
+#ifndef TEXTURE_MAPS
+#define texEnabled         false
+#define hasDiffuseTexture  false
+#define hasSpecularTexture false
+#define hasEmissiveTexture false
+#define hasNormalTexture   false
+#define hasHeightTexture   false
+#define hasOpacityTexture  false
+#define hasAlbedoMap       false
+#define hasMetallicMap     false
+#define hasRoughnessMap    false
+#define hasNormalMap       false
+#define hasAOMap           false
+#define hasHeightMap       false
+#define hasOpacityMap      false
+#elif defined(MULTI_DRAW)
+#define texEnabled         drawMaterial.texEnabled
+#define hasDiffuseTexture  drawMaterial.hasDiffuseTexture
+#define hasSpecularTexture drawMaterial.hasSpecularTexture
+#define hasEmissiveTexture drawMaterial.hasEmissiveTexture
+#define hasNormalTexture   drawMaterial.hasNormalTexture
+#define hasHeightTexture   drawMaterial.hasHeightTexture
+#define hasOpacityTexture  drawMaterial.hasOpacityTexture
+#define hasAlbedoMap       drawMaterial.hasAlbedoMap
+#define hasMetallicMap     drawMaterial.hasMetallicMap
+#define hasRoughnessMap    drawMaterial.hasRoughnessMap
+#define hasNormalMap       drawMaterial.hasNormalMap
+#define hasAOMap           drawMaterial.hasAOMap
+#define hasHeightMap       drawMaterial.hasHeightMap
+#define hasOpacityMap      drawMaterial.hasOpacityMap
+#endif
+
+uniform vec4 reflectColor;
+
+#ifdef BINDLESS_TEXTURES
+// Resident handles of the material maps, a row of 14 per material in texture unit order
+layout(std430, binding = 3) readonly buffer MaterialTextures
+{
+    sampler2D materialTextures[];
+};
+#define materialTexture(slot) materialTextures[materialIndex * 14 + slot]
+#define texUnit          materialTexture(0)
+#define texture_diffuse  materialTexture(1)
+#define texture_specular materialTexture(2)
+#define texture_emissive materialTexture(3)
+#define texture_normal   materialTexture(4)
+#define texture_height   materialTexture(5)
+#define texture_opacity  materialTexture(6)
+#define albedoMap        materialTexture(7)
+#define normalMap        materialTexture(8)
+#define metallicMap      materialTexture(9)
+#define roughnessMap     materialTexture(10)
+#define aoMap            materialTexture(11)
+#define heightMap        materialTexture(12)
+#define opacityMap       materialTexture(13)
+#else
+layout(binding = 0) uniform sampler2D texUnit;
+
+// ADS light maps
+layout(binding = 10) uniform sampler2D texture_diffuse;
+layout(binding = 11) uniform sampler2D texture_specular;
+layout(binding = 12) uniform sampler2D texture_emissive;
+layout(binding = 13) uniform sampler2D texture_normal;
+layout(binding = 14) uniform sampler2D texture_height;
+layout(binding = 15) uniform sampler2D texture_opacity;
+
+// PBR maps
+layout(binding = 20) uniform sampler2D albedoMap;
+layout(binding = 21) uniform sampler2D normalMap;
+layout(binding = 22) uniform sampler2D metallicMap;
+layout(binding = 23) uniform sampler2D roughnessMap;
+layout(binding = 24) uniform sampler2D aoMap;
+layout(binding = 25) uniform sampler2D heightMap;
+layout(binding = 26) uniform sampler2D opacityMap;
+#endif
+
+layout(binding = 1) uniform samplerCube envMap;
+layout(binding = 2) uniform sampler2D shadowMap;
+// IBL
+layout(binding = 3) uniform samplerCube irradianceMap;
+layout(binding = 4) uniform samplerCube prefilterMap;
+layout(binding = 5) uniform sampler2D brdfLUT;
 
 const float PI = 3.14159265359;
 
@@ -134,6 +312,7 @@ vec4    shadeBlinnPhong(LightSource source, LightModel model, Material mat, vec3
 vec4    calculatePBRLighting(int renderMode, float side);
 void    applyEnvironmentMapping(float alpha);
 
+vec3    sampleNormalMap(sampler2D map, vec2 texCoord);
 vec3    getNormalFromMap();
 mat3    getTBNFromMap();
 float   distributionGGX(vec3 N, vec3 H, float roughness);
@@ -187,6 +366,7 @@ void main()
     }
     else // wireshaded
     {
+#ifdef WIRESHADED
         // Find the smallest distance
         float d = min(g_edgeDistance.x, g_edgeDistance.y );
         d = min( d, g_edgeDistance.z );
@@ -211,7 +391,7 @@ void main()
         float lightness = 0.2126*v_color.r + 0.7152*v_color.g + 0.0722*v_color.b;
         vec4 linecolor = lightness > 0.05f ? Line.Color : vec4(1.0f) - avg;
         fragColor = mix(v_color, linecolor, mixVal);
-
+#endif
     }
 
     // Get alpha from maps if available
@@ -249,8 +429,10 @@ void main()
         vec3 result = (ambient + diffuse + specular) * objectColor;
         fragColor = vec4(result, opacity);
 
+#ifdef WIRESHADED
         if(displayMode == 2)
             fragColor = mix(fragColor, Line.Color, mixVal);
+#endif
     }
 }
 
@@ -662,6 +844,15 @@ void applyEnvironmentMapping(float alpha)
     }
 }
 
+// ----------------------------------------------------------------------------
+// Tangent space normal in [-1, 1]. z is rebuilt from x and y since compressed
+// normal maps only store those two.
+vec3 sampleNormalMap(sampler2D map, vec2 texCoord)
+{
+    vec2 xy = texture(map, texCoord).xy * 2.0 - 1.0;
+    return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+}
+
 // ----------------------------------------------------------------------------
 // Easy trick to get tangent-normals to world-space to keep PBR code simplified.
 // Don't worry if you don't get what's going on; you generally want to do normal
@@ -669,7 +860,7 @@ void applyEnvironmentMapping(float alpha)
 // technique somewhere later in the normal mapping tutorial.
 vec3 getNormalFromMap()
 {
-    vec3 tangentNormal = texture(normalMap, g_texCoord2d).xyz * 2.0 - 1.0;
+    vec3 tangentNormal = sampleNormalMap(normalMap, g_texCoord2d);
 
     vec3 Q1  = dFdx(g_position);
     vec3 Q2  = dFdy(g_position);
@@ -686,7 +877,7 @@ vec3 getNormalFromMap()
 
 mat3 getTBNFromMap()
 {
-    vec3 tangentNormal = texture(normalMap, g_texCoord2d).xyz * 2.0 - 1.0;
+    vec3 tangentNormal = sampleNormalMap(normalMap, g_texCoord2d);
 
     vec3 Q1  = dFdx(g_position);
     vec3 Q2  = dFdy(g_position);
@@ -760,8 +951,7 @@ vec3 calcBumpedNormal(sampler2D map, vec2 texCoord)
     vec3 tangent = normalize(g_tangent);
     tangent = normalize(tangent - dot(tangent, normal) * normal);
     vec3 bitangent = cross(tangent, normal);
-    vec3 bumpMapNormal = texture(map, texCoord).xyz;
-    bumpMapNormal = 2.0 * bumpMapNormal - vec3(1.0, 1.0, 1.0);
+    vec3 bumpMapNormal = sampleNormalMap(map, texCoord);
     vec3 newNormal;
     mat3 TBN = mat3(tangent, bitangent, normal);
     newNormal = TBN * bumpMapNormal;
@@ -1,25 +1,120 @@
 #version 450 core
+#if defined(MULTI_VIEW) && !defined(WIRESHADED)
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
 
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec2 texCoord2d;
-layout(location = 3) in vec3 vertexTangent;
+layout(location = 3) in vec4 vertexTangent;   // w is the bitangent sign in compressed vertex data
 layout(location = 4) in vec3 vertexBitangent;
 
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 modelViewMatrix;
-uniform mat3 normalMatrix;
-uniform mat4 projectionMatrix;
-uniform vec4 clipPlaneX;
-uniform vec4 clipPlaneY;
-uniform vec4 clipPlaneZ;
-uniform mat4 lightSpaceMatrix;
-uniform vec3 cameraPos;
-uniform vec3 lightPos;
-
-// user defined clip plane
-uniform vec4 clipPlane;
+struct LineInfo
+{
+    float Width;
+    vec4 Color;
+};
+
+struct LightSource
+{
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    vec3 position;
+};
+
+struct LightModel
+{
+    vec3 ambient;
+};
+
+// Per view state, the same block in all stages, mirrored by FrameUniforms in UniformBlocks.h
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 modelMatrix;
+    mat4 viewMatrix;
+    mat4 modelViewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewportMatrix;
+    mat4 lightSpaceMatrix;
+    mat3 normalMatrix;
+    vec4 clipPlaneX;
+    vec4 clipPlaneY;
+    vec4 clipPlaneZ;
+    vec4 clipPlane;          // user defined clip plane
+    vec3 cameraPos;
+    vec3 lightPos;
+    LightSource lightSource;
+    LightModel lightModel;
+    LineInfo Line;
+    int displayMode;
+    int renderingMode;
+    bool envMapEnabled;
+    bool shadowsEnabled;
+    bool reflectionMapEnabled;
+    bool lockLightAndCamera;
+    bool hdrToneMapping;
+    bool gammaCorrection;
+    float screenGamma;
+    float shadowSamples;
+    bool sectionActive;
+    bool floorRendering;
+};
+
+#ifdef MULTI_VIEW
+// The state that differs between the views of the four view layout, mirrored by ViewUniforms in UniformBlocks.h
+struct ViewData
+{
+    mat4 view;
+    mat4 modelView;
+    mat4 projection;
+    mat4 viewport;
+    mat3 normalTransform;
+    bool shadows;
+};
+
+layout(std140, binding = 2) uniform ViewUniforms
+{
+    ViewData views[4];
+};
+
+// A draw has an instance per view, each goes to the viewport of its view
+#define viewMatrix       views[gl_InstanceID].view
+#define modelViewMatrix  views[gl_InstanceID].modelView
+#define projectionMatrix views[gl_InstanceID].projection
+#define normalMatrix     views[gl_InstanceID].normalTransform
+
+flat out int v_viewIndex;
+#endif
+
+#ifdef MULTI_DRAW
+// Per draw state of a multi draw batch, mirrored by DrawUniforms in UniformBlocks.h
+layout(location = 5) in uint drawIndex; // per instance, the draw's baseInstance
+
+struct DrawData
+{
+    mat4 meshMatrix;
+    mat3 meshNormalMatrix;
+    bool bitangentFromTangent;
+    bool selected;
+    vec4 materialData[12]; // MaterialUniforms, read by the fragment shader
+};
+
+layout(std430, binding = 4) readonly buffer DrawUniforms
+{
+    DrawData draws[];
+};
+
+#define meshMatrix           draws[drawIndex].meshMatrix
+#define meshNormalMatrix     draws[drawIndex].meshNormalMatrix
+#define bitangentFromTangent draws[drawIndex].bitangentFromTangent
+
+flat out uint v_drawIndex;
+#else
+uniform mat4 meshMatrix;       // per mesh transformation
+uniform mat3 meshNormalMatrix; // inverse transpose of meshMatrix
+uniform bool bitangentFromTangent; // compressed vertex data carries no bitangent
+#endif
 
 out float v_clipDistX;
 out float v_clipDistY;
@@ -49,36 +144,42 @@ out VS_OUT_SHADOW {
 
 void main()
 {
-    v_normal     = normalize(normalMatrix * vertexNormal);                       // normal vector
-    //v_normal = mat3(transpose(inverse(modelMatrix))) * vertexNormal;
-    v_position   = vec3(modelMatrix * vec4(vertexPosition, 1));              // vertex pos in eye coords
+    vec4 position = meshMatrix * vec4(vertexPosition, 1);
+    vec3 normal = meshNormalMatrix * vertexNormal;
+    vec3 tangent = mat3(meshMatrix) * vertexTangent.xyz;
+    vec3 objectBitangent = bitangentFromTangent ? cross(vertexNormal, vertexTangent.xyz) * vertexTangent.w : vertexBitangent;
+    vec3 bitangent = mat3(meshMatrix) * objectBitangent;
+
+    v_normal     = normalize(normalMatrix * normal);                       // normal vector
+    //v_normal = mat3(transpose(inverse(modelMatrix))) * normal;
+    v_position   = vec3(modelMatrix * position);              // vertex pos in eye coords
     v_texCoord2d = texCoord2d;
-    v_tangent = normalize(normalMatrix * vertexTangent);
-    v_bitangent = normalize(normalMatrix * vertexBitangent);
+    v_tangent = normalize(normalMatrix * tangent);
+    v_bitangent = normalize(normalMatrix * bitangent);
 
-    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vertexPosition, 1);
+    gl_Position = projectionMatrix * viewMatrix * modelMatrix * position;
 
-    v_clipDistX = dot(clipPlaneX, modelViewMatrix* vec4(vertexPosition, 1));
-    v_clipDistY = dot(clipPlaneY, modelViewMatrix* vec4(vertexPosition, 1));
-    v_clipDistZ = dot(clipPlaneZ, modelViewMatrix* vec4(vertexPosition, 1));
-    v_clipDist = dot(clipPlane, modelViewMatrix* vec4(vertexPosition, 1));
+    v_clipDistX = dot(clipPlaneX, modelViewMatrix* position);
+    v_clipDistY = dot(clipPlaneY, modelViewMatrix* position);
+    v_clipDistZ = dot(clipPlaneZ, modelViewMatrix* position);
+    v_clipDist = dot(clipPlane, modelViewMatrix* position);
 
     // Shadow mapping
-    vs_out_shadow.FragPos = vec3(modelMatrix * vec4(vertexPosition, 1.0));
-    vs_out_shadow.Normal = normalize(mat3(transpose(inverse(modelMatrix))) * vertexNormal);
+    vs_out_shadow.FragPos = vec3(modelMatrix * position);
+    vs_out_shadow.Normal = normalize(mat3(transpose(inverse(modelMatrix))) * normal);
     vs_out_shadow.TexCoords = v_texCoord2d;
     vs_out_shadow.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out_shadow.FragPos, 1.0);
     vs_out_shadow.cameraPos = cameraPos;
     vs_out_shadow.lightPos = lightPos;
 
     // Cube environment mapping
-    v_reflectionPosition = vec3(modelMatrix * vec4(vertexPosition, 1.0));
-    v_reflectionNormal = normalize(mat3(transpose(inverse(modelMatrix))) * vertexNormal);
+    v_reflectionPosition = vec3(modelMatrix * position);
+    v_reflectionNormal = normalize(mat3(transpose(inverse(modelMatrix))) * normal);
 
     // Depth mapping
-    vec3 T = normalize((mat3(modelViewMatrix)) * vertexTangent);
-    //vec3 B = normalize((mat3(modelViewMatrix)) * vertexBitangent);
-    vec3 N = normalize((mat3(modelViewMatrix)) * vertexNormal);
+    vec3 T = normalize((mat3(modelViewMatrix)) * tangent);
+    //vec3 B = normalize((mat3(modelViewMatrix)) * bitangent);
+    vec3 N = normalize((mat3(modelViewMatrix)) * normal);
     vec3 B = cross(N, T);
     if (dot(cross(N, T), B) < 0.0f)
     {
@@ -90,11 +191,22 @@ void main()
     v_tangentViewPos  = TBN * cameraPos;
     v_tangentFragPos  = TBN * v_position;
 
-    // Moved this to geometry shader
-    /*
-    gl_ClipDistance[0] = clipDistX;
-    gl_ClipDistance[1] = clipDistY;
-    gl_ClipDistance[2] = clipDistZ;
-    gl_ClipDistance[3] = clipDist;
-    */
+#ifdef MULTI_DRAW
+    v_drawIndex = drawIndex;
+#endif
+
+#ifdef MULTI_VIEW
+    v_viewIndex = gl_InstanceID;
+#ifndef WIRESHADED
+    gl_ViewportIndex = gl_InstanceID;
+#endif
+#endif
+
+#ifndef WIRESHADED
+    // The geometry shader clips where there is one
+    gl_ClipDistance[0] = v_clipDistX;
+    gl_ClipDistance[1] = v_clipDistY;
+    gl_ClipDistance[2] = v_clipDistZ;
+    gl_ClipDistance[3] = v_clipDist;
+#endif
 }
\ No newline at end of file
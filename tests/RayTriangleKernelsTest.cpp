@@ -0,0 +1,135 @@
+// Checks the RayTriangleKernels of every instruction set the CPU supports
+// against the TriangleMollerTrumbore and TriangleBaldwinWeber classes: the
+// nearest hit of each ray over a soup of random triangles has to be the same
+// triangle at the same distance. Returns non-zero on any mismatch.
+
+#include "RayTriangleKernels.h"
+#include "TriangleStore.h"
+#include "TriangleMollerTrumbore.h"
+#include "TriangleBaldwinWeber.h"
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace RayTriangleKernels;
+
+namespace
+{
+	constexpr int TRIANGLE_COUNT = 100000;
+	constexpr int RAY_COUNT = 300;
+	constexpr float DISTANCE_TOLERANCE = 1e-3f;
+
+	struct Reference
+	{
+		int triangle; // -1 for a miss
+		float t;
+	};
+
+	// Nearest hit of the ray by testing every triangle object
+	Reference nearestHit(const std::vector<std::unique_ptr<Triangle>>& triangles, const QVector3D& orig, const QVector3D& dir)
+	{
+		Reference nearest = { -1, std::numeric_limits<float>::max() };
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			QVector3D point;
+			if (triangles[i]->intersectsWithRay(orig, dir, point))
+			{
+				const float t = (point - orig).length();
+				if (t < nearest.t)
+					nearest = { static_cast<int>(i), t };
+			}
+		}
+		return nearest;
+	}
+}
+
+int main()
+{
+	std::printf("Supported instruction set: %s\n", instructionSetName(supportedInstructionSet()));
+
+	// Small triangles scattered through a box, rays from inside it towards random points
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+	std::vector<float> points;
+	std::vector<unsigned int> indices;
+	for (int i = 0; i < TRIANGLE_COUNT; i++)
+	{
+		const float center[3] = { position(rng), position(rng), position(rng) };
+		for (int vertex = 0; vertex < 3; vertex++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+				points.push_back(center[axis] + offset(rng));
+			indices.push_back(3 * i + vertex);
+		}
+	}
+
+	std::vector<QVector3D> origins;
+	std::vector<QVector3D> directions;
+	for (int r = 0; r < RAY_COUNT; r++)
+	{
+		const QVector3D orig(position(rng) * 0.3f, position(rng) * 0.3f, position(rng) * 0.3f);
+		const QVector3D target(position(rng), position(rng), position(rng));
+		origins.push_back(orig);
+		directions.push_back((target - orig).normalized());
+	}
+
+	int failures = 0;
+	for (Method method : { Method::MollerTrumbore, Method::BaldwinWeber })
+	{
+		const char* methodName = method == Method::MollerTrumbore ? "Moller-Trumbore" : "Baldwin-Weber";
+
+		std::vector<std::unique_ptr<Triangle>> triangles;
+		for (int i = 0; i < TRIANGLE_COUNT; i++)
+		{
+			const float* v = &points[9 * i];
+			const QVector3D v0(v[0], v[1], v[2]), v1(v[3], v[4], v[5]), v2(v[6], v[7], v[8]);
+			if (method == Method::MollerTrumbore)
+				triangles.emplace_back(new TriangleMollerTrumbore(v0, v1, v2));
+			else
+				triangles.emplace_back(new TriangleBaldwinWeber(v0, v1, v2));
+		}
+		std::vector<Reference> references;
+		for (int r = 0; r < RAY_COUNT; r++)
+			references.push_back(nearestHit(triangles, origins[r], directions[r]));
+
+		TriangleStore store;
+		store.setMethod(method);
+		store.build(points, indices);
+
+		for (InstructionSet isa : { InstructionSet::Scalar, InstructionSet::SSE2, InstructionSet::AVX2, InstructionSet::NEON })
+		{
+			setInstructionSet(isa);
+			if (activeInstructionSet() != isa)
+			{
+				std::printf("%s %s: not supported, skipped\n", methodName, instructionSetName(isa));
+				continue;
+			}
+
+			int mismatches = 0;
+			int hits = 0;
+			for (int r = 0; r < RAY_COUNT; r++)
+			{
+				const Ray ray = { { origins[r].x(), origins[r].y(), origins[r].z() },
+					{ directions[r].x(), directions[r].y(), directions[r].z() } };
+				Hit hit = { std::numeric_limits<float>::max(), 0.0f, 0.0f, 0 };
+				const bool found = store.intersect(0, store.size(), ray, hit);
+				const Reference& reference = references[r];
+				hits += found;
+				if (found != (reference.triangle >= 0) ||
+					(found && (static_cast<int>(store.triangleId(hit.index)) != reference.triangle ||
+						std::fabs(hit.t - reference.t) > DISTANCE_TOLERANCE)))
+					mismatches++;
+			}
+			std::printf("%s %s: %d hits, %d mismatches\n", methodName, instructionSetName(isa), hits, mismatches);
+			failures += mismatches;
+		}
+	}
+
+	setInstructionSet(supportedInstructionSet());
+	return failures == 0 ? 0 : 1;
+}